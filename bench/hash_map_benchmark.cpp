@@ -0,0 +1,410 @@
+/*
+
+Benchmarks of rstd::hash_map against std::unordered_map, and optionally
+absl::flat_hash_map and robin_hood::unordered_flat_map.
+
+Every operation is measured for each map, key distribution and value size,
+over element counts from 1K up to RSTD_BENCH_MAX_ELEMENTS. Names read
+Operation/Map/Distribution/ValueBytes/Elements, so --benchmark_filter picks
+single rows, e.g. --benchmark_filter='HitLookup/rstd/random/8/'.
+
+Built on Google Benchmark, by the opt-in target of the top-level CMakeLists.txt:
+
+  cmake -S . -B build -DCMAKE_BUILD_TYPE=Release -DRSTD_BUILD_BENCHMARKS=ON
+  cmake --build build --target hash_map_benchmark
+
+or by hand:
+
+  g++ -std=c++17 -O2 -DNDEBUG -I.. hash_map_benchmark.cpp -lbenchmark -lpthread -o hash_map_benchmark
+
+Comparing against Abseil adds -DRSTD_BENCH_WITH_ABSL and its libraries:
+
+  -labsl_hash -labsl_city -labsl_low_level_hash -labsl_raw_hash_set
+
+Comparing against robin_hood adds -DRSTD_BENCH_WITH_ROBIN_HOOD, with
+robin_hood.h on the include path.
+
+The largest rows of the request, 100M elements, need
+-DRSTD_BENCH_MAX_ELEMENTS=100000000 and tens of GB of memory. The CMake
+target takes it as the cache variable of the same name.
+
+*/
+
+#include "hash_map.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef RSTD_BENCH_WITH_ABSL
+#include <absl/container/flat_hash_map.h>
+#endif
+
+#ifdef RSTD_BENCH_WITH_ROBIN_HOOD
+#include <robin_hood.h>
+#endif
+
+#ifndef RSTD_BENCH_MAX_ELEMENTS
+#define RSTD_BENCH_MAX_ELEMENTS ( 1 << 22 )
+#endif
+
+namespace
+{
+
+  //! A value of the given size, so that moving it costs what moving a real one would.
+  template< size_t Bytes >
+  struct payload
+  {
+    uint64_t words[Bytes / 8];
+
+    payload() = default;
+
+    explicit payload( uint64_t seed ) {
+      for ( uint64_t& word : words ) {
+        word = seed;
+      }
+    }
+  };
+
+  template< typename T >
+  uint64_t firstWord( const T& value ) {
+    return value.words[0];
+  }
+
+  struct group_policy : rstd::default_hash_map_policy
+  {
+    using engine = rstd::group_engine;
+  };
+
+  /*
+  The maps under test, each with its default hash. The name shows up in the
+  benchmark names.
+  */
+  template< typename T >
+  struct rstd_map
+  {
+    using type = rstd::hash_map<uint64_t, T>;
+    static constexpr const char* name = "rstd";
+  };
+
+  template< typename T >
+  struct rstd_group_map
+  {
+    using type = rstd::hash_map<uint64_t, T, rstd::hash<uint64_t>, std::equal_to<uint64_t>, std::allocator<std::pair<const uint64_t, T>>, group_policy>;
+    static constexpr const char* name = "rstd_group";
+  };
+
+  template< typename T >
+  struct std_map
+  {
+    using type = std::unordered_map<uint64_t, T>;
+    static constexpr const char* name = "std";
+  };
+
+#ifdef RSTD_BENCH_WITH_ABSL
+  template< typename T >
+  struct absl_map
+  {
+    using type = absl::flat_hash_map<uint64_t, T>;
+    static constexpr const char* name = "absl";
+  };
+#endif
+
+#ifdef RSTD_BENCH_WITH_ROBIN_HOOD
+  template< typename T >
+  struct robin_hood_map
+  {
+    using type = robin_hood::unordered_flat_map<uint64_t, T>;
+    static constexpr const char* name = "robin_hood";
+  };
+#endif
+
+  //! Returns the value stored at the key, or nullptr. The std style maps.
+  template< typename Map >
+  const typename Map::mapped_type* findValue( const Map& map, uint64_t key ) {
+    auto found = map.find( key );
+    return found == map.end() ? nullptr : &( found->second );
+  }
+
+  template< typename K, typename T, typename Hash, typename KeyEqual, typename Allocator, typename Policy >
+  const T* findValue( const rstd::hash_map<K, T, Hash, KeyEqual, Allocator, Policy>& map, uint64_t key ) {
+    return map.find( key );
+  }
+
+  template< typename Map >
+  void reserveFor( Map& map, size_t elementCount ) {
+    map.reserve( elementCount );
+  }
+
+  enum class distribution
+  {
+    sequential,
+    random,
+    strided
+  };
+
+  const char* nameOf( distribution keys ) {
+    switch ( keys ) {
+      case distribution::sequential:
+        return "sequential";
+      case distribution::random:
+        return "random";
+      default:
+        return "strided";
+    }
+  }
+
+  /*
+  Returns elementCount distinct keys of the distribution, followed by as many
+  keys of the same shape that are not among them, for misses. Strided keys are
+  4096 apart, like page aligned pointers, which hurts maps that mask the low bits.
+  */
+  const std::vector<uint64_t>& keysFor( distribution keys, size_t elementCount ) {
+
+    static std::map<std::pair<distribution, size_t>, std::vector<uint64_t>> cache;
+
+    std::vector<uint64_t>& generated = cache[{ keys, elementCount }];
+    if ( !generated.empty() ) {
+      return generated;
+    }
+
+    generated.resize( elementCount * 2 );
+
+    if ( keys == distribution::random ) {
+
+      std::mt19937_64 rng( elementCount );
+      for ( uint64_t& key : generated ) {
+        key = rng();
+      }
+
+      // Collisions among 64-bit random keys are rare enough to simply patch up.
+      std::vector<uint64_t> sorted( generated );
+      std::sort( sorted.begin(), sorted.end() );
+      for ( size_t i = 1; i < sorted.size(); i++ ) {
+        if ( sorted[i] == sorted[i - 1] ) {
+          std::replace( generated.begin(), generated.end(), sorted[i], (uint64_t) ( sorted[i] ^ 0x8000000000000000ull ) );
+        }
+      }
+    }
+    else {
+      uint64_t stride = keys == distribution::strided ? 4096 : 1;
+      for ( size_t i = 0; i < generated.size(); i++ ) {
+        generated[i] = i * stride;
+      }
+    }
+
+    return generated;
+  }
+
+  template< typename Map >
+  void fill( Map& map, const std::vector<uint64_t>& keys, size_t elementCount ) {
+    using value = typename Map::mapped_type;
+    for ( size_t i = 0; i < elementCount; i++ ) {
+      map[keys[i]] = value( keys[i] );
+    }
+  }
+
+  template< typename Map >
+  void benchInsert( benchmark::State& state, distribution distributed ) {
+
+    size_t elementCount = (size_t) state.range( 0 );
+    const std::vector<uint64_t>& keys = keysFor( distributed, elementCount );
+
+    for ( auto _ : state ) {
+      Map map;
+      fill( map, keys, elementCount );
+      benchmark::DoNotOptimize( map );
+    }
+
+    state.SetItemsProcessed( state.iterations() * elementCount );
+  }
+
+  template< typename Map >
+  void benchReservedInsert( benchmark::State& state, distribution distributed ) {
+
+    size_t elementCount = (size_t) state.range( 0 );
+    const std::vector<uint64_t>& keys = keysFor( distributed, elementCount );
+
+    for ( auto _ : state ) {
+      Map map;
+      reserveFor( map, elementCount );
+      fill( map, keys, elementCount );
+      benchmark::DoNotOptimize( map );
+    }
+
+    state.SetItemsProcessed( state.iterations() * elementCount );
+  }
+
+  //! Looks up the stored keys, or with miss set, the keys that were never stored.
+  template< typename Map >
+  void benchLookup( benchmark::State& state, distribution distributed, bool miss ) {
+
+    size_t elementCount = (size_t) state.range( 0 );
+    const std::vector<uint64_t>& keys = keysFor( distributed, elementCount );
+
+    Map map;
+    fill( map, keys, elementCount );
+
+    // Looking keys up in another order than they were inserted in defeats the prefetcher a bit, as real traffic would.
+    std::vector<uint64_t> probes( keys.begin() + ( miss ? elementCount : 0 ), keys.begin() + ( miss ? 2 * elementCount : elementCount ) );
+    std::shuffle( probes.begin(), probes.end(), std::mt19937_64( 42 ) );
+
+    for ( auto _ : state ) {
+      uint64_t sum = 0;
+      for ( uint64_t key : probes ) {
+        const auto* found = findValue( map, key );
+        sum += found == nullptr ? 1 : firstWord( *found );
+      }
+      benchmark::DoNotOptimize( sum );
+    }
+
+    state.SetItemsProcessed( state.iterations() * elementCount );
+  }
+
+  template< typename Map >
+  void benchErase( benchmark::State& state, distribution distributed ) {
+
+    size_t elementCount = (size_t) state.range( 0 );
+    const std::vector<uint64_t>& keys = keysFor( distributed, elementCount );
+
+    for ( auto _ : state ) {
+
+      state.PauseTiming();
+      Map map;
+      fill( map, keys, elementCount );
+      state.ResumeTiming();
+
+      for ( size_t i = 0; i < elementCount; i++ ) {
+        map.erase( keys[i] );
+      }
+      benchmark::DoNotOptimize( map );
+
+      state.PauseTiming();
+      { Map dropped( std::move( map ) ); }
+      state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed( state.iterations() * elementCount );
+  }
+
+  template< typename Map >
+  void benchIterate( benchmark::State& state, distribution distributed ) {
+
+    size_t elementCount = (size_t) state.range( 0 );
+    Map map;
+    fill( map, keysFor( distributed, elementCount ), elementCount );
+
+    for ( auto _ : state ) {
+      uint64_t sum = 0;
+      for ( const auto& entry : map ) {
+        sum += firstWord( entry.second );
+      }
+      benchmark::DoNotOptimize( sum );
+    }
+
+    state.SetItemsProcessed( state.iterations() * elementCount );
+  }
+
+  template< typename Map >
+  void benchCopy( benchmark::State& state, distribution distributed ) {
+
+    size_t elementCount = (size_t) state.range( 0 );
+    Map map;
+    fill( map, keysFor( distributed, elementCount ), elementCount );
+
+    for ( auto _ : state ) {
+      Map copy( map );
+      benchmark::DoNotOptimize( copy );
+      state.PauseTiming();
+      { Map dropped( std::move( copy ) ); }
+      state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed( state.iterations() * elementCount );
+  }
+
+  template< typename Map >
+  void benchClear( benchmark::State& state, distribution distributed ) {
+
+    size_t elementCount = (size_t) state.range( 0 );
+    const std::vector<uint64_t>& keys = keysFor( distributed, elementCount );
+    Map map;
+
+    for ( auto _ : state ) {
+      state.PauseTiming();
+      fill( map, keys, elementCount );
+      state.ResumeTiming();
+
+      map.clear();
+      benchmark::DoNotOptimize( map );
+    }
+
+    state.SetItemsProcessed( state.iterations() * elementCount );
+  }
+
+  template< typename Map, typename Bench >
+  void registerOne( const std::string& operation, const char* mapName, distribution distributed, size_t valueBytes, Bench bench ) {
+
+    std::string name = operation + "/" + mapName + "/" + nameOf( distributed ) + "/" + std::to_string( valueBytes );
+
+    benchmark::RegisterBenchmark( name.c_str(), [bench, distributed]( benchmark::State& state ) { bench( state, distributed ); } )
+      ->RangeMultiplier( 8 )
+      ->Range( 1 << 10, RSTD_BENCH_MAX_ELEMENTS )
+      ->Unit( benchmark::kMicrosecond );
+  }
+
+  template< template< typename > class Subject, size_t ValueBytes >
+  void registerMap() {
+
+    using map = typename Subject<payload<ValueBytes>>::type;
+    const char* mapName = Subject<payload<ValueBytes>>::name;
+
+    for ( distribution distributed : { distribution::sequential, distribution::random, distribution::strided } ) {
+      registerOne<map>( "Insert", mapName, distributed, ValueBytes, &benchInsert<map> );
+      registerOne<map>( "ReservedInsert", mapName, distributed, ValueBytes, &benchReservedInsert<map> );
+      registerOne<map>( "HitLookup", mapName, distributed, ValueBytes, []( benchmark::State& state, distribution keys ) { benchLookup<map>( state, keys, false ); } );
+      registerOne<map>( "MissLookup", mapName, distributed, ValueBytes, []( benchmark::State& state, distribution keys ) { benchLookup<map>( state, keys, true ); } );
+      registerOne<map>( "Erase", mapName, distributed, ValueBytes, &benchErase<map> );
+      registerOne<map>( "Iterate", mapName, distributed, ValueBytes, &benchIterate<map> );
+      registerOne<map>( "Copy", mapName, distributed, ValueBytes, &benchCopy<map> );
+      registerOne<map>( "Clear", mapName, distributed, ValueBytes, &benchClear<map> );
+    }
+  }
+
+  template< template< typename > class Subject >
+  void registerValueSizes() {
+    registerMap<Subject, 8>();
+    registerMap<Subject, 32>();
+    registerMap<Subject, 128>();
+  }
+
+}
+
+int main( int argc, char** argv ) {
+
+  registerValueSizes<rstd_map>();
+  registerValueSizes<rstd_group_map>();
+  registerValueSizes<std_map>();
+#ifdef RSTD_BENCH_WITH_ABSL
+  registerValueSizes<absl_map>();
+#endif
+#ifdef RSTD_BENCH_WITH_ROBIN_HOOD
+  registerValueSizes<robin_hood_map>();
+#endif
+
+  benchmark::Initialize( &argc, argv );
+  if ( benchmark::ReportUnrecognizedArguments( argc, argv ) ) {
+    return 1;
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
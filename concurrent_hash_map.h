@@ -0,0 +1,285 @@
+#ifndef CONCURRENT_HASH_MAP_H
+#define CONCURRENT_HASH_MAP_H
+
+#include "hash_map.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <shared_mutex>
+
+/*
+
+A hash_map that can be used from many threads at once.
+
+Keys are spread over a fixed number of shards, each an independent hash_map
+behind its own reader-writer lock. The shard is picked from the top bits of
+the hash, which the hash_map inside does not use to find its buckets, so each
+shard still sees a well spread set of keys. Writers to different shards never
+touch the same lock or cache line, so throughput scales with the number of
+cores as long as the keys do not pile up in a few shards. Every shard map
+shares the Hash, KeyEqual and Allocator of the concurrent_hash_map, and each
+key is hashed once per call, for both picking its shard and the lookup inside.
+
+References into a shard cannot outlive its lock, so lookups either copy the
+value out, or run a callback on it while the lock is held.
+
+Shards
+------
+[0] -> { shared_mutex, size, hash_map }
+[1] -> { shared_mutex, size, hash_map }
+...
+[N - 1] -> { shared_mutex, size, hash_map }
+
+*/
+
+namespace rstd
+{
+
+  template< typename K, typename T, typename Hash = hash<K>, typename KeyEqual = std::equal_to<K>, typename Allocator = std::allocator<std::pair<const K, T>>, typename Policy = default_hash_map_policy >
+  class concurrent_hash_map
+  {
+
+  public:
+
+    using map_type = hash_map<K, T, Hash, KeyEqual, Allocator, Policy>;
+    using key_type = K;
+    using mapped_type = T;
+    using value_type = typename map_type::value_type;
+
+  private:
+
+    //! The buckets each shard starts with, the fewest a table grows from, so idle shards stay small.
+    static constexpr uint32_t shardBuckets = 8;
+
+    //! A single hash_map and its lock, on cache lines of its own.
+    struct alignas( 64 ) shard
+    {
+      mutable std::shared_mutex lock;
+
+      //! Mirrors map.size(), so size() can be read without taking the lock.
+      std::atomic<uint32_t> elementCount{ 0 };
+
+      map_type map;
+
+      shard( const Hash& hasher, const KeyEqual& keyEqual, const typename map_type::allocator_type& alloc ) :
+        map( shardBuckets, hasher, keyEqual, alloc ) {}
+    };
+
+    //! Destroys the shards built in place by the constructor, which cannot be moved into a container because of their locks.
+    struct shard_deleter
+    {
+      uint32_t count = 0;
+
+      void operator()( shard* shards ) const {
+        for ( uint32_t i = 0; i < count; i++ ) {
+          shards[i].~shard();
+        }
+        ::operator delete( shards, std::align_val_t( alignof( shard ) ) );
+      }
+    };
+
+    //! The number of shards, a power of two.
+    uint32_t _shardCount = 0;
+
+    //! Shift moving the top bits of a hash down to a shard index.
+    uint32_t _shardShift = 0;
+
+    std::unique_ptr<shard[], shard_deleter> _shards;
+
+    Hash _hasher;
+
+    KeyEqual _keyEqual;
+
+  public:
+
+    //! shardCount is rounded up to a power of two. The default gives 64 shards. Every shard map gets a copy of alloc.
+    explicit concurrent_hash_map( uint32_t shardCount = 64, const Hash& hasher = Hash(), const KeyEqual& keyEqual = KeyEqual(), const Allocator& alloc = Allocator() ) :
+      _hasher( hasher ),
+      _keyEqual( keyEqual ) {
+
+      _shardCount = 1;
+      _shardShift = sizeof( size_t ) * 8;
+      while ( _shardCount < shardCount && _shardCount < 0x10000 ) {
+        _shardCount <<= 1;
+        _shardShift--;
+      }
+
+      // The deleter only ever destroys the shards constructed so far.
+      _shards = std::unique_ptr<shard[], shard_deleter>( static_cast<shard*>( ::operator new( sizeof( shard ) * _shardCount, std::align_val_t( alignof( shard ) ) ) ) );
+      for ( shard_deleter& built = _shards.get_deleter(); built.count < _shardCount; built.count++ ) {
+        new ( &_shards[built.count] ) shard( _hasher, _keyEqual, typename map_type::allocator_type( alloc ) );
+      }
+    }
+
+    concurrent_hash_map( const concurrent_hash_map& other ) = delete;
+    concurrent_hash_map& operator=( const concurrent_hash_map& other ) = delete;
+
+    virtual ~concurrent_hash_map() {}
+
+    //! Inserts the value, or assigns it over the one already stored. Returns whether it was inserted.
+    template< typename M >
+    bool insert_or_assign( const K& rawKey, M&& value ) {
+      size_t hash = _hasher( rawKey );
+      shard& s = shardAt( hash );
+      std::unique_lock<std::shared_mutex> guard( s.lock );
+      // try_emplace_hashed() leaves value untouched if the key is already there.
+      std::pair<T*, bool> result = s.map.try_emplace_hashed( rawKey, hash, std::forward<M>( value ) );
+      if ( !result.second ) {
+        *result.first = std::forward<M>( value );
+      }
+      s.elementCount.store( s.map.size(), std::memory_order_relaxed );
+      return result.second;
+    }
+
+    //! Constructs the value from args if the key is missing. Returns whether it was inserted.
+    template< typename... Args >
+    bool try_emplace( const K& rawKey, Args&&... args ) {
+      size_t hash = _hasher( rawKey );
+      shard& s = shardAt( hash );
+      std::unique_lock<std::shared_mutex> guard( s.lock );
+      bool inserted = s.map.try_emplace_hashed( rawKey, hash, std::forward<Args>( args )... ).second;
+      s.elementCount.store( s.map.size(), std::memory_order_relaxed );
+      return inserted;
+    }
+
+    //! Returns a copy of the value stored at the key, if any.
+    std::optional<T> find( const K& rawKey ) const {
+      size_t hash = _hasher( rawKey );
+      const shard& s = shardAt( hash );
+      std::shared_lock<std::shared_mutex> guard( s.lock );
+      const T* found = s.map.find_hashed( rawKey, hash );
+      return found == nullptr ? std::nullopt : std::optional<T>( *found );
+    }
+
+    bool contains( const K& rawKey ) const {
+      size_t hash = _hasher( rawKey );
+      const shard& s = shardAt( hash );
+      std::shared_lock<std::shared_mutex> guard( s.lock );
+      return s.map.find_hashed( rawKey, hash ) != nullptr;
+    }
+
+    //! Calls f( T& ) on the value stored at the key under an exclusive lock. Returns whether it was found.
+    template< typename F >
+    bool visit( const K& rawKey, F&& f ) {
+      size_t hash = _hasher( rawKey );
+      shard& s = shardAt( hash );
+      std::unique_lock<std::shared_mutex> guard( s.lock );
+      T* found = s.map.find_hashed( rawKey, hash );
+      if ( found != nullptr ) {
+        f( *found );
+      }
+      return found != nullptr;
+    }
+
+    //! Calls f( const T& ) on the value stored at the key under a shared lock. Returns whether it was found.
+    template< typename F >
+    bool visit( const K& rawKey, F&& f ) const {
+      size_t hash = _hasher( rawKey );
+      const shard& s = shardAt( hash );
+      std::shared_lock<std::shared_mutex> guard( s.lock );
+      const T* found = s.map.find_hashed( rawKey, hash );
+      if ( found != nullptr ) {
+        f( *found );
+      }
+      return found != nullptr;
+    }
+
+    //! Calls f( T& ) on the value at the key, default constructing it first if it is missing.
+    template< typename F >
+    void upsert( const K& rawKey, F&& f ) {
+      size_t hash = _hasher( rawKey );
+      shard& s = shardAt( hash );
+      std::unique_lock<std::shared_mutex> guard( s.lock );
+      f( *s.map.try_emplace_hashed( rawKey, hash ).first );
+      s.elementCount.store( s.map.size(), std::memory_order_relaxed );
+    }
+
+    //! Erases the key. Returns whether it was present.
+    bool erase( const K& rawKey ) {
+      size_t hash = _hasher( rawKey );
+      shard& s = shardAt( hash );
+      std::unique_lock<std::shared_mutex> guard( s.lock );
+      bool erased = s.map.erase_hashed( rawKey, hash );
+      s.elementCount.store( s.map.size(), std::memory_order_relaxed );
+      return erased;
+    }
+
+    //! Calls f( const value_type& ) on every element, holding one shard lock at a time.
+    template< typename F >
+    void for_each( F&& f ) const {
+      for ( uint32_t i = 0; i < _shardCount; i++ ) {
+        std::shared_lock<std::shared_mutex> guard( _shards[i].lock );
+        for ( const value_type& entry : _shards[i].map ) {
+          f( entry );
+        }
+      }
+    }
+
+    //! Empties every shard, one at a time.
+    void clear() {
+      for ( uint32_t i = 0; i < _shardCount; i++ ) {
+        std::unique_lock<std::shared_mutex> guard( _shards[i].lock );
+        _shards[i].map.clear();
+        _shards[i].elementCount.store( 0, std::memory_order_relaxed );
+      }
+    }
+
+    //! Makes room for elementCount elements in total, spread evenly over the shards.
+    void reserve( uint32_t elementCount ) {
+      uint32_t perShard = elementCount / _shardCount + 1;
+      for ( uint32_t i = 0; i < _shardCount; i++ ) {
+        reserve_shard( i, perShard );
+      }
+    }
+
+    //! Makes room for elementCount elements in a single shard.
+    void reserve_shard( uint32_t shardIndex, uint32_t elementCount ) {
+      std::unique_lock<std::shared_mutex> guard( _shards[shardIndex].lock );
+      _shards[shardIndex].map.reserve( elementCount );
+    }
+
+    //! Returns the number of elements. Other threads may change it right after.
+    uint64_t size() const {
+      uint64_t total = 0;
+      for ( uint32_t i = 0; i < _shardCount; i++ ) {
+        total += _shards[i].elementCount.load( std::memory_order_relaxed );
+      }
+      return total;
+    }
+
+    bool empty() const {
+      return size() == 0;
+    }
+
+    uint32_t shard_count() const {
+      return _shardCount;
+    }
+
+    //! Returns the index of the shard holding the key.
+    uint32_t shard_index( const K& rawKey ) const {
+      return shardIndexOf( _hasher( rawKey ) );
+    }
+
+  private:
+
+    uint32_t shardIndexOf( size_t hash ) const {
+      // Shifting by the full width of size_t is undefined, so a single shard skips the shift.
+      return _shardCount == 1 ? 0 : (uint32_t) ( hash >> _shardShift );
+    }
+
+    shard& shardAt( size_t hash ) {
+      return _shards[shardIndexOf( hash )];
+    }
+
+    const shard& shardAt( size_t hash ) const {
+      return _shards[shardIndexOf( hash )];
+    }
+
+  };
+
+}
+
+#endif // CONCURRENT_HASH_MAP_H
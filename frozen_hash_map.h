@@ -0,0 +1,365 @@
+#ifndef FROZEN_HASH_MAP_H
+#define FROZEN_HASH_MAP_H
+
+#include "hash_map.h"
+
+#include <algorithm>
+
+/*
+
+An immutable map over a fixed key set, for lookup tables built once and only
+read afterward.
+
+Freezing computes a minimal perfect hash of the keys by hash and displace:
+the keys are spread over about n / 4 small buckets, and each bucket is given
+a pilot, found by trial, that sends all of its keys to slots no other key
+took yet. A lookup reads the pilot of its bucket and compares the key in the
+one slot it points to; a key that is not in the map fails that comparison.
+
+Pilot search visits the buckets from largest to smallest, so the last ones to
+place hold a single key and only need any free slot. Pilots pick from 1% more
+slots than there are keys, which keeps those last searches short, and the few
+keys landing past the end are remapped into the slots left free below it, at
+the cost of one more read for their lookups. The elements thus sit in a single
+array of exactly n slots: no empty slots, no pointers and no probing. Besides
+the elements, the pilots take 2 bytes per bucket, half a byte per key, and the
+remap table 4 bytes per 100 keys.
+
+As in PTHash, 60% of the keys go to the first 30% of the buckets. The big
+buckets that result are placed while the slots are still mostly free, which
+cuts the trials the mid sized ones need later on by half.
+
+Buckets      Slots
+-------      -----
+[0] pilot    [0] { key, value }
+[1] pilot    [1] { key, value }
+...          ...
+[b - 1]      [n - 1]
+             [n]      -> remap[0]
+             ...
+
+*/
+
+namespace rstd
+{
+
+  template< typename K, typename T, typename Hash = hash<K>, typename KeyEqual = std::equal_to<K> >
+  class frozen_hash_map
+  {
+
+  public:
+
+    using key_type = K;
+    using mapped_type = T;
+    using value_type = std::pair<const K, T>;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+    using iterator = const_iterator;
+
+  private:
+
+    //! The average number of keys per bucket. Larger saves pilot bytes and costs build time.
+    static constexpr uint32_t keysPerBucket = 4;
+
+    //! Pilots pick from one extra slot per this many keys.
+    static constexpr uint32_t keysPerExtraSlot = 100;
+
+    //! Marks a slot no key was placed in.
+    static constexpr uint32_t noOwner = UINT32_MAX;
+
+    //! Every element, in the slot the perfect hash gives its key.
+    std::vector<value_type> _elements;
+
+    //! The pilot of each bucket. Seeds needing bigger pilots are given up on.
+    std::vector<uint16_t> _pilots;
+
+    //! The number of slots pilots pick from, a few more than the elements.
+    uint32_t _slotCount = 0;
+
+    //! The free element slot standing in for each slot past the last element.
+    std::vector<uint32_t> _remap;
+
+    //! Picks the bucket mapping; changed only if a build attempt gets stuck.
+    uint64_t _seed = 0;
+
+    Hash _hasher;
+    KeyEqual _keyEqual;
+
+  public:
+
+    //! An empty map.
+    explicit frozen_hash_map( const Hash& hasher = Hash(), const KeyEqual& keyEqual = KeyEqual() ) :
+      _hasher( hasher ),
+      _keyEqual( keyEqual ) {}
+
+    /*
+    Freezes the elements of map, anything iterable over pairs whose keys are
+    unique, such as a hash_map. Throws std::invalid_argument if two keys hash
+    to the same value, since no pilot could then tell them apart.
+    */
+    template< typename Map >
+    explicit frozen_hash_map( const Map& map, const Hash& hasher = Hash(), const KeyEqual& keyEqual = KeyEqual() ) :
+      _hasher( hasher ),
+      _keyEqual( keyEqual ) {
+
+      std::vector<const typename Map::value_type*> entries;
+      for ( const auto& entry : map ) {
+        entries.push_back( &entry );
+      }
+
+      build( entries );
+    }
+
+    //! Returns the value stored at the key, or nullptr. Inspects a single slot.
+    const T* find( const K& rawKey ) const {
+
+      if ( _elements.empty() ) {
+        return nullptr;
+      }
+
+      uint64_t mixed = mixedHash( _hasher( rawKey ) );
+      uint32_t slot = slotOf( mixed, _pilots[bucketOf( mixed )] );
+      if ( slot >= _elements.size() ) {
+        slot = _remap[slot - _elements.size()];
+      }
+
+      const value_type& entry = _elements[slot];
+      return _keyEqual( entry.first, rawKey ) ? &( entry.second ) : nullptr;
+    }
+
+    bool contains( const K& rawKey ) const {
+      return find( rawKey ) != nullptr;
+    }
+
+    uint32_t count( const K& rawKey ) const {
+      return contains( rawKey ) ? 1 : 0;
+    }
+
+    //! Returns the value stored at the key. Throws std::out_of_range if it is not there.
+    const T& at( const K& rawKey ) const {
+      const T* found = find( rawKey );
+      if ( found == nullptr ) {
+        throw std::out_of_range( "rstd::frozen_hash_map::at: key not found" );
+      }
+      return *found;
+    }
+
+    const_iterator begin() const {
+      return _elements.begin();
+    }
+
+    const_iterator end() const {
+      return _elements.end();
+    }
+
+    uint32_t size() const {
+      return (uint32_t) _elements.size();
+    }
+
+    bool empty() const {
+      return _elements.empty();
+    }
+
+    //! Returns the bytes held by the elements and pilots.
+    size_t memory_usage() const {
+      return _elements.capacity() * sizeof( value_type ) + _pilots.capacity() * sizeof( uint16_t ) + _remap.capacity() * sizeof( uint32_t );
+    }
+
+    hasher hash_function() const {
+      return _hasher;
+    }
+
+    //! Copies every element back into a mutable map, by default a hash_map with the same Hash and KeyEqual.
+    template< typename Map = hash_map<K, T, Hash, KeyEqual> >
+    Map thaw() const {
+
+      Map map( 256, _hasher, _keyEqual );
+      map.reserve( size() );
+      for ( const value_type& entry : _elements ) {
+        map.try_emplace( entry.first, entry.second );
+      }
+
+      return map;
+    }
+
+  private:
+
+    //! Maps x onto [0, range) by the high half of a wide multiply, which is cheaper than a modulo.
+    static uint32_t reduce( uint64_t x, uint32_t range ) {
+#ifdef __SIZEOF_INT128__
+      return (uint32_t) ( ( (__uint128_t) x * range ) >> 64 );
+#else
+      return (uint32_t) ( x % range );
+#endif
+    }
+
+    //! Spreads a hash over all 64 bits under the current seed.
+    uint64_t mixedHash( size_t hash ) const {
+      return mixBits( hash ^ _seed );
+    }
+
+    //! The low bits pick the dense or the sparse buckets, the high the bucket among them.
+    uint32_t bucketOf( uint64_t mixed ) const {
+      uint32_t denseBuckets = (uint32_t) ( _pilots.size() * 3 / 10 ) + 1;
+      if ( (uint32_t) mixed < 0x9999999Au ) {
+        return reduce( mixed, denseBuckets );
+      }
+      return denseBuckets + reduce( mixed, (uint32_t) _pilots.size() - denseBuckets );
+    }
+
+    //! Mixed again, since keys of one bucket share the high bits the bucket came from.
+    uint32_t slotOf( uint64_t mixed, uint32_t pilot ) const {
+      return reduce( mixBits( mixed ^ ( (uint64_t) pilot * 0x9E3779B97F4A7C15ull ) ), _slotCount );
+    }
+
+    template< typename Entry >
+    void build( const std::vector<const Entry*>& entries ) {
+
+      if ( entries.size() > UINT32_MAX / 2 ) {
+        throw std::length_error( "rstd::frozen_hash_map: too many elements" );
+      }
+
+      uint32_t n = (uint32_t) entries.size();
+      if ( n == 0 ) {
+        return;
+      }
+
+      std::vector<size_t> hashes( n );
+      for ( uint32_t i = 0; i < n; i++ ) {
+        hashes[i] = _hasher( entries[i]->first );
+      }
+
+      // At least one dense and one sparse bucket.
+      _pilots.assign( n / keysPerBucket + 2, 0 );
+      _slotCount = n + n / keysPerExtraSlot + 1;
+
+      std::vector<uint32_t> owners;
+      while ( !placeAll( hashes, owners ) ) {
+        _seed = mixBits( _seed + 1 );
+      }
+
+      // There are as many keys past the end as free slots below it. Slots past the end left empty point anywhere, matching no key.
+      _remap.assign( _slotCount - n, 0 );
+      uint32_t freeSlot = 0;
+      for ( uint32_t slot = n; slot < _slotCount; slot++ ) {
+        if ( owners[slot] != noOwner ) {
+          while ( owners[freeSlot] != noOwner ) {
+            freeSlot++;
+          }
+          owners[freeSlot] = owners[slot];
+          _remap[slot - n] = freeSlot;
+        }
+      }
+
+      _elements.reserve( n );
+      for ( uint32_t slot = 0; slot < n; slot++ ) {
+        _elements.emplace_back( entries[owners[slot]]->first, entries[owners[slot]]->second );
+      }
+    }
+
+    /*
+    Finds a pilot for every bucket, filling owners with the key index of each
+    slot, or noOwner. Returns false if some bucket ran out of pilots under the
+    current seed.
+    */
+    bool placeAll( const std::vector<size_t>& hashes, std::vector<uint32_t>& owners ) {
+
+      uint32_t n = (uint32_t) hashes.size();
+      uint32_t bucketCount = (uint32_t) _pilots.size();
+
+      std::vector<uint64_t> mixed( n );
+      for ( uint32_t i = 0; i < n; i++ ) {
+        mixed[i] = mixedHash( hashes[i] );
+      }
+
+      // Counting sort of the keys by bucket.
+      std::vector<uint32_t> bucketStarts( bucketCount + 1 );
+      std::vector<uint32_t> buckets( n );
+      for ( uint32_t i = 0; i < n; i++ ) {
+        bucketStarts[bucketOf( mixed[i] ) + 1]++;
+      }
+      for ( uint32_t b = 1; b <= bucketCount; b++ ) {
+        bucketStarts[b] += bucketStarts[b - 1];
+      }
+      {
+        std::vector<uint32_t> cursor( bucketStarts.begin(), bucketStarts.end() - 1 );
+        for ( uint32_t i = 0; i < n; i++ ) {
+          buckets[cursor[bucketOf( mixed[i] )]++] = i;
+        }
+      }
+
+      // Largest buckets first, while most slots are still free.
+      std::vector<uint32_t> byCount( bucketCount );
+      for ( uint32_t b = 0; b < bucketCount; b++ ) {
+        byCount[b] = b;
+      }
+      std::stable_sort( byCount.begin(), byCount.end(), [&]( uint32_t b1, uint32_t b2 ) {
+        return bucketStarts[b1 + 1] - bucketStarts[b1] > bucketStarts[b2 + 1] - bucketStarts[b2];
+      } );
+
+      // Trials test the bits, small enough to stay in cache, instead of owners.
+      owners.assign( _slotCount, noOwner );
+      std::vector<bool> taken( _slotCount );
+      std::vector<uint32_t> slots;
+
+      constexpr uint32_t pilotLimit = 0x10000;
+
+      for ( uint32_t b : byCount ) {
+
+        uint32_t first = bucketStarts[b];
+        uint32_t last = bucketStarts[b + 1];
+        if ( first == last ) {
+          continue;
+        }
+
+        for ( uint32_t i = first + 1; i < last; i++ ) {
+          for ( uint32_t j = first; j < i; j++ ) {
+            if ( hashes[buckets[i]] == hashes[buckets[j]] ) {
+              throw std::invalid_argument( "rstd::frozen_hash_map: two keys share a hash" );
+            }
+          }
+        }
+
+        uint32_t pilot = 0;
+        for ( ; pilot < pilotLimit; pilot++ ) {
+
+          slots.clear();
+          bool fits = true;
+
+          for ( uint32_t i = first; fits && i < last; i++ ) {
+            uint32_t slot = slotOf( mixed[buckets[i]], pilot );
+            fits = !taken[slot] && std::find( slots.begin(), slots.end(), slot ) == slots.end();
+            slots.push_back( slot );
+          }
+
+          if ( fits ) {
+            break;
+          }
+        }
+
+        if ( pilot == pilotLimit ) {
+          return false;
+        }
+
+        _pilots[b] = (uint16_t) pilot;
+        for ( uint32_t i = first; i < last; i++ ) {
+          taken[slots[i - first]] = true;
+          owners[slots[i - first]] = buckets[i];
+        }
+      }
+
+      return true;
+    }
+
+  };
+
+  //! Freezes a hash_map into a frozen_hash_map with the same Hash and KeyEqual.
+  template< typename K, typename T, typename Hash, typename KeyEqual, typename Allocator, typename Policy >
+  frozen_hash_map<K, T, Hash, KeyEqual> freeze( const hash_map<K, T, Hash, KeyEqual, Allocator, Policy>& map ) {
+    return frozen_hash_map<K, T, Hash, KeyEqual>( map, map.hash_function(), map.key_eq() );
+  }
+
+}
+
+#endif // FROZEN_HASH_MAP_H
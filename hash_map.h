@@ -1,16 +1,46 @@
 #ifndef HASH_MAP_H
 #define HASH_MAP_H
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#elif defined( __ARM_NEON ) && defined( __aarch64__ )
+#include <arm_neon.h>
+#endif
+
+#if defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+#include <xmmintrin.h>
+#endif
 
 #ifdef _DEBUG
-#include <string.h>
 #include <iostream>
 #endif
 
 /*
 
-A custom implementation of a hashed mapping from an int32_t into a value.
+A custom implementation of a hashed mapping from a key into a value.
 The purposes of creating this in descending value:
    1. To learn how to implement hash maps.
    2. To practice memory management.
@@ -20,323 +50,4522 @@ The hope is the implementation will be faster than the std implementations.
 It will attain this speed by not having the overhead of abstraction the standard
 library needs to satisfy any/all needs. This only needs to do a subset of the functionality.
 
-The data is organized into a series of linked lists of hash_map_ll_nodes.
-Each hashed index has its own unique linked list. To access an element,
-an index will be provided to the access operator []. This index will
-be hashed to find the associated linked list. Then the list will be traversed
-to find the original provided index which is stored as part of the node along
-with the corresponding element.
-
-Hashed Index -> First node of hash_map_ll_node linked list.
--------------
-[0] -> nullptr
-[1] -> hash_map_ll_node -> nullptr
-[2] -> hash_map_ll_node -> hash_map_ll_node -> nullptr
-[3] -> hash_map_ll_node -> hash_map_ll_node -> ... -> nullptr
+The data is organized into a single open-addressed table using Robin Hood
+linear probing. Every element lives inline in one contiguous array of slots,
+next to a parallel array of info bytes. An info byte holds the distance of its
+slot from the home bucket of the element stored there, plus one, so that 0
+marks an empty slot. To access an element, the key provided to the access
+operator [] is hashed to its home bucket and the slots are scanned forward from
+there. The scan stops as soon as it meets an element that sits closer to its
+own home than the searched key would, so a lookup touches one or two cache lines.
+Policies selecting boxed_storage keep only a pointer in each slot instead, for
+elements too large to be moved around cheaply.
+
+Inserting takes the slot of the first such "richer" element and shifts the rest
+of the run one slot to the right. Erasing shifts the following run back by one,
+so the table never needs tombstones. The table does not wrap around; it is
+followed by an overflow tail of up to maxDistance slots that absorbs the runs
+starting at the last buckets. When an element would land further than
+maxDistance from home in a table at most half full, growing would not help:
+its keys share their hashes, or most of their low bits. It then goes to a
+small stash next to the table instead, searched linearly by lookups that
+miss in it, so a degenerate Hash makes those keys slow rather than running
+the process out of memory.
+
+Slot  Info  Element
+----  ----  -------
+[0]   0     (empty)
+[1]   1     { key homed at 1, value }
+[2]   1     { key homed at 2, value }
+[3]   2     { key homed at 2, value }
+[4]   0     (empty)
 ...
+[n]   ...   overflow tail
+
+Policies selecting group_engine get a Swiss table layout instead, described at
+group_table, which compares a whole group of one byte hash tags per SIMD
+instruction. It rejects misses faster at high load factors, at the cost of
+tombstones on erase. Either way, once the ratio of elements to buckets passes
+max_load_factor(), the access operator [] doubles the bucket count and moves
+every element over in a single rehash. With incremental_rehash() enabled, the
+old table is kept next to the new one instead, and every later insert or erase
+moves a few of its elements over, so that no single call pays for the whole
+rehash. Lookups check both tables until the old one is drained.
+
+Policies selecting small_engine keep their first few elements in a buffer
+inside the map object and allocate no table until it overflows.
 
 */
 
 namespace rstd
 {
 
+  //! Stores each element directly in its table slot. The default.
+  struct inline_storage {};
+
+  /*
+  Stores each element in its own allocation and keeps only a pointer in the slot.
+  Meant for very large elements: probing and rehashing then move a pointer
+  instead of the element, and references stay valid across growth.
+  */
+  struct boxed_storage {};
+
+  /*
+  Stores the elements packed together in one array per table and keeps only a
+  32-bit index in each slot. Probing and rehashing move 4 bytes instead of the
+  element, like boxed_storage, without an allocation and a pointer per element.
+  */
+  struct compact_storage {};
+
+  //! Robin Hood linear probing over a single slot array. The default engine.
+  struct robin_hood_engine {};
+
+  //! Swiss table style probing, testing a whole group of 1 byte tags per SIMD compare.
+  struct group_engine {};
+
+  /*
+  Keeps up to N elements inside the map object, found by a linear scan, and
+  only allocates a table of the wrapped Engine once one more comes in. For
+  the many maps of which most stay tiny, such as per object attributes.
+  */
+  template< uint32_t N, typename Engine = robin_hood_engine >
+  struct small_engine {};
+
+  //! Counts nothing, so that counting compiles away. The default.
+  struct no_counters {};
+
+  //! Counts hot path events in relaxed atomics, read and reset at runtime through hash_map::counters().
+  struct atomic_counters {};
+
+  //! Compile-time knobs of a hash_map. Derive from it to override single members.
+  struct default_hash_map_policy
+  {
+    //! How elements are kept in the table, inline_storage, boxed_storage or compact_storage.
+    using storage = inline_storage;
+
+    //! How the table is laid out and probed, robin_hood_engine or group_engine, possibly wrapped in small_engine.
+    using engine = robin_hood_engine;
+
+    //! Whether the map counts its hot path events, no_counters or atomic_counters.
+    using counters = no_counters;
+  };
+
   namespace rstd_support
   {
-    template< typename T>
-    class hash_map_ll_node final
-    {
+    /*
+    Scrambles the bits of a key so that every input bit reaches the low bits a
+    power-of-two mask keeps. It multiplies by 2^64 / phi and folds the high half
+    of the 128-bit product into the low half, a single wide multiply on 64-bit
+    targets. Keys allocated in strides, pointers and timestamps then spread over
+    all buckets instead of piling up in a few. constexpr, for static_hash_map.
+    */
+    constexpr size_t mixBits( uint64_t bits ) {
+#ifdef __SIZEOF_INT128__
+      __uint128_t product = (__uint128_t) bits * 0x9E3779B97F4A7C15ull;
+      return (size_t) ( (uint64_t) product ^ (uint64_t) ( product >> 64 ) );
+#else
+      bits ^= bits >> 33;
+      bits *= 0xFF51AFD7ED558CCDull;
+      bits ^= bits >> 33;
+      bits *= 0xC4CEB9FE1A85EC53ull;
+      bits ^= bits >> 33;
+      return (size_t) bits;
+#endif
+    }
 
-    public:
+    //! Hints the CPU to start loading the cache line holding address.
+    inline void prefetch( const void* address ) {
+#if defined( __GNUC__ ) || defined( __clang__ )
+      __builtin_prefetch( address );
+#elif defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+      _mm_prefetch( static_cast<const char*>( address ), _MM_HINT_T0 );
+#else
+      (void) address;
+#endif
+    }
+
+    //! Hashes a run of bytes eight at a time, mixing each word into the running state.
+    inline size_t hashBytes( const void* data, size_t length ) {
+
+      const unsigned char* bytes = static_cast<const unsigned char*>( data );
+      uint64_t state = 0x243F6A8885A308D3ull ^ length;
+      uint64_t word;
+
+      for ( ; length >= 8; bytes += 8, length -= 8 ) {
+        memcpy( &word, bytes, 8 );
+        state = mixBits( state ^ word );
+      }
+
+      if ( length > 0 ) {
+        word = 0;
+        memcpy( &word, bytes, length );
+        state = mixBits( state ^ word );
+      }
 
-      //! The raw key of the hash map to be accessed.
-      int32_t rawKey = 0;
+      return mixBits( state );
+    }
 
-      //! The data stored at the raw key.
-      T* dataPointer = nullptr;
+    //! The fewest slots worth handing to a thread of their own.
+    constexpr uint32_t minParallelSlots = 16384;
 
-      //! The parent node in the linked list.
-      hash_map_ll_node* parentNode = nullptr;
+    //! Resolves a requested thread count, 0 meaning one per hardware thread.
+    inline unsigned threadCount( unsigned threads ) {
+      if ( threads == 0 ) {
+        threads = std::thread::hardware_concurrency();
+      }
+      return threads == 0 ? 1 : threads;
+    }
 
-      //! The child node in the linked list.
-      hash_map_ll_node* childNode = nullptr;
+    /*
+    Splits [0, count) into up to threadCount( threads ) contiguous ranges, of
+    at least minParallelSlots each, and calls body( begin, end, part ) on each,
+    the first on the calling thread. Rethrows the exception of the lowest part
+    that threw once every part is done.
+    */
+    template< typename Body >
+    void parallelRanges( uint32_t count, unsigned threads, const Body& body ) {
 
-      hash_map_ll_node( int32_t rawkey, hash_map_ll_node* parent, T* data ) :
-        rawKey( rawkey ),
-        dataPointer( data ),
-        parentNode( parent ) {}
+      uint32_t parts = count / minParallelSlots;
+      if ( parts > threadCount( threads ) ) {
+        parts = threadCount( threads );
+      }
+      if ( parts <= 1 ) {
+        body( 0, count, 0 );
+        return;
+      }
 
-      hash_map_ll_node( const hash_map_ll_node& other, hash_map_ll_node* parent = nullptr ) :
-        rawKey( other.rawKey ),
-        dataPointer( new T( *( other.dataPointer ) ) ),
-        parentNode( parent ) {
+      std::vector<std::exception_ptr> errors( parts );
+      std::vector<std::thread> workers;
+      workers.reserve( parts - 1 );
 
-        if ( other.childNode != nullptr ) {
-          childNode = new hash_map_ll_node( *( other.childNode ), this );
+      auto run = [&]( uint32_t part ) {
+        try {
+          body( (uint32_t) ( (uint64_t) count * part / parts ), (uint32_t) ( (uint64_t) count * ( part + 1 ) / parts ), part );
+        }
+        catch ( ... ) {
+          errors[part] = std::current_exception();
         }
+      };
+
+      for ( uint32_t part = 1; part < parts; part++ ) {
+        workers.emplace_back( run, part );
       }
+      run( 0 );
 
-      hash_map_ll_node( hash_map_ll_node&& other ) = delete;
-      hash_map_ll_node& operator=( const hash_map_ll_node& other ) = delete;
-      hash_map_ll_node& operator=( hash_map_ll_node&& other ) = delete;
+      for ( std::thread& worker : workers ) {
+        worker.join();
+      }
 
-      ~hash_map_ll_node() {
-        delete dataPointer;
-        delete childNode;
+      for ( const std::exception_ptr& error : errors ) {
+        if ( error ) {
+          std::rethrow_exception( error );
+        }
       }
+    }
 
-    };
+    //! Whether a Hash or KeyEqual takes keys of other types than the key_type, marked by an is_transparent member type.
+    template< typename F, typename Enable = void >
+    struct is_transparent : std::false_type {};
+
+    template< typename F >
+    struct is_transparent<F, std::void_t<typename F::is_transparent>> : std::true_type {};
   }
 
-  using namespace rstd_support;
+  /*
+  The default hash of a hash_map. Integral, enum and pointer keys go through
+  mixBits(), which compiles down to a multiply and an xor. Strings go through
+  hashBytes(). The string hashes are transparent: a std::string, a
+  std::string_view or a string literal of the same characters hash alike.
+  */
+  template< typename K, typename Enable = void >
+  struct hash;
 
-  template< typename T >
-  class hash_map
+  template< typename K >
+  struct hash<K, typename std::enable_if<std::is_integral<K>::value || std::is_enum<K>::value>::type>
   {
+    constexpr size_t operator()( K key ) const noexcept {
+      return rstd_support::mixBits( (uint64_t) key );
+    }
+  };
 
-  private:
+  template< typename K >
+  struct hash<K*>
+  {
+    size_t operator()( K* key ) const noexcept {
+      return rstd_support::mixBits( (uint64_t) reinterpret_cast<uintptr_t>( key ) );
+    }
+  };
+
+  template<>
+  struct hash<std::string_view>
+  {
+    using is_transparent = void;
 
-    //! The number of hashed indices representing the linked lists.
-    uint32_t _hashIndices = 0;
+    size_t operator()( std::string_view key ) const noexcept {
+      return rstd_support::hashBytes( key.data(), key.size() );
+    }
+  };
 
-    //! The number of elements in the map.
-    uint32_t _elementCount = 0;
+  template<>
+  struct hash<std::string>
+  {
+    using is_transparent = void;
 
-    //! Pointer to the hash_map_ll_node linked list array.
-    hash_map_ll_node<T>** _heads = nullptr;
+    size_t operator()( std::string_view key ) const noexcept {
+      return rstd_support::hashBytes( key.data(), key.size() );
+    }
+  };
 
-  public:
+  namespace rstd_support
+  {
+    //! How a table keeps its elements, selected by the storage policy.
+    template< typename Storage, typename V >
+    struct element_storage;
 
-    template< typename valtype >
-    friend void swap( hash_map<valtype>& map1, hash_map<valtype>& map2 );
+    //! How an extracted node keeps its element: boxed elements keep their allocation, the others move into the node.
+    template< typename Storage, typename V >
+    using node_storage = element_storage<typename std::conditional<std::is_same<Storage, boxed_storage>::value, boxed_storage, inline_storage>::type, V>;
 
-    hash_map( uint32_t storageSize = 256 ) {
+    template< typename V >
+    struct element_storage<inline_storage, V> final
+    {
+      //! Uninitialized storage for a single element.
+      struct slot
+      {
+        alignas( V ) unsigned char bytes[sizeof( V )];
+      };
 
-      _hashIndices = storageSize - 1;
-      _hashIndices |= _hashIndices >> 1;
-      _hashIndices |= _hashIndices >> 2;
-      _hashIndices |= _hashIndices >> 4;
-      _hashIndices |= _hashIndices >> 8;
-      _hashIndices |= _hashIndices >> 16;
-      _hashIndices++;
+      static V* get( slot& s ) {
+        return std::launder( reinterpret_cast<V*>( s.bytes ) );
+      }
 
-      if ( _hashIndices == 0 ) {
-        _hashIndices = 256;
+      template< typename Alloc, typename... Args >
+      static void construct( Alloc&, slot& s, Args&&... args ) {
+        ::new ( s.bytes ) V( std::forward<Args>( args )... );
       }
 
-      _heads = new hash_map_ll_node<T> * [_hashIndices];
-      memsetHeads();
-    }
+      template< typename Alloc >
+      static void destroy( Alloc&, slot& s ) {
+        get( s )->~V();
+      }
+
+      //! Whether discard() does nothing, so a clear() may skip visiting the elements.
+      static constexpr bool trivialDiscard = std::is_trivially_destructible<V>::value;
+
+      //! Destroys the element for a clear(), which calls reset() once every element is gone.
+      template< typename Alloc >
+      static void discard( Alloc& alloc, slot& s ) {
+        destroy( alloc, s );
+      }
+
+      //! Forgets every element after a clear().
+      static void reset() {}
+
+      //! Whether the slots of a table can be copied with memcpy, after copyAll().
+      static constexpr bool trivialCopy = std::is_trivially_copyable<typename V::first_type>::value && std::is_trivially_copyable<typename V::second_type>::value;
+
+      //! Copies what the storage holds besides the slots, for a memcpy of the slots. Holds no element yet.
+      template< typename Alloc >
+      static void copyAll( Alloc&, const element_storage& ) {}
+
+      //! Moves the element in src into the uninitialized dst, leaving src uninitialized.
+      static void relocate( slot& dst, slot& src ) {
+        V* from = get( src );
+        // The key is about to be destroyed along with its slot, so moving out of it is safe.
+        ::new ( dst.bytes ) V( std::move( const_cast<typename V::first_type&>( from->first ) ), std::move( from->second ) );
+        from->~V();
+      }
+
+      //! Same as relocate(), for a src slot of another table.
+      template< typename Alloc >
+      static void transfer( Alloc&, element_storage&, slot& dst, slot& src ) {
+        relocate( dst, src );
+      }
+
+      //! The slot of an extracted node, see node_storage.
+      using node_slot = slot;
+
+      //! Moves the element of s out into the uninitialized node, leaving s uninitialized.
+      template< typename Alloc >
+      static void extract( Alloc&, slot& s, node_slot& node ) {
+        relocate( node, s );
+      }
+
+      //! Moves the element of node into the uninitialized s, leaving node uninitialized.
+      template< typename Alloc >
+      static void adopt( Alloc&, slot& s, node_slot& node ) {
+        relocate( s, node );
+      }
+
+      //! Makes sure extra more elements can be constructed without allocating.
+      template< typename Alloc >
+      static void reserve( Alloc&, uint32_t ) {}
+
+      //! Frees what the storage holds besides the slots. Every element must be destroyed.
+      template< typename Alloc >
+      static void release( Alloc& ) {}
+
+      //! Returns the bytes held outside of the slots for elementCount elements.
+      static size_t bytes( uint32_t ) {
+        return 0;
+      }
+
+      //! Returns the part of bytes() holding no element.
+      static size_t slackBytes( uint32_t ) {
+        return 0;
+      }
+    };
+
+    template< typename V >
+    struct element_storage<boxed_storage, V> final
+    {
+      //! Pointer to the separately allocated element.
+      struct slot
+      {
+        V* pointer;
+      };
 
-    hash_map( const hash_map& other ) : hash_map( other._hashIndices ) {
+      static V* get( slot& s ) {
+        return s.pointer;
+      }
+
+      //! Allocates the element through alloc, whose value_type is V.
+      template< typename Alloc, typename... Args >
+      static void construct( Alloc& alloc, slot& s, Args&&... args ) {
 
-      for ( uint32_t i = 0; i < _hashIndices; i++ ) {
-        if ( other._heads[i] != nullptr ) {
-          _heads[i] = new hash_map_ll_node<T>( *( other._heads[i] ) );
+        V* pointer = std::allocator_traits<Alloc>::allocate( alloc, 1 );
+
+        try {
+          ::new ( pointer ) V( std::forward<Args>( args )... );
+        }
+        catch ( ... ) {
+          std::allocator_traits<Alloc>::deallocate( alloc, pointer, 1 );
+          throw;
         }
+
+        s.pointer = pointer;
       }
-    }
 
-    hash_map( hash_map&& other ) noexcept {
-      swap( *this, other );
-    }
+      template< typename Alloc >
+      static void destroy( Alloc& alloc, slot& s ) {
+        s.pointer->~V();
+        std::allocator_traits<Alloc>::deallocate( alloc, s.pointer, 1 );
+      }
 
-    hash_map& operator=( const hash_map& other ) {
-      if ( this != &other ) {
-        hash_map temp( other );
-        swap( *this, temp );
+      //! Every element has an allocation to give back.
+      static constexpr bool trivialDiscard = false;
+
+      template< typename Alloc >
+      static void discard( Alloc& alloc, slot& s ) {
+        destroy( alloc, s );
       }
-      return *this;
-    }
 
-    hash_map& operator=( hash_map&& other ) noexcept {
-      swap( *this, other );
-      return *this;
-    }
+      static void reset() {}
 
-    //! Clean up, aisle hash_map.
-    virtual ~hash_map() {
-      clear();
-      delete[] _heads;
-    }
+      //! Copied slots would share their elements.
+      static constexpr bool trivialCopy = false;
 
-    //! Accessor operator.
-    T& operator[]( int32_t rawKey ) {
+      template< typename Alloc >
+      static void copyAll( Alloc&, const element_storage& ) {}
+
+      static void relocate( slot& dst, slot& src ) {
+        dst.pointer = src.pointer;
+      }
+
+      template< typename Alloc >
+      static void transfer( Alloc&, element_storage&, slot& dst, slot& src ) {
+        relocate( dst, src );
+      }
 
-      uint32_t hashedKey = hashThis( rawKey );
-      hash_map_ll_node<T>* curNode = _heads[hashedKey];
+      //! A node takes over the allocation of the element.
+      using node_slot = slot;
 
-      //First record
-      if ( curNode == nullptr ) {
-        _heads[hashedKey] = new hash_map_ll_node<T>( rawKey, nullptr, new T() );
-        _elementCount++;
-        return *( _heads[hashedKey]->dataPointer );
+      template< typename Alloc >
+      static void extract( Alloc&, slot& s, node_slot& node ) {
+        relocate( node, s );
+      }
+
+      template< typename Alloc >
+      static void adopt( Alloc&, slot& s, node_slot& node ) {
+        relocate( s, node );
+      }
+
+      template< typename Alloc >
+      static void reserve( Alloc&, uint32_t ) {}
+
+      template< typename Alloc >
+      static void release( Alloc& ) {}
+
+      //! Allocator overhead per block is not known, so only the elements themselves are counted.
+      static size_t bytes( uint32_t elementCount ) {
+        return (size_t) elementCount * sizeof( V );
+      }
+
+      static size_t slackBytes( uint32_t ) {
+        return 0;
+      }
+    };
+
+    /*
+    Dense element array of a table using compact_storage. Cells below _used are
+    either live or chained into the free list through their first bytes, and are
+    reused before the array grows. Growing keeps every index, so slots never
+    need to be updated.
+    */
+    template< typename V >
+    struct element_storage<compact_storage, V> final
+    {
+      //! Index of the element in the cell array.
+      struct slot
+      {
+        uint32_t index;
+      };
+
+    private:
+
+      //! Ends the free list.
+      static constexpr uint32_t noCell = UINT32_MAX;
+
+      //! Storage for a single element, or the link of a free cell.
+      union cell
+      {
+        alignas( V ) unsigned char bytes[sizeof( V )];
+        uint32_t nextFree;
+      };
+
+      cell* _cells = nullptr;
+
+      //! The number of cells allocated.
+      uint32_t _capacity = 0;
+
+      //! The number of cells handed out so far, live or free.
+      uint32_t _used = 0;
+
+      //! The number of cells in the free list.
+      uint32_t _freeCount = 0;
+
+      //! The most recently freed cell, or noCell.
+      uint32_t _freeHead = noCell;
+
+    public:
+
+      element_storage() = default;
+      element_storage( const element_storage& other ) = delete;
+      element_storage& operator=( const element_storage& other ) = delete;
+
+      friend void swap( element_storage& storage1, element_storage& storage2 ) noexcept {
+        using std::swap;
+        swap( storage1._cells, storage2._cells );
+        swap( storage1._capacity, storage2._capacity );
+        swap( storage1._used, storage2._used );
+        swap( storage1._freeCount, storage2._freeCount );
+        swap( storage1._freeHead, storage2._freeHead );
       }
 
-      do {
+      V* get( const slot& s ) const {
+        return std::launder( reinterpret_cast<V*>( _cells[s.index].bytes ) );
+      }
+
+      template< typename Alloc, typename... Args >
+      void construct( Alloc& alloc, slot& s, Args&&... args ) {
 
-        if ( curNode->rawKey == rawKey ) {
-          return *( curNode->dataPointer );
+        reserve( alloc, 1 );
+
+        uint32_t index;
+        if ( _freeHead != noCell ) {
+          index = _freeHead;
+          _freeHead = _cells[index].nextFree;
+          _freeCount--;
+        }
+        else {
+          index = _used++;
         }
 
-        if ( curNode->childNode != nullptr ) {
-          curNode = curNode->childNode;
-          continue;
+        try {
+          ::new ( _cells[index].bytes ) V( std::forward<Args>( args )... );
+        }
+        catch ( ... ) {
+          pushFree( index );
+          throw;
         }
 
-        curNode->childNode = new hash_map_ll_node<T>( rawKey, curNode, new T() );
-        _elementCount++;
-        return *( curNode->childNode->dataPointer );
+        s.index = index;
+      }
 
-      } while ( true );
-    }
+      template< typename Alloc >
+      void destroy( Alloc&, slot& s ) {
+        get( s )->~V();
+        pushFree( s.index );
+      }
 
-    //! Clears out the hash map from items.
-    void clear() {
+      static constexpr bool trivialDiscard = std::is_trivially_destructible<V>::value;
+
+      //! Leaves the cell out of the free list, since reset() hands out every cell again.
+      template< typename Alloc >
+      void discard( Alloc&, slot& s ) {
+        get( s )->~V();
+      }
+
+      //! Keeps the cells, refilling them from the first one on.
+      void reset() {
+        _used = 0;
+        _freeCount = 0;
+        _freeHead = noCell;
+      }
+
+      static constexpr bool trivialCopy = std::is_trivially_copyable<typename V::first_type>::value && std::is_trivially_copyable<typename V::second_type>::value;
 
-      for ( uint32_t i = 0; i < _hashIndices; i++ ) {
+      //! Copies the cells of other, free list and all, so copied slots keep their indices.
+      template< typename Alloc >
+      void copyAll( Alloc& alloc, const element_storage& other ) {
 
-        hash_map_ll_node<T>* toDelete = _heads[i];
-        hash_map_ll_node<T>* nextToDelete;
+        if ( _capacity < other._used ) {
+          release( alloc );
+          growTo( alloc, other._capacity );
+        }
 
-        while ( toDelete != nullptr ) {
-          nextToDelete = toDelete->childNode;
-          delete toDelete;
-          toDelete = nextToDelete;
+        if ( other._used != 0 ) {
+          memcpy( _cells, other._cells, (size_t) other._used * sizeof( cell ) );
         }
+
+        _used = other._used;
+        _freeCount = other._freeCount;
+        _freeHead = other._freeHead;
       }
 
-      memsetHeads();
-    }
+      //! Within a table the element stays in its cell, only the index moves.
+      static void relocate( slot& dst, slot& src ) {
+        dst.index = src.index;
+      }
 
-    //! Erases a single entity from the map.
-    void erase( int32_t rawKey ) {
+      //! Moves the element of a slot of another table into a cell of this one.
+      template< typename Alloc >
+      void transfer( Alloc& alloc, element_storage& from, slot& dst, slot& src ) {
+        V* element = from.get( src );
+        construct( alloc, dst, std::move( const_cast<typename V::first_type&>( element->first ) ), std::move( element->second ) );
+        from.destroy( alloc, src );
+      }
 
-      uint32_t hashedKey = hashThis( rawKey );
-      hash_map_ll_node<T>* curNode = _heads[hashedKey];
+      //! A node keeps its element inline, so the element moves out of its cell.
+      using node_slot = typename element_storage<inline_storage, V>::slot;
 
-      if ( curNode == nullptr ) {
-        return;
+      template< typename Alloc >
+      void extract( Alloc& alloc, slot& s, node_slot& node ) {
+        V* element = get( s );
+        element_storage<inline_storage, V>::construct( alloc, node, std::move( const_cast<typename V::first_type&>( element->first ) ), std::move( element->second ) );
+        destroy( alloc, s );
       }
 
-      do {
+      template< typename Alloc >
+      void adopt( Alloc& alloc, slot& s, node_slot& node ) {
+        V* element = element_storage<inline_storage, V>::get( node );
+        construct( alloc, s, std::move( const_cast<typename V::first_type&>( element->first ) ), std::move( element->second ) );
+        element_storage<inline_storage, V>::destroy( alloc, node );
+      }
 
-        if ( curNode->rawKey == rawKey ) {
+      template< typename Alloc >
+      void reserve( Alloc& alloc, uint32_t extra ) {
 
-          if ( curNode->parentNode == nullptr ) {
-            _heads[hashedKey] = curNode->childNode;
-          }
-          else {
-            curNode->parentNode->childNode = curNode->childNode;
-          }
-          delete curNode;
+        if ( _capacity - _used + _freeCount >= extra ) {
           return;
         }
 
-        if ( curNode->childNode == nullptr ) {
-          return;
+        // Growing by half keeps the unused tail smaller than doubling would.
+        uint64_t capacity = (uint64_t) _capacity + _capacity / 2;
+        if ( capacity < (uint64_t) _used + extra ) {
+          capacity = (uint64_t) _used + extra;
+        }
+        if ( capacity < 8 ) {
+          capacity = 8;
         }
-        curNode = curNode->childNode;
-
-      } while ( true );
 
-    }
+        growTo( alloc, capacity < noCell ? (uint32_t) capacity : noCell - 1 );
+      }
 
-    //! Checks if the map is empty or not.
-    bool empty() {
-      return _elementCount == 0;
-    }
+      template< typename Alloc >
+      void release( Alloc& alloc ) {
 
-    //! Returns the number of elements in the map.
-    uint32_t size() {
-      return _elementCount;
-    }
+        if ( _cells != nullptr ) {
+          cell_allocator<Alloc> cellAlloc( alloc );
+          std::allocator_traits<cell_allocator<Alloc>>::deallocate( cellAlloc, _cells, _capacity );
+        }
 
-    //! Returns the density of the bucket containing the given key.
-    uint32_t bucketDensity( int32_t rawKey ) {
+        _cells = nullptr;
+        _capacity = 0;
+        _used = 0;
+        _freeCount = 0;
+        _freeHead = noCell;
+      }
 
-      uint32_t counter = 0;
-      hash_map_ll_node<T>* curNode = _heads[hashThis( rawKey )];
+      size_t bytes( uint32_t ) const {
+        return (size_t) _capacity * sizeof( cell );
+      }
 
-      while ( curNode != nullptr ) {
-        counter++;
-        curNode = curNode->childNode;
+      //! Free and never used cells.
+      size_t slackBytes( uint32_t elementCount ) const {
+        return (size_t) ( _capacity - elementCount ) * sizeof( cell );
       }
 
-      return counter;
-    }
+    private:
 
-    //! Returns the number of buckets (hash size?).
-    uint32_t bucketCount() {
-      return _hashIndices;
-    }
+      template< typename Alloc >
+      using cell_allocator = typename std::allocator_traits<Alloc>::template rebind_alloc<cell>;
 
-#ifdef _DEBUG
+      void pushFree( uint32_t index ) {
+        _cells[index].nextFree = _freeHead;
+        _freeHead = index;
+        _freeCount++;
+      }
 
-    //! Prints each entry in map to console. Mainly a debug thing.
-    void debugString() {
+      //! Moves every cell into a bigger array at the same index.
+      template< typename Alloc >
+      void growTo( Alloc& alloc, uint32_t capacity ) {
 
-      std::cout << "Loc\tKey\tValue" << std::endl;
-      for ( size_t i = 0; i < _hashIndices; i++ ) {
+        cell_allocator<Alloc> cellAlloc( alloc );
+        cell* grown = std::allocator_traits<cell_allocator<Alloc>>::allocate( cellAlloc, capacity );
 
-        if ( headerHasData( i ) ) {
+        // Free cells hold no element to move, so they are picked out first.
+        std::unique_ptr<bool[]> isFree;
+        if ( _freeCount != 0 ) {
+          isFree.reset( new bool[_used]() );
+          for ( uint32_t i = _freeHead; i != noCell; i = _cells[i].nextFree ) {
+            isFree[i] = true;
+          }
+        }
 
-          hash_map_ll_node<T>* h = _heads[i];
+        for ( uint32_t i = 0; i < _used; i++ ) {
 
-          while ( h != nullptr ) {
-            std::cout << i << "\t" << ( h->rawKey ) << "\t" << *( h->dataPointer ) << std::endl;
-            h = h->childNode;
+          if ( isFree && isFree[i] ) {
+            grown[i].nextFree = _cells[i].nextFree;
+            continue;
           }
+
+          V* element = std::launder( reinterpret_cast<V*>( _cells[i].bytes ) );
+          ::new ( grown[i].bytes ) V( std::move( const_cast<typename V::first_type&>( element->first ) ), std::move( element->second ) );
+          element->~V();
+        }
+
+        if ( _cells != nullptr ) {
+          std::allocator_traits<cell_allocator<Alloc>>::deallocate( cellAlloc, _cells, _capacity );
         }
+
+        _cells = grown;
+        _capacity = capacity;
       }
+    };
+
+    //! Adds one to histogram[index], growing it as needed.
+    inline void countInto( std::vector<uint32_t>& histogram, uint32_t index ) {
+      if ( histogram.size() <= index ) {
+        histogram.resize( index + 1 );
+      }
+      histogram[index]++;
     }
 
-#endif
+    template< typename K, typename T, typename Storage, typename Allocator >
+    class robin_hood_table final
+    {
 
-  private:
+    public:
 
-    //! Clears the _heads data to all 0 bits.
-    void memsetHeads() {
-      memset( _heads, 0, sizeof( hash_map_ll_node<T>* ) * _hashIndices );
-    }
+      using value_type = std::pair<const K, T>;
+      using allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<value_type>;
+      using node_storage = rstd_support::node_storage<Storage, value_type>;
+      using node_slot = typename node_storage::slot;
 
-    //! Hashes the key
-    uint32_t hashThis( int32_t rawKey ) {
-      return (uint32_t) ( rawKey & ( _hashIndices - 1 ) );
-    }
+    private:
 
-    //! Checks to see if the header has a hash_map_ll_node.
-    bool headerHasData( uint32_t hashedKey ) {
-      return _heads[hashedKey] != nullptr;
-    }
+      using storage = element_storage<Storage, value_type>;
+      using slot = typename storage::slot;
+      using slot_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<slot>;
 
-  };
+    public:
 
-  template< typename valtype >
-  void swap( hash_map<valtype>& map1, hash_map<valtype>& map2 ) {
-    using std::swap;
-    swap( map1._hashIndices, map2._hashIndices );
-    swap( map1._elementCount, map2._elementCount );
-    swap( map1._heads, map2._heads );
-  }
+      //! Returned by index lookups that found nothing.
+      static constexpr uint32_t npos = UINT32_MAX;
 
-}
+      //! The furthest an element may sit from its home bucket.
+      static constexpr uint32_t maxDistance = 255;
 
-#endif // HASH_MAP_H
+    private:
+
+      //! The number of home buckets. Always a power of two, or 0 when unallocated.
+      uint32_t _bucketCount = 0;
+
+      //! The number of slots, home buckets plus the overflow tail.
+      uint32_t _slotCount = 0;
+
+      //! Mask reducing a hash to a home bucket.
+      uint32_t _mask = 0;
+
+      //! The number of elements in the table.
+      uint32_t _elementCount = 0;
+
+      //! Distance from home plus one of each slot, 0 if empty. Followed by a 0 sentinel.
+      uint8_t* _info = emptyInfo();
+
+      //! The element storage, parallel to _info. _info lives in the same allocation, right after it.
+      slot* _slots = nullptr;
+
+      //! Slots of the elements too far from home for the table, at slot indices from _slotCount on.
+      slot* _stash = nullptr;
+
+      //! The number of elements in the stash.
+      uint32_t _stashCount = 0;
+
+      //! The number of slots allocated for the stash.
+      uint32_t _stashCapacity = 0;
+
+      //! Allocates the table block and any boxed elements.
+      allocator_type _allocator;
+
+      //! Holds the elements, or whatever the slots refer to.
+      storage _store;
 
+    public:
+
+      friend void swap( robin_hood_table& table1, robin_hood_table& table2 ) noexcept {
+        using std::swap;
+        swap( table1._bucketCount, table2._bucketCount );
+        swap( table1._slotCount, table2._slotCount );
+        swap( table1._mask, table2._mask );
+        swap( table1._elementCount, table2._elementCount );
+        swap( table1._info, table2._info );
+        swap( table1._slots, table2._slots );
+        swap( table1._stash, table2._stash );
+        swap( table1._stashCount, table2._stashCount );
+        swap( table1._stashCapacity, table2._stashCapacity );
+        swap( table1._allocator, table2._allocator );
+        swap( table1._store, table2._store );
+      }
+
+      explicit robin_hood_table( const allocator_type& alloc = allocator_type() ) :
+        _allocator( alloc ) {}
+
+      //! Allocates an empty table. bucketCount must be a power of two.
+      robin_hood_table( uint32_t bucketCount, const allocator_type& alloc ) :
+        _allocator( alloc ) {
+
+        if ( bucketCount == 0 ) {
+          return;
+        }
+
+        _bucketCount = bucketCount;
+        _slotCount = bucketCount + ( bucketCount < maxDistance ? bucketCount : maxDistance );
+        _mask = bucketCount - 1;
+
+        slot_allocator slotAlloc( _allocator );
+        _slots = std::allocator_traits<slot_allocator>::allocate( slotAlloc, blockSlots() );
+        _info = reinterpret_cast<uint8_t*>( _slots + _slotCount );
+        memset( _info, 0, _slotCount + 1 );
+      }
+
+      robin_hood_table( const robin_hood_table& other ) :
+        robin_hood_table( other._bucketCount, std::allocator_traits<allocator_type>::select_on_container_copy_construction( other._allocator ) ) {
+        copyFrom( other );
+      }
+
+      robin_hood_table( robin_hood_table&& other ) noexcept :
+        _allocator( other._allocator ) {
+        swap( *this, other );
+      }
+
+      robin_hood_table& operator=( robin_hood_table other ) noexcept {
+        swap( *this, other );
+        return *this;
+      }
 
+      ~robin_hood_table() {
+        clear();
+        _store.release( _allocator );
+        slot_allocator slotAlloc( _allocator );
+        if ( _slots != nullptr ) {
+          std::allocator_traits<slot_allocator>::deallocate( slotAlloc, _slots, blockSlots() );
+        }
+        if ( _stash != nullptr ) {
+          std::allocator_traits<slot_allocator>::deallocate( slotAlloc, _stash, _stashCapacity );
+        }
+      }
 
+      //! Returns the slot index holding the key, or npos.
+      template< typename Key, typename KeyEqual >
+      uint32_t findIndex( const Key& rawKey, size_t hash, const KeyEqual& equal ) const {
 
+        uint32_t index = (uint32_t) ( hash & _mask );
+        uint32_t distance = 1;
 
+        while ( _info[index] >= distance ) {
+          if ( _info[index] == distance && equal( _store.get( _slots[index] )->first, rawKey ) ) {
+            return index;
+          }
+          index++;
+          distance++;
+        }
 
+        if ( _stashCount != 0 ) {
+          return findStashed( rawKey, equal );
+        }
 
+        return npos;
+      }
 
+      //! Returns the element holding the key, or nullptr.
+      template< typename Key, typename KeyEqual >
+      value_type* find( const Key& rawKey, size_t hash, const KeyEqual& equal ) const {
+        uint32_t index = findIndex( rawKey, hash, equal );
+        return index == npos ? nullptr : _store.get( slotAt( index ) );
+      }
 
+      /*
+      Opens up the slot a new element with the given hash belongs in, shifting
+      the rest of its run to the right. The key must not be in the table yet.
+      Returns npos when the table has run out of room and needs to grow; the
+      table is left untouched in that case. A table at most half full opens a
+      stash slot instead, since growing it would not shorten the run.
+      */
+      uint32_t makeRoom( size_t hash ) {
 
+        uint32_t index = openRun( hash );
+        if ( index == npos && _bucketCount != 0 && _elementCount < _bucketCount / 2 ) {
+          index = openStash();
+        }
 
+        return index;
+      }
 
+      //! Same as makeRoom(), falling back to the stash however full the table is. Never returns npos.
+      uint32_t makeRoomOrStash( size_t hash ) {
+        uint32_t index = openRun( hash );
+        return index == npos ? openStash() : index;
+      }
 
+    private:
 
+      //! The part of makeRoom() shifting the run, without the stash.
+      uint32_t openRun( size_t hash ) {
 
+        uint32_t index = (uint32_t) ( hash & _mask );
+        uint32_t distance = 1;
 
+        while ( _info[index] >= distance ) {
+          index++;
+          distance++;
+        }
 
+        uint32_t end = index;
+        while ( _info[end] != 0 ) {
+          if ( _info[end] == maxDistance ) {
+            return npos;
+          }
+          end++;
+        }
 
+        if ( end >= _slotCount || distance > maxDistance ) {
+          return npos;
+        }
+
+        for ( uint32_t i = end; i > index; i-- ) {
+          _store.relocate( _slots[i], _slots[i - 1] );
+          _info[i] = _info[i - 1] + 1;
+        }
+        _info[index] = (uint8_t) distance;
+
+        return index;
+      }
+
+    public:
+
+      //! Constructs an element in a slot opened by makeRoom().
+      template< typename... Args >
+      value_type& constructAt( uint32_t index, Args&&... args ) {
+
+        try {
+          _store.construct( _allocator, slotAt( index ), std::forward<Args>( args )... );
+        }
+        catch ( ... ) {
+          closeRoom( index );
+          throw;
+        }
+
+        _elementCount++;
+        return *_store.get( slotAt( index ) );
+      }
+
+      //! Destroys the element in the given slot.
+      void eraseAt( uint32_t index ) {
+        _store.destroy( _allocator, slotAt( index ) );
+        _elementCount--;
+        closeRoom( index );
+      }
+
+      //! Same as eraseAt(), moving the element out into node instead of destroying it.
+      void extractAt( uint32_t index, node_slot& node ) {
+        _store.extract( _allocator, slotAt( index ), node );
+        _elementCount--;
+        closeRoom( index );
+      }
+
+      //! Same as constructAt(), moving the element of node in.
+      value_type& adoptAt( uint32_t index, node_slot& node ) {
+
+        try {
+          _store.adopt( _allocator, slotAt( index ), node );
+        }
+        catch ( ... ) {
+          closeRoom( index );
+          throw;
+        }
+
+        _elementCount++;
+        return *_store.get( slotAt( index ) );
+      }
+
+      /*
+      Copies every element of other into the same slot of this table, which
+      must be empty and have as many buckets. Trivially copyable elements are
+      copied along with their info bytes in a single memcpy of the block.
+      */
+      void copyFrom( const robin_hood_table& other ) {
+
+        if ( _slots == nullptr ) {
+          return;
+        }
+
+        reserveStash( other._stashCount );
+
+        if ( storage::trivialCopy ) {
+          _store.copyAll( _allocator, other._store );
+          memcpy( _slots, other._slots, (size_t) blockSlots() * sizeof( slot ) );
+          if ( other._stashCount != 0 ) {
+            memcpy( _stash, other._stash, (size_t) other._stashCount * sizeof( slot ) );
+          }
+          _stashCount = other._stashCount;
+          _elementCount = other._elementCount;
+          return;
+        }
+
+        for ( uint32_t i = other.nextOccupied( 0 ); i < _slotCount; i = other.nextOccupied( i + 1 ) ) {
+          _store.construct( _allocator, _slots[i], *other._store.get( other._slots[i] ) );
+          _info[i] = other._info[i];
+          _elementCount++;
+        }
+
+        for ( uint32_t i = 0; i < other._stashCount; i++ ) {
+          _store.construct( _allocator, _stash[i], *other._store.get( other._stash[i] ) );
+          _stashCount++;
+          _elementCount++;
+        }
+      }
+
+      //! Moves the element in the given slot into target under its hash. Returns its slot in target, or npos, changing nothing, if target is out of room.
+      uint32_t moveTo( robin_hood_table& target, uint32_t index, size_t hash ) {
+
+        // Reserving first leaves nothing that can fail once the slot is claimed.
+        target._store.reserve( target._allocator, 1 );
+
+        uint32_t targetIndex = target.makeRoom( hash );
+        if ( targetIndex == npos ) {
+          return npos;
+        }
+
+        target._store.transfer( target._allocator, _store, target.slotAt( targetIndex ), slotAt( index ) );
+        target._elementCount++;
+        _elementCount--;
+        closeRoom( index );
+        return targetIndex;
+      }
+
+      //! Erases the key if present. Returns whether anything was erased.
+      template< typename Key, typename KeyEqual >
+      bool erase( const Key& rawKey, size_t hash, const KeyEqual& equal ) {
+
+        uint32_t index = findIndex( rawKey, hash, equal );
+        if ( index == npos ) {
+          return false;
+        }
+
+        eraseAt( index );
+        return true;
+      }
+
+      /*
+      Destroys every element, keeping the slots and element storage for the
+      next fill. Elements that need no destructor are not visited at all; the
+      info bytes are wiped in one go.
+      */
+      void clear() {
+
+        // A drained table, like the old one of an incremental rehash, has nothing to visit.
+        if ( _elementCount == 0 ) {
+          return;
+        }
+
+        if ( !storage::trivialDiscard ) {
+          for ( uint32_t i = nextOccupied( 0 ); i < slotCount(); i = nextOccupied( i + 1 ) ) {
+            _store.discard( _allocator, slotAt( i ) );
+          }
+        }
+
+        memset( _info, 0, _slotCount );
+        _store.reset();
+        _stashCount = 0;
+        _elementCount = 0;
+      }
+
+      /*
+      Moves every element into a new table with the given number of buckets.
+      Elements the new table has no room for go to its stash, so a rehash never
+      has to grow again halfway through.
+      */
+      template< typename Hasher >
+      void rehash( uint32_t bucketCount, const Hasher& hasher ) {
+
+        robin_hood_table resized( bucketCount, _allocator );
+        resized._store.reserve( resized._allocator, _elementCount );
+
+        for ( uint32_t i = nextOccupied( 0 ); i < slotCount(); i = nextOccupied( i + 1 ) ) {
+          size_t hash = hasher( _store.get( slotAt( i ) )->first );
+          uint32_t index = resized.makeRoomOrStash( hash );
+          resized._store.transfer( resized._allocator, _store, resized.slotAt( index ), slotAt( i ) );
+          resized._elementCount++;
+        }
+
+        memset( _info, 0, _slotCount );
+        _stashCount = 0;
+        _elementCount = 0;
+        swap( *this, resized );
+      }
+
+      uint32_t size() const {
+        return _elementCount;
+      }
+
+      //! Erasing shifts runs back, so there are never any tombstones.
+      uint32_t tombstones() const {
+        return 0;
+      }
+
+      uint32_t bucketCount() const {
+        return _bucketCount;
+      }
+
+      //! Returns the bucket count growing the table should move to.
+      uint32_t grownBucketCount() const {
+        return _bucketCount == 0 ? 8 : _bucketCount * 2;
+      }
+
+      //! The table an incremental rehash drains, this one as a whole.
+      using migration_table = robin_hood_table;
+
+      migration_table& migrationTable() {
+        return *this;
+      }
+
+      //! The slots of the table, then those of the stash.
+      uint32_t slotCount() const {
+        return _slotCount + _stashCount;
+      }
+
+      //! Returns the number of elements in the stash.
+      uint32_t stashed() const {
+        return _stashCount;
+      }
+
+      //! Returns the bytes of the table block, the slots along with their info bytes, and of the stash.
+      size_t blockBytes() const {
+        return ( _slots == nullptr ? 0 : (size_t) blockSlots() * sizeof( slot ) ) + (size_t) _stashCapacity * sizeof( slot );
+      }
+
+      //! Returns the bytes held by elements stored outside of the slots.
+      size_t elementBytes() const {
+        return _store.bytes( _elementCount );
+      }
+
+      //! Returns the bytes of empty slots and of unused element storage.
+      size_t slackBytes() const {
+        return (size_t) ( _slotCount + _stashCapacity - _elementCount ) * sizeof( slot ) + _store.slackBytes( _elementCount );
+      }
+
+      //! Counts every element into histogram by its distance from home.
+      template< typename Hasher >
+      void probeHistogram( const Hasher&, std::vector<uint32_t>& histogram ) const {
+        for ( uint32_t i = nextOccupied( 0 ); i < slotCount(); i = nextOccupied( i + 1 ) ) {
+          countInto( histogram, probeLength( i, 0 ) - 1 );
+        }
+      }
+
+      //! Returns the number of slots a lookup of the given hash inspects to reach the occupied slot index. Stashed elements count a full run first.
+      uint32_t probeLength( uint32_t index, size_t ) const {
+        return index < _slotCount ? _info[index] : maxDistance + 1 + ( index - _slotCount );
+      }
+
+      //! Returns the most elements sharing a single home bucket.
+      template< typename Hasher >
+      uint32_t maxHomeDensity( const Hasher& hasher ) const {
+
+        if ( _stashCount != 0 ) {
+          return maxHomeDensityStashed( hasher );
+        }
+
+        uint32_t densest = 0;
+        uint32_t counter = 0;
+        uint32_t currentHome = npos;
+
+        // Elements sharing a home are stored next to each other, so a single pass counts them.
+        for ( uint32_t i = nextOccupied( 0 ); i < _slotCount; i = nextOccupied( i + 1 ) ) {
+
+          uint32_t home = i + 1 - _info[i];
+          if ( home != currentHome ) {
+            currentHome = home;
+            counter = 0;
+          }
+
+          counter++;
+          if ( counter > densest ) {
+            densest = counter;
+          }
+        }
+
+        return densest;
+      }
+
+      //! Returns the home bucket of a hash.
+      uint32_t homeBucket( size_t hash ) const {
+        return (uint32_t) ( hash & _mask );
+      }
+
+      //! Makes sure extra more elements can be constructed without the element storage allocating.
+      void reserveElements( uint32_t extra ) {
+        _store.reserve( _allocator, extra );
+      }
+
+      //! Starts loading the info bytes and slot of the home bucket of a hash.
+      void prefetch( size_t hash ) const {
+        uint32_t index = (uint32_t) ( hash & _mask );
+        rstd_support::prefetch( _info + index );
+        if ( _slots != nullptr ) {
+          rstd_support::prefetch( _slots + index );
+        }
+      }
+
+      //! Returns the number of elements sharing the home bucket of hash.
+      template< typename Hasher >
+      uint32_t homeDensity( size_t hash, const Hasher& hasher ) const {
+
+        uint32_t home = (uint32_t) ( hash & _mask );
+        uint32_t counter = 0;
+
+        for ( uint32_t i = 0; i < _stashCount; i++ ) {
+          counter += homeBucket( hasher( _store.get( _stash[i] )->first ) ) == home;
+        }
+
+        // Elements sharing a home are stored next to each other, after those homed earlier.
+        for ( uint32_t i = home; i < _slotCount && _info[i] != 0; i++ ) {
+          uint32_t slotHome = i + 1 - _info[i];
+          if ( slotHome > home ) {
+            break;
+          }
+          if ( slotHome == home ) {
+            counter++;
+          }
+        }
+
+        return counter;
+      }
+
+      //! Checks whether the given slot holds an element.
+      bool occupied( uint32_t index ) const {
+        return index < _slotCount ? _info[index] != 0 : index < slotCount();
+      }
+
+      //! Returns the first occupied slot at or after index, or slotCount() if there is none. The stash is full up to its count.
+      uint32_t nextOccupied( uint32_t index ) const {
+
+        if ( index >= _slotCount ) {
+          return index < slotCount() ? index : slotCount();
+        }
+
+        // Skip empty stretches eight info bytes at a time.
+        uint64_t word;
+        while ( index + 8 <= _slotCount ) {
+          memcpy( &word, _info + index, 8 );
+          if ( word != 0 ) {
+            break;
+          }
+          index += 8;
+        }
+
+        while ( index < _slotCount && _info[index] == 0 ) {
+          index++;
+        }
+
+        return index < _slotCount || _stashCount == 0 ? index : _slotCount;
+      }
+
+      value_type& slotValue( uint32_t index ) const {
+        return *_store.get( slotAt( index ) );
+      }
+
+      //! Returns the raw slot array, slotCount() slots when nothing is stashed, or nullptr when unallocated.
+      const void* slotData() const {
+        return _slots;
+      }
+
+      //! Returns the info bytes, slotCount() of them followed by the 0 sentinel.
+      const uint8_t* infoData() const {
+        return _info;
+      }
+
+      allocator_type get_allocator() const {
+        return _allocator;
+      }
+
+    private:
+
+      //! Shared info array of unallocated tables, a lone sentinel.
+      static uint8_t* emptyInfo() {
+        static uint8_t sentinel[1] = { 0 };
+        return sentinel;
+      }
+
+      //! The size of the table block in slots, enough to also hold _info and its sentinel.
+      uint32_t blockSlots() const {
+        return _slotCount + ( _slotCount + sizeof( slot ) ) / sizeof( slot );
+      }
+
+      slot& slotAt( uint32_t index ) const {
+        return index < _slotCount ? _slots[index] : _stash[index - _slotCount];
+      }
+
+      template< typename Key, typename KeyEqual >
+      uint32_t findStashed( const Key& rawKey, const KeyEqual& equal ) const {
+        for ( uint32_t i = 0; i < _stashCount; i++ ) {
+          if ( equal( _store.get( _stash[i] )->first, rawKey ) ) {
+            return _slotCount + i;
+          }
+        }
+        return npos;
+      }
+
+      //! Makes sure the stash holds count elements, moving the stashed ones into a bigger array if needed.
+      void reserveStash( uint32_t count ) {
+
+        if ( count <= _stashCapacity ) {
+          return;
+        }
+
+        uint32_t capacity = _stashCapacity < 8 ? 8 : _stashCapacity * 2;
+        if ( capacity < count ) {
+          capacity = count;
+        }
+
+        slot_allocator slotAlloc( _allocator );
+        slot* grown = std::allocator_traits<slot_allocator>::allocate( slotAlloc, capacity );
+        for ( uint32_t i = 0; i < _stashCount; i++ ) {
+          _store.relocate( grown[i], _stash[i] );
+        }
+
+        if ( _stash != nullptr ) {
+          std::allocator_traits<slot_allocator>::deallocate( slotAlloc, _stash, _stashCapacity );
+        }
+
+        _stash = grown;
+        _stashCapacity = capacity;
+      }
+
+      //! Opens the next stash slot.
+      uint32_t openStash() {
+        reserveStash( _stashCount + 1 );
+        return _slotCount + _stashCount++;
+      }
+
+      //! maxHomeDensity() of a table with a stash, whose elements are counted by their hashes.
+      template< typename Hasher >
+      uint32_t maxHomeDensityStashed( const Hasher& hasher ) const {
+
+        std::vector<uint32_t> homes;
+        for ( uint32_t i = nextOccupied( 0 ); i < slotCount(); i = nextOccupied( i + 1 ) ) {
+          homes.push_back( i < _slotCount ? i + 1 - _info[i] : homeBucket( hasher( _store.get( _stash[i - _slotCount] )->first ) ) );
+        }
+        std::sort( homes.begin(), homes.end() );
+
+        uint32_t densest = 0;
+        for ( size_t first = 0, last = 0; first < homes.size(); first = last ) {
+          while ( last < homes.size() && homes[last] == homes[first] ) {
+            last++;
+          }
+          if ( last - first > densest ) {
+            densest = (uint32_t) ( last - first );
+          }
+        }
+
+        return densest;
+      }
+
+      //! Frees an uninitialized slot, shifting the rest of its run back by one. A stash slot takes the last stashed element instead.
+      void closeRoom( uint32_t index ) {
+
+        if ( index >= _slotCount ) {
+          _stashCount--;
+          if ( index != _slotCount + _stashCount ) {
+            _store.relocate( _stash[index - _slotCount], _stash[_stashCount] );
+          }
+          return;
+        }
+
+        while ( _info[index + 1] > 1 ) {
+          _store.relocate( _slots[index], _slots[index + 1] );
+          _info[index] = _info[index + 1] - 1;
+          index++;
+        }
+
+        _info[index] = 0;
+      }
+
+    };
+
+    //! Number of trailing zero bits of a non-zero word.
+    inline uint32_t countTrailingZeros( uint64_t bits ) {
+#if defined( __GNUC__ ) || defined( __clang__ )
+      return (uint32_t) __builtin_ctzll( bits );
+#else
+      uint32_t count = 0;
+      while ( ( bits & 1 ) == 0 ) {
+        bits >>= 1;
+        count++;
+      }
+      return count;
+#endif
+    }
+
+    //! Number of leading zero bits of a non-zero word.
+    inline uint32_t countLeadingZeros( uint64_t bits ) {
+#if defined( __GNUC__ ) || defined( __clang__ )
+      return (uint32_t) __builtin_clzll( bits );
+#else
+      uint32_t count = 0;
+      while ( ( bits & 0x8000000000000000ull ) == 0 ) {
+        bits <<= 1;
+        count++;
+      }
+      return count;
+#endif
+    }
+
+    //! Control byte of an empty slot in a group_table. Full slots hold 7 bits of their hash instead.
+    constexpr int8_t ctrlEmpty = -128;
+
+    //! Control byte of a slot whose element was erased, a tombstone.
+    constexpr int8_t ctrlDeleted = -2;
+
+    /*
+    The slots of a group matching some test. Every slot owns 1 << Shift bits of
+    the mask, of which only the highest may be set.
+    */
+    template< uint32_t Width, uint32_t Shift >
+    class group_mask final
+    {
+
+    private:
+
+      uint64_t _bits;
+
+    public:
+
+      explicit group_mask( uint64_t bits ) :
+        _bits( bits ) {}
+
+      explicit operator bool() const {
+        return _bits != 0;
+      }
+
+      //! Returns the lowest matching slot. The mask must not be empty.
+      uint32_t lowest() const {
+        return countTrailingZeros( _bits ) >> Shift;
+      }
+
+      void dropLowest() {
+        _bits &= _bits - 1;
+      }
+
+      //! Returns the number of slots below the lowest match, Width if none.
+      uint32_t trailingClear() const {
+        return _bits == 0 ? Width : lowest();
+      }
+
+      //! Returns the number of slots above the highest match, Width if none.
+      uint32_t leadingClear() const {
+        return _bits == 0 ? Width : ( countLeadingZeros( _bits ) - ( 64 - ( Width << Shift ) ) ) >> Shift;
+      }
+
+    };
+
+#if defined( __AVX2__ )
+
+    //! Control bytes of 32 consecutive slots, tested with AVX2.
+    class control_group final
+    {
+
+    public:
+
+      static constexpr uint32_t width = 32;
+      using mask = group_mask<width, 0>;
+
+    private:
+
+      __m256i _ctrl;
+
+    public:
+
+      explicit control_group( const int8_t* ctrl ) :
+        _ctrl( _mm256_loadu_si256( reinterpret_cast<const __m256i*>( ctrl ) ) ) {}
+
+      mask match( int8_t tag ) const {
+        return mask( (uint32_t) _mm256_movemask_epi8( _mm256_cmpeq_epi8( _ctrl, _mm256_set1_epi8( tag ) ) ) );
+      }
+
+      mask matchEmpty() const {
+        return match( ctrlEmpty );
+      }
+
+      mask matchEmptyOrDeleted() const {
+        return mask( (uint32_t) _mm256_movemask_epi8( _mm256_cmpgt_epi8( _mm256_set1_epi8( -1 ), _ctrl ) ) );
+      }
+
+    };
+
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+
+    //! Control bytes of 16 consecutive slots, tested with SSE2.
+    class control_group final
+    {
+
+    public:
+
+      static constexpr uint32_t width = 16;
+      using mask = group_mask<width, 0>;
+
+    private:
+
+      __m128i _ctrl;
+
+    public:
+
+      explicit control_group( const int8_t* ctrl ) :
+        _ctrl( _mm_loadu_si128( reinterpret_cast<const __m128i*>( ctrl ) ) ) {}
+
+      mask match( int8_t tag ) const {
+        return mask( (uint32_t) _mm_movemask_epi8( _mm_cmpeq_epi8( _ctrl, _mm_set1_epi8( tag ) ) ) );
+      }
+
+      mask matchEmpty() const {
+        return match( ctrlEmpty );
+      }
+
+      mask matchEmptyOrDeleted() const {
+        return mask( (uint32_t) _mm_movemask_epi8( _mm_cmpgt_epi8( _mm_set1_epi8( -1 ), _ctrl ) ) );
+      }
+
+    };
+
+#elif defined( __ARM_NEON ) && defined( __aarch64__ )
+
+    //! Control bytes of 16 consecutive slots, tested with NEON.
+    class control_group final
+    {
+
+    public:
+
+      static constexpr uint32_t width = 16;
+      using mask = group_mask<width, 2>;
+
+    private:
+
+      int8x16_t _ctrl;
+
+      //! Narrows a 16 lane comparison into 4 bits per lane, keeping only the highest.
+      static mask toMask( uint8x16_t lanes ) {
+        uint64_t bits = vget_lane_u64( vreinterpret_u64_u8( vshrn_n_u16( vreinterpretq_u16_u8( lanes ), 4 ) ), 0 );
+        return mask( bits & 0x8888888888888888ull );
+      }
+
+    public:
+
+      explicit control_group( const int8_t* ctrl ) :
+        _ctrl( vld1q_s8( ctrl ) ) {}
+
+      mask match( int8_t tag ) const {
+        return toMask( vceqq_s8( _ctrl, vdupq_n_s8( tag ) ) );
+      }
+
+      mask matchEmpty() const {
+        return match( ctrlEmpty );
+      }
+
+      mask matchEmptyOrDeleted() const {
+        return toMask( vcltq_s8( _ctrl, vdupq_n_s8( -1 ) ) );
+      }
+
+    };
+
+#else
+
+    //! Control bytes of 8 consecutive slots, tested eight at a time within a 64-bit word.
+    class control_group final
+    {
+
+    public:
+
+      static constexpr uint32_t width = 8;
+      using mask = group_mask<width, 3>;
+
+    private:
+
+      static constexpr uint64_t lsbs = 0x0101010101010101ull;
+      static constexpr uint64_t msbs = 0x8080808080808080ull;
+
+      uint64_t _ctrl;
+
+    public:
+
+      explicit control_group( const int8_t* ctrl ) {
+        memcpy( &_ctrl, ctrl, 8 );
+#if defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        _ctrl = __builtin_bswap64( _ctrl );
+#endif
+      }
+
+      //! May report false positives next to real matches; callers compare keys anyway.
+      mask match( int8_t tag ) const {
+        uint64_t x = _ctrl ^ ( lsbs * (uint8_t) tag );
+        return mask( ( x - lsbs ) & ~x & msbs );
+      }
+
+      //! Empty is the only control byte with the top bit set and bit 1 clear.
+      mask matchEmpty() const {
+        return mask( _ctrl & ~( _ctrl << 6 ) & msbs );
+      }
+
+      //! Empty and deleted are the only control bytes with the top bit set and bit 0 clear.
+      mask matchEmptyOrDeleted() const {
+        return mask( _ctrl & ~( _ctrl << 7 ) & msbs );
+      }
+
+    };
+
+#endif
+
+    /*
+    A Swiss table style engine. Next to the slots sits an array of one control
+    byte per slot holding either ctrlEmpty, ctrlDeleted, or the low 7 bits of the
+    hash of the element stored there. The rest of the hash picks the group of
+    control_group::width slots a probe starts at. A probe compares the 7 bit tag
+    against a whole group of control bytes at once and only touches the slots
+    whose tag matched, so most misses are rejected without reading any key.
+    The probe moves on to further groups in triangular steps until it meets a
+    group with an empty slot.
+
+    Erasing leaves a tombstone unless no probe can have passed through the slot.
+    Tombstones count against the load factor and are dropped by rehashing.
+    The first width control bytes are cloned past the end of the array, so a
+    group starting at any slot can be loaded in one go.
+    */
+    template< typename K, typename T, typename Storage, typename Allocator >
+    class group_table final
+    {
+
+    public:
+
+      using value_type = std::pair<const K, T>;
+      using allocator_type = typename std::allocator_traits<Allocator>::template rebind_alloc<value_type>;
+      using node_storage = rstd_support::node_storage<Storage, value_type>;
+      using node_slot = typename node_storage::slot;
+
+    private:
+
+      using storage = element_storage<Storage, value_type>;
+      using slot = typename storage::slot;
+      using slot_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<slot>;
+      using group = control_group;
+
+    public:
+
+      //! Returned by index lookups that found nothing.
+      static constexpr uint32_t npos = UINT32_MAX;
+
+      //! The smallest number of slots a table has, one group.
+      static constexpr uint32_t minBucketCount = group::width;
+
+    private:
+
+      //! The number of slots. Always a power of two of at least one group, or 0 when unallocated.
+      uint32_t _bucketCount = 0;
+
+      //! Mask reducing a position to a slot.
+      uint32_t _mask = 0;
+
+      //! The number of elements in the table.
+      uint32_t _elementCount = 0;
+
+      //! The number of tombstones in the table.
+      uint32_t _deletedCount = 0;
+
+      //! One control byte per slot, followed by clones of the first group.
+      int8_t* _ctrl = emptyCtrl();
+
+      //! The element storage. _ctrl lives in the same allocation, right after it.
+      slot* _slots = nullptr;
+
+      //! Allocates the table block and any boxed elements.
+      allocator_type _allocator;
+
+      //! Holds the elements, or whatever the slots refer to.
+      storage _store;
+
+    public:
+
+      friend void swap( group_table& table1, group_table& table2 ) noexcept {
+        using std::swap;
+        swap( table1._bucketCount, table2._bucketCount );
+        swap( table1._mask, table2._mask );
+        swap( table1._elementCount, table2._elementCount );
+        swap( table1._deletedCount, table2._deletedCount );
+        swap( table1._ctrl, table2._ctrl );
+        swap( table1._slots, table2._slots );
+        swap( table1._allocator, table2._allocator );
+        swap( table1._store, table2._store );
+      }
+
+      explicit group_table( const allocator_type& alloc = allocator_type() ) :
+        _allocator( alloc ) {}
+
+      //! Allocates an empty table. bucketCount must be a power of two and is raised to minBucketCount.
+      group_table( uint32_t bucketCount, const allocator_type& alloc ) :
+        _allocator( alloc ) {
+
+        if ( bucketCount == 0 ) {
+          return;
+        }
+
+        _bucketCount = bucketCount < minBucketCount ? minBucketCount : bucketCount;
+        _mask = _bucketCount - 1;
+
+        slot_allocator slotAlloc( _allocator );
+        _slots = std::allocator_traits<slot_allocator>::allocate( slotAlloc, blockSlots() );
+        _ctrl = reinterpret_cast<int8_t*>( _slots + _bucketCount );
+        memset( _ctrl, (uint8_t) ctrlEmpty, _bucketCount + group::width );
+      }
+
+      group_table( const group_table& other ) :
+        group_table( other._bucketCount, std::allocator_traits<allocator_type>::select_on_container_copy_construction( other._allocator ) ) {
+        copyFrom( other );
+      }
+
+      group_table( group_table&& other ) noexcept :
+        _allocator( other._allocator ) {
+        swap( *this, other );
+      }
+
+      group_table& operator=( group_table other ) noexcept {
+        swap( *this, other );
+        return *this;
+      }
+
+      ~group_table() {
+        clear();
+        _store.release( _allocator );
+        if ( _slots != nullptr ) {
+          slot_allocator slotAlloc( _allocator );
+          std::allocator_traits<slot_allocator>::deallocate( slotAlloc, _slots, blockSlots() );
+        }
+      }
+
+      //! Returns the slot index holding the key, or npos.
+      template< typename Key, typename KeyEqual >
+      uint32_t findIndex( const Key& rawKey, size_t hash, const KeyEqual& equal ) const {
+
+        int8_t tag = tagOf( hash );
+        uint32_t position = (uint32_t) ( hash >> 7 ) & _mask;
+        uint32_t step = 0;
+
+        while ( true ) {
+
+          group g( _ctrl + position );
+
+          for ( typename group::mask match = g.match( tag ); match; match.dropLowest() ) {
+            uint32_t index = ( position + match.lowest() ) & _mask;
+            if ( equal( _store.get( _slots[index] )->first, rawKey ) ) {
+              return index;
+            }
+          }
+
+          if ( g.matchEmpty() ) {
+            return npos;
+          }
+
+          step += group::width;
+          position = ( position + step ) & _mask;
+        }
+      }
+
+      //! Returns the element holding the key, or nullptr.
+      template< typename Key, typename KeyEqual >
+      value_type* find( const Key& rawKey, size_t hash, const KeyEqual& equal ) const {
+        uint32_t index = findIndex( rawKey, hash, equal );
+        return index == npos ? nullptr : _store.get( _slots[index] );
+      }
+
+      /*
+      Claims the first empty or deleted slot on the probe sequence of the hash.
+      The key must not be in the table yet. Returns npos when the table is
+      unallocated, or claiming a slot could leave none empty, which probes
+      for missing keys rely on to stop.
+      */
+      uint32_t makeRoom( size_t hash ) {
+
+        if ( _elementCount + _deletedCount + 1 >= _bucketCount ) {
+          return npos;
+        }
+
+        uint32_t index = firstFree( hash );
+        if ( _ctrl[index] == ctrlDeleted ) {
+          _deletedCount--;
+        }
+        setCtrl( index, tagOf( hash ) );
+
+        return index;
+      }
+
+      //! Constructs an element in a slot claimed by makeRoom().
+      template< typename... Args >
+      value_type& constructAt( uint32_t index, Args&&... args ) {
+
+        try {
+          _store.construct( _allocator, _slots[index], std::forward<Args>( args )... );
+        }
+        catch ( ... ) {
+          releaseSlot( index );
+          throw;
+        }
+
+        _elementCount++;
+        return *_store.get( _slots[index] );
+      }
+
+      //! Destroys the element in the given slot.
+      void eraseAt( uint32_t index ) {
+        _store.destroy( _allocator, _slots[index] );
+        _elementCount--;
+        releaseSlot( index );
+      }
+
+      //! Same as eraseAt(), moving the element out into node instead of destroying it.
+      void extractAt( uint32_t index, node_slot& node ) {
+        _store.extract( _allocator, _slots[index], node );
+        _elementCount--;
+        releaseSlot( index );
+      }
+
+      //! Same as constructAt(), moving the element of node in.
+      value_type& adoptAt( uint32_t index, node_slot& node ) {
+
+        try {
+          _store.adopt( _allocator, _slots[index], node );
+        }
+        catch ( ... ) {
+          releaseSlot( index );
+          throw;
+        }
+
+        _elementCount++;
+        return *_store.get( _slots[index] );
+      }
+
+      /*
+      Copies every element and tombstone of other into the same slot of this
+      table, which must be empty and have as many slots. Trivially copyable
+      elements are copied along with the control bytes in a single memcpy.
+      */
+      void copyFrom( const group_table& other ) {
+
+        if ( _slots == nullptr ) {
+          return;
+        }
+
+        if ( storage::trivialCopy ) {
+          _store.copyAll( _allocator, other._store );
+          memcpy( _slots, other._slots, blockBytes() );
+          _elementCount = other._elementCount;
+          _deletedCount = other._deletedCount;
+          return;
+        }
+
+        // Control bytes are copied per element, so a throwing copy leaves clear() only what was constructed.
+        for ( uint32_t i = other.nextOccupied( 0 ); i < _bucketCount; i = other.nextOccupied( i + 1 ) ) {
+          _store.construct( _allocator, _slots[i], *other._store.get( other._slots[i] ) );
+          setCtrl( i, other._ctrl[i] );
+          _elementCount++;
+        }
+
+        memcpy( _ctrl, other._ctrl, _bucketCount + group::width );
+        _deletedCount = other._deletedCount;
+      }
+
+      //! Moves the element in the given slot into target under its hash. Returns its slot in target, or npos, changing nothing, if target is out of room.
+      uint32_t moveTo( group_table& target, uint32_t index, size_t hash ) {
+
+        // Reserving first leaves nothing that can fail once the slot is claimed.
+        target._store.reserve( target._allocator, 1 );
+
+        uint32_t targetIndex = target.makeRoom( hash );
+        if ( targetIndex == npos ) {
+          return npos;
+        }
+
+        target._store.transfer( target._allocator, _store, target._slots[targetIndex], _slots[index] );
+        target._elementCount++;
+        _elementCount--;
+        releaseSlot( index );
+        return targetIndex;
+      }
+
+      //! Erases the key if present. Returns whether anything was erased.
+      template< typename Key, typename KeyEqual >
+      bool erase( const Key& rawKey, size_t hash, const KeyEqual& equal ) {
+
+        uint32_t index = findIndex( rawKey, hash, equal );
+        if ( index == npos ) {
+          return false;
+        }
+
+        eraseAt( index );
+        return true;
+      }
+
+      //! Destroys every element, keeping the storage. Like robin_hood_table::clear(), skips elements needing no destructor.
+      void clear() {
+
+        if ( _bucketCount == 0 ) {
+          return;
+        }
+
+        for ( uint32_t i = 0; !storage::trivialDiscard && _elementCount != 0 && i < _bucketCount; i++ ) {
+          if ( _ctrl[i] >= 0 ) {
+            _store.discard( _allocator, _slots[i] );
+            _elementCount--;
+          }
+        }
+
+        memset( _ctrl, (uint8_t) ctrlEmpty, _bucketCount + group::width );
+        _store.reset();
+        _elementCount = 0;
+        _deletedCount = 0;
+      }
+
+      //! Moves every element into a new table with the given number of slots, dropping all tombstones.
+      template< typename Hasher >
+      void rehash( uint32_t bucketCount, const Hasher& hasher ) {
+
+        group_table resized( bucketCount, _allocator );
+        resized._store.reserve( resized._allocator, _elementCount );
+
+        for ( uint32_t i = 0; i < _bucketCount; i++ ) {
+
+          if ( _ctrl[i] < 0 ) {
+            continue;
+          }
+
+          size_t hash = hasher( _store.get( _slots[i] )->first );
+          uint32_t index = resized.firstFree( hash );
+          resized.setCtrl( index, tagOf( hash ) );
+          resized._store.transfer( resized._allocator, _store, resized._slots[index], _slots[i] );
+          resized._elementCount++;
+        }
+
+        if ( _bucketCount != 0 ) {
+          memset( _ctrl, (uint8_t) ctrlEmpty, _bucketCount + group::width );
+        }
+        _elementCount = 0;
+        _deletedCount = 0;
+        swap( *this, resized );
+      }
+
+      uint32_t size() const {
+        return _elementCount;
+      }
+
+      uint32_t tombstones() const {
+        return _deletedCount;
+      }
+
+      uint32_t bucketCount() const {
+        return _bucketCount;
+      }
+
+      //! Returns the bucket count growing the table should move to.
+      uint32_t grownBucketCount() const {
+        return _bucketCount == 0 ? 8 : _bucketCount * 2;
+      }
+
+      //! The table an incremental rehash drains, this one as a whole.
+      using migration_table = group_table;
+
+      migration_table& migrationTable() {
+        return *this;
+      }
+
+      uint32_t slotCount() const {
+        return _bucketCount;
+      }
+
+      //! Returns the bytes of the table block, the slots along with their control bytes.
+      size_t blockBytes() const {
+        return _slots == nullptr ? 0 : (size_t) blockSlots() * sizeof( slot );
+      }
+
+      //! Returns the bytes held by elements stored outside of the slots.
+      size_t elementBytes() const {
+        return _store.bytes( _elementCount );
+      }
+
+      //! Returns the bytes of empty and deleted slots and of unused element storage.
+      size_t slackBytes() const {
+        return (size_t) ( _bucketCount - _elementCount ) * sizeof( slot ) + _store.slackBytes( _elementCount );
+      }
+
+      //! Counts every element into histogram by the number of groups probed before its own.
+      template< typename Hasher >
+      void probeHistogram( const Hasher& hasher, std::vector<uint32_t>& histogram ) const {
+
+        for ( uint32_t i = nextOccupied( 0 ); i < _bucketCount; i = nextOccupied( i + 1 ) ) {
+          countInto( histogram, probeLength( i, hasher( _store.get( _slots[i] )->first ) ) - 1 );
+        }
+      }
+
+      //! Returns the number of groups a lookup of the given hash inspects to reach the slot index.
+      uint32_t probeLength( uint32_t index, size_t hash ) const {
+
+        uint32_t position = (uint32_t) ( hash >> 7 ) & _mask;
+        uint32_t step = 0;
+        uint32_t probes = 1;
+
+        while ( ( ( index - position ) & _mask ) >= group::width ) {
+          step += group::width;
+          position = ( position + step ) & _mask;
+          probes++;
+        }
+
+        return probes;
+      }
+
+      //! Returns the most elements sharing a single home bucket, counting in a temporary byte per bucket that saturates at 255.
+      template< typename Hasher >
+      uint32_t maxHomeDensity( const Hasher& hasher ) const {
+
+        if ( _elementCount == 0 ) {
+          return 0;
+        }
+
+        std::unique_ptr<uint8_t[]> counts( new uint8_t[_bucketCount]() );
+        uint32_t densest = 0;
+
+        for ( uint32_t i = nextOccupied( 0 ); i < _bucketCount; i = nextOccupied( i + 1 ) ) {
+
+          uint32_t home = (uint32_t) ( hasher( _store.get( _slots[i] )->first ) >> 7 ) & _mask;
+          if ( counts[home] < 255 ) {
+            counts[home]++;
+          }
+
+          if ( counts[home] > densest ) {
+            densest = counts[home];
+          }
+        }
+
+        return densest;
+      }
+
+      //! Returns the slot the probe of a hash starts at.
+      uint32_t homeBucket( size_t hash ) const {
+        return (uint32_t) ( hash >> 7 ) & _mask;
+      }
+
+      void reserveElements( uint32_t extra ) {
+        _store.reserve( _allocator, extra );
+      }
+
+      //! Starts loading the control bytes and slots of the first group probed for a hash.
+      void prefetch( size_t hash ) const {
+        uint32_t position = (uint32_t) ( hash >> 7 ) & _mask;
+        rstd_support::prefetch( _ctrl + position );
+        if ( _slots != nullptr ) {
+          rstd_support::prefetch( _slots + position );
+        }
+      }
+
+      //! Returns the number of elements whose probe sequence starts where the one of hash does.
+      template< typename Hasher >
+      uint32_t homeDensity( size_t hash, const Hasher& hasher ) const {
+
+        if ( _bucketCount == 0 ) {
+          return 0;
+        }
+
+        uint32_t home = (uint32_t) ( hash >> 7 ) & _mask;
+        uint32_t position = home;
+        uint32_t step = 0;
+        uint32_t counter = 0;
+
+        // Such elements can only sit on the probe sequence up to its first group with an empty slot.
+        while ( true ) {
+
+          for ( uint32_t i = 0; i < group::width; i++ ) {
+            uint32_t index = ( position + i ) & _mask;
+            if ( _ctrl[index] >= 0 && ( (uint32_t) ( hasher( _store.get( _slots[index] )->first ) >> 7 ) & _mask ) == home ) {
+              counter++;
+            }
+          }
+
+          if ( group( _ctrl + position ).matchEmpty() || step >= _bucketCount ) {
+            return counter;
+          }
+
+          step += group::width;
+          position = ( position + step ) & _mask;
+        }
+      }
+
+      //! Checks whether the given slot holds an element.
+      bool occupied( uint32_t index ) const {
+        return _ctrl[index] >= 0;
+      }
+
+      //! Returns the first occupied slot at or after index, or slotCount() if there is none.
+      uint32_t nextOccupied( uint32_t index ) const {
+
+        // Skip stretches of empty and deleted slots eight control bytes at a time.
+        uint64_t word;
+        while ( index + 8 <= _bucketCount ) {
+          memcpy( &word, _ctrl + index, 8 );
+          if ( ( word & 0x8080808080808080ull ) != 0x8080808080808080ull ) {
+            break;
+          }
+          index += 8;
+        }
+
+        while ( index < _bucketCount && _ctrl[index] < 0 ) {
+          index++;
+        }
+
+        return index < _bucketCount ? index : _bucketCount;
+      }
+
+      value_type& slotValue( uint32_t index ) const {
+        return *_store.get( _slots[index] );
+      }
+
+      allocator_type get_allocator() const {
+        return _allocator;
+      }
+
+    private:
+
+      //! Shared control bytes of unallocated tables, a single empty group.
+      static int8_t* emptyCtrl() {
+
+        static struct empty_group
+        {
+          int8_t bytes[group::width];
+
+          empty_group() {
+            memset( bytes, (uint8_t) ctrlEmpty, sizeof( bytes ) );
+          }
+        } empty;
+
+        return empty.bytes;
+      }
+
+      //! The 7 bit tag stored in the control byte of a full slot.
+      static int8_t tagOf( size_t hash ) {
+        return (int8_t) ( hash & 0x7F );
+      }
+
+      //! The size of the table block in slots, enough to also hold _ctrl and its clones.
+      uint32_t blockSlots() const {
+        return _bucketCount + ( _bucketCount + group::width + sizeof( slot ) - 1 ) / (uint32_t) sizeof( slot );
+      }
+
+      //! Sets a control byte, keeping the clone past the end in sync.
+      void setCtrl( uint32_t index, int8_t value ) {
+        _ctrl[index] = value;
+        if ( index < group::width ) {
+          _ctrl[_bucketCount + index] = value;
+        }
+      }
+
+      //! Returns the first empty or deleted slot on the probe sequence of the hash. One must exist.
+      uint32_t firstFree( size_t hash ) const {
+
+        uint32_t position = (uint32_t) ( hash >> 7 ) & _mask;
+        uint32_t step = 0;
+
+        while ( true ) {
+
+          typename group::mask free = group( _ctrl + position ).matchEmptyOrDeleted();
+          if ( free ) {
+            return ( position + free.lowest() ) & _mask;
+          }
+
+          step += group::width;
+          position = ( position + step ) & _mask;
+        }
+      }
+
+      /*
+      Marks a slot as free again. It can go back to empty if no window of
+      group::width full slots covers it, since no probe can then have passed
+      over it; otherwise it becomes a tombstone.
+      */
+      void releaseSlot( uint32_t index ) {
+
+        typename group::mask emptyBefore = group( _ctrl + ( ( index - group::width ) & _mask ) ).matchEmpty();
+        typename group::mask emptyAfter = group( _ctrl + index ).matchEmpty();
+
+        if ( emptyBefore && emptyAfter && emptyBefore.leadingClear() + emptyAfter.trailingClear() < group::width ) {
+          setCtrl( index, ctrlEmpty );
+        }
+        else {
+          setCtrl( index, ctrlDeleted );
+          _deletedCount++;
+        }
+      }
+
+    };
+
+    /*
+    Forward iterator over the elements of a hash_map, walking the table in
+    memory order. Erasing or inserting invalidates every iterator.
+    */
+    template< typename Map, bool IsConst >
+    class hash_map_iterator final
+    {
+
+    public:
+
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = typename Map::value_type;
+      using difference_type = std::ptrdiff_t;
+      using pointer = typename std::conditional<IsConst, const value_type*, value_type*>::type;
+      using reference = typename std::conditional<IsConst, const value_type&, value_type&>::type;
+
+    private:
+
+      friend Map;
+      friend class hash_map_iterator<Map, !IsConst>;
+
+      //! The map being walked.
+      const Map* _map = nullptr;
+
+      //! Position of the current element, as defined by the map.
+      uint32_t _position = 0;
+
+      hash_map_iterator( const Map* map, uint32_t position ) :
+        _map( map ),
+        _position( position ) {}
+
+    public:
+
+      hash_map_iterator() = default;
+
+      //! Mutable iterators convert to const ones.
+      template< bool OtherConst, typename = typename std::enable_if<IsConst && !OtherConst>::type >
+      hash_map_iterator( const hash_map_iterator<Map, OtherConst>& other ) :
+        _map( other._map ),
+        _position( other._position ) {}
+
+      reference operator*() const {
+        return _map->valueAt( _position );
+      }
+
+      pointer operator->() const {
+        return &( _map->valueAt( _position ) );
+      }
+
+      hash_map_iterator& operator++() {
+        _position = _map->nextPosition( _position + 1 );
+        return *this;
+      }
+
+      hash_map_iterator operator++( int ) {
+        hash_map_iterator previous = *this;
+        ++( *this );
+        return previous;
+      }
+
+      template< bool OtherConst >
+      bool operator==( const hash_map_iterator<Map, OtherConst>& other ) const {
+        return _position == other._position;
+      }
+
+      template< bool OtherConst >
+      bool operator!=( const hash_map_iterator<Map, OtherConst>& other ) const {
+        return _position != other._position;
+      }
+
+    };
+
+    /*
+    The table of small_engine. The first N slot indices are a buffer of
+    elements inside the table object, filled from the front and scanned
+    linearly; the rest are those of the wrapped table, shifted by N. While
+    the wrapped table is unallocated, the buffer holds every element and
+    bucketCount() reports the bucket count the wrapped table will be
+    allocated with once the buffer overflows. From then on the buffer stays
+    empty and every call goes to the wrapped table.
+    */
+    template< typename Table, uint32_t N >
+    class small_table final
+    {
+
+    public:
+
+      using value_type = typename Table::value_type;
+      using allocator_type = typename Table::allocator_type;
+      using node_storage = typename Table::node_storage;
+      using node_slot = typename Table::node_slot;
+
+      static_assert( N > 0 && N < 0x10000, "small_engine holds between 1 and 65535 elements inline" );
+
+    private:
+
+      using buffer = element_storage<inline_storage, value_type>;
+      using slot = typename buffer::slot;
+
+    public:
+
+      static constexpr uint32_t npos = Table::npos;
+
+    private:
+
+      //! The table the elements spill into. Unallocated while they fit the buffer.
+      Table _table;
+
+      //! The bucket count _table is allocated with on spilling, 0 for an unallocated table.
+      uint32_t _spillBuckets = 0;
+
+      //! The number of elements in the buffer, which fill its first slots.
+      uint32_t _inlineCount = 0;
+
+      slot _inline[N];
+
+    public:
+
+      friend void swap( small_table& table1, small_table& table2 ) noexcept {
+
+        using std::swap;
+        swap( table1._table, table2._table );
+        swap( table1._spillBuckets, table2._spillBuckets );
+
+        small_table& fuller = table1._inlineCount >= table2._inlineCount ? table1 : table2;
+        small_table& emptier = table1._inlineCount >= table2._inlineCount ? table2 : table1;
+
+        for ( uint32_t i = 0; i < emptier._inlineCount; i++ ) {
+          slot temp;
+          buffer::relocate( temp, emptier._inline[i] );
+          buffer::relocate( emptier._inline[i], fuller._inline[i] );
+          buffer::relocate( fuller._inline[i], temp );
+        }
+
+        for ( uint32_t i = emptier._inlineCount; i < fuller._inlineCount; i++ ) {
+          buffer::relocate( emptier._inline[i], fuller._inline[i] );
+        }
+
+        swap( table1._inlineCount, table2._inlineCount );
+      }
+
+      explicit small_table( const allocator_type& alloc = allocator_type() ) :
+        _table( alloc ) {}
+
+      //! Allocates nothing yet; bucketCount is what the wrapped table gets on spilling.
+      small_table( uint32_t bucketCount, const allocator_type& alloc ) :
+        _table( alloc ),
+        _spillBuckets( bucketCount == 0 ? 0 : spillFloor( bucketCount ) ) {}
+
+      small_table( const small_table& other ) :
+        _table( std::allocator_traits<allocator_type>::select_on_container_copy_construction( other._table.get_allocator() ) ) {
+        copyFrom( other );
+      }
+
+      small_table( small_table&& other ) noexcept :
+        _table( other._table.get_allocator() ) {
+        swap( *this, other );
+      }
+
+      small_table& operator=( small_table other ) noexcept {
+        swap( *this, other );
+        return *this;
+      }
+
+      ~small_table() {
+        clearBuffer();
+      }
+
+      template< typename Key, typename KeyEqual >
+      uint32_t findIndex( const Key& rawKey, size_t hash, const KeyEqual& equal ) const {
+
+        if ( spilled() ) {
+          uint32_t index = _table.findIndex( rawKey, hash, equal );
+          return index == npos ? npos : index + N;
+        }
+
+        for ( uint32_t i = 0; i < _inlineCount; i++ ) {
+          if ( equal( inlineValue( i ).first, rawKey ) ) {
+            return i;
+          }
+        }
+
+        return npos;
+      }
+
+      template< typename Key, typename KeyEqual >
+      value_type* find( const Key& rawKey, size_t hash, const KeyEqual& equal ) const {
+        uint32_t index = findIndex( rawKey, hash, equal );
+        return index == npos ? nullptr : &( slotValue( index ) );
+      }
+
+      //! Returns the next buffer slot, or npos once the buffer is full and the table has to spill.
+      uint32_t makeRoom( size_t hash ) {
+
+        if ( spilled() ) {
+          uint32_t index = _table.makeRoom( hash );
+          return index == npos ? npos : index + N;
+        }
+
+        return _inlineCount < N ? _inlineCount : npos;
+      }
+
+      template< typename... Args >
+      value_type& constructAt( uint32_t index, Args&&... args ) {
+
+        if ( index >= N ) {
+          return _table.constructAt( index - N, std::forward<Args>( args )... );
+        }
+
+        buffer::construct( _table, _inline[index], std::forward<Args>( args )... );
+        _inlineCount++;
+        return inlineValue( index );
+      }
+
+      //! Erasing from the buffer moves its last element into the hole, which an iterator at index then visits next.
+      void eraseAt( uint32_t index ) {
+
+        if ( index >= N ) {
+          _table.eraseAt( index - N );
+          return;
+        }
+
+        buffer::destroy( _table, _inline[index] );
+        _inlineCount--;
+        if ( index != _inlineCount ) {
+          buffer::relocate( _inline[index], _inline[_inlineCount] );
+        }
+      }
+
+      //! A boxed node of a buffer element is allocated here, as the buffer holds no allocations to hand over.
+      void extractAt( uint32_t index, node_slot& node ) {
+
+        if ( index >= N ) {
+          _table.extractAt( index - N, node );
+          return;
+        }
+
+        allocator_type alloc = _table.get_allocator();
+        value_type& entry = inlineValue( index );
+        node_storage::construct( alloc, node, std::move( const_cast<typename value_type::first_type&>( entry.first ) ), std::move( entry.second ) );
+        eraseAt( index );
+      }
+
+      value_type& adoptAt( uint32_t index, node_slot& node ) {
+
+        if ( index >= N ) {
+          return _table.adoptAt( index - N, node );
+        }
+
+        allocator_type alloc = _table.get_allocator();
+        value_type* entry = node_storage::get( node );
+        buffer::construct( _table, _inline[index], std::move( const_cast<typename value_type::first_type&>( entry->first ) ), std::move( entry->second ) );
+        node_storage::destroy( alloc, node );
+        _inlineCount++;
+        return inlineValue( index );
+      }
+
+      uint32_t moveTo( small_table& target, uint32_t index, size_t hash ) {
+
+        if ( index >= N && target.spilled() ) {
+          uint32_t targetIndex = _table.moveTo( target._table, index - N, hash );
+          return targetIndex == npos ? npos : targetIndex + N;
+        }
+
+        uint32_t targetIndex = target.makeRoom( hash );
+        if ( targetIndex == npos ) {
+          return npos;
+        }
+
+        value_type& entry = slotValue( index );
+        target.constructAt( targetIndex, std::move( const_cast<typename value_type::first_type&>( entry.first ) ), std::move( entry.second ) );
+        eraseAt( index );
+        return targetIndex;
+      }
+
+      template< typename Key, typename KeyEqual >
+      bool erase( const Key& rawKey, size_t hash, const KeyEqual& equal ) {
+
+        uint32_t index = findIndex( rawKey, hash, equal );
+        if ( index == npos ) {
+          return false;
+        }
+
+        eraseAt( index );
+        return true;
+      }
+
+      //! Copies every element of other, which has as many buckets, into the same slots. Spills or unspills to match it.
+      void copyFrom( const small_table& other ) {
+
+        _spillBuckets = other._spillBuckets;
+
+        if ( other.spilled() ) {
+          if ( !spilled() ) {
+            _table = Table( other._table.bucketCount(), _table.get_allocator() );
+          }
+          _table.copyFrom( other._table );
+          return;
+        }
+
+        if ( spilled() ) {
+          _table = Table( _table.get_allocator() );
+        }
+
+        for ( uint32_t i = 0; i < other._inlineCount; i++ ) {
+          buffer::construct( _table, _inline[i], other.inlineValue( i ) );
+          _inlineCount++;
+        }
+      }
+
+      //! Destroys every element. A spilled table stays spilled, keeping its storage.
+      void clear() {
+        clearBuffer();
+        _table.clear();
+      }
+
+      /*
+      While the buffer has room left, only changes the bucket count the
+      table spills with. Otherwise spills the buffer into a table with the
+      given number of buckets, or rehashes the spilled table.
+      */
+      template< typename Hasher >
+      void rehash( uint32_t bucketCount, const Hasher& hasher ) {
+
+        if ( spilled() ) {
+          _table.rehash( bucketCount, hasher );
+          return;
+        }
+
+        bucketCount = spillFloor( bucketCount );
+        if ( _inlineCount < N ) {
+          _spillBuckets = bucketCount;
+          return;
+        }
+
+        Table spill( bucketCount, _table.get_allocator() );
+        spill.reserveElements( _inlineCount );
+
+        for ( uint32_t i = 0; i < _inlineCount; i++ ) {
+
+          value_type& entry = inlineValue( i );
+          size_t hash = hasher( entry.first );
+
+          uint32_t index;
+          while ( ( index = spill.makeRoom( hash ) ) == npos ) {
+            spill.rehash( spill.grownBucketCount(), hasher );
+          }
+          spill.constructAt( index, std::move( const_cast<typename value_type::first_type&>( entry.first ) ), std::move( entry.second ) );
+        }
+
+        clearBuffer();
+        _table = std::move( spill );
+        _spillBuckets = 0;
+      }
+
+      uint32_t size() const {
+        return _inlineCount + _table.size();
+      }
+
+      uint32_t tombstones() const {
+        return _table.tombstones();
+      }
+
+      uint32_t bucketCount() const {
+        return spilled() ? _table.bucketCount() : _spillBuckets;
+      }
+
+      //! The buffer spills into the bucket count it was given.
+      uint32_t grownBucketCount() const {
+        return spilled() ? _table.grownBucketCount() : spillFloor( _spillBuckets );
+      }
+
+      //! Only a spilled table has a block to rehash incrementally, and its buffer is empty, so a rehash drains the wrapped table alone.
+      using migration_table = Table;
+
+      migration_table& migrationTable() {
+        return _table;
+      }
+
+      uint32_t slotCount() const {
+        return N + _table.slotCount();
+      }
+
+      //! The buffer is part of the table object, so only the wrapped table has a block.
+      size_t blockBytes() const {
+        return _table.blockBytes();
+      }
+
+      size_t elementBytes() const {
+        return _table.elementBytes();
+      }
+
+      size_t slackBytes() const {
+        return _table.slackBytes();
+      }
+
+      //! A lookup in the buffer scans it from the front, so element i takes i + 1 probes.
+      template< typename Hasher >
+      void probeHistogram( const Hasher& hasher, std::vector<uint32_t>& histogram ) const {
+        for ( uint32_t i = 0; i < _inlineCount; i++ ) {
+          countInto( histogram, i );
+        }
+        _table.probeHistogram( hasher, histogram );
+      }
+
+      uint32_t probeLength( uint32_t index, size_t hash ) const {
+        return index < N ? index + 1 : _table.probeLength( index - N, hash );
+      }
+
+      //! Every element of the buffer is on the same linear scan, as if they shared one bucket.
+      template< typename Hasher >
+      uint32_t maxHomeDensity( const Hasher& hasher ) const {
+        return spilled() ? _table.maxHomeDensity( hasher ) : _inlineCount;
+      }
+
+      void prefetch( size_t hash ) const {
+        if ( spilled() ) {
+          _table.prefetch( hash );
+        }
+        else {
+          rstd_support::prefetch( _inline );
+        }
+      }
+
+      template< typename Hasher >
+      uint32_t homeDensity( size_t hash, const Hasher& hasher ) const {
+        return spilled() ? _table.homeDensity( hash, hasher ) : _inlineCount;
+      }
+
+      uint32_t homeBucket( size_t hash ) const {
+        if ( spilled() ) {
+          return _table.homeBucket( hash );
+        }
+        return _spillBuckets == 0 ? 0 : (uint32_t) ( hash & ( _spillBuckets - 1 ) );
+      }
+
+      void reserveElements( uint32_t extra ) {
+        if ( spilled() ) {
+          _table.reserveElements( extra );
+        }
+      }
+
+      bool occupied( uint32_t index ) const {
+        return index < N ? index < _inlineCount : _table.occupied( index - N );
+      }
+
+      uint32_t nextOccupied( uint32_t index ) const {
+        if ( index < _inlineCount ) {
+          return index;
+        }
+        return N + _table.nextOccupied( index < N ? 0 : index - N );
+      }
+
+      value_type& slotValue( uint32_t index ) const {
+        return index < N ? inlineValue( index ) : _table.slotValue( index - N );
+      }
+
+      allocator_type get_allocator() const {
+        return _table.get_allocator();
+      }
+
+    private:
+
+      bool spilled() const {
+        return _table.bucketCount() != 0;
+      }
+
+      //! Raises a bucket count to the smallest one the wrapped table holds N + 1 elements in.
+      static uint32_t spillFloor( uint32_t bucketCount ) {
+        uint32_t floor = 8;
+        while ( floor < 2 * N ) {
+          floor <<= 1;
+        }
+        return bucketCount < floor ? floor : bucketCount;
+      }
+
+      value_type& inlineValue( uint32_t index ) const {
+        return *buffer::get( const_cast<slot&>( _inline[index] ) );
+      }
+
+      void clearBuffer() {
+        for ( uint32_t i = 0; i < _inlineCount; i++ ) {
+          buffer::destroy( _table, _inline[i] );
+        }
+        _inlineCount = 0;
+      }
+    };
+
+    //! Maps an engine tag of the policy onto its table.
+    template< typename Engine, typename K, typename T, typename Storage, typename Allocator >
+    struct engine_table;
+
+    template< typename K, typename T, typename Storage, typename Allocator >
+    struct engine_table<robin_hood_engine, K, T, Storage, Allocator>
+    {
+      using type = robin_hood_table<K, T, Storage, Allocator>;
+    };
+
+    template< typename K, typename T, typename Storage, typename Allocator >
+    struct engine_table<group_engine, K, T, Storage, Allocator>
+    {
+      using type = group_table<K, T, Storage, Allocator>;
+    };
+
+    template< uint32_t N, typename Engine, typename K, typename T, typename Storage, typename Allocator >
+    struct engine_table<small_engine<N, Engine>, K, T, Storage, Allocator>
+    {
+      using type = small_table<typename engine_table<Engine, K, T, Storage, Allocator>::type, N>;
+    };
+
+    /*
+    Leads the image hash_map::save() writes. Offsets are from the start of the
+    file, so the image works wherever it is mapped. The slots are those of a
+    robin_hood_table with inline elements, including the overflow tail, with
+    empty slots zeroed. The info bytes follow them, sentinel included.
+    */
+    struct snapshot_header
+    {
+      char magic[8];
+      uint32_t version;
+
+      //! snapshotByteOrder as written, to tell images of the other endianness apart.
+      uint32_t byteOrder;
+
+      //! sizeof and alignof of the value_type stored in each slot, and sizeof of its key and value.
+      uint32_t elementBytes;
+      uint32_t elementAlign;
+      uint32_t keyBytes;
+      uint32_t mappedBytes;
+
+      uint32_t bucketCount;
+      uint32_t slotCount;
+      uint32_t elementCount;
+      uint32_t maxDistance;
+
+      uint64_t slotsOffset;
+      uint64_t infoOffset;
+      uint64_t fileBytes;
+    };
+
+    constexpr char snapshotMagic[8] = { 'R', 'S', 'T', 'D', 'H', 'M', 'A', 'P' };
+    constexpr uint32_t snapshotVersion = 1;
+    constexpr uint32_t snapshotByteOrder = 0x01020304;
+
+    //! Where the slots start. A multiple of the cache line, so mapped slots are aligned for any element.
+    constexpr uint64_t snapshotSlotsOffset = 128;
+
+    static_assert( sizeof( snapshot_header ) <= snapshotSlotsOffset, "snapshot_header must fit in front of the slots" );
+
+    //! Writes the image of a robin_hood_table with inline elements to path. Throws std::runtime_error on failure.
+    template< typename Table >
+    void writeSnapshot( const std::string& path, const Table& table ) {
+
+      using value_type = typename Table::value_type;
+
+      if ( table.stashed() != 0 ) {
+        throw std::runtime_error( "rstd::hash_map::save: too many keys share a hash for the image format" );
+      }
+
+      snapshot_header header = {};
+      memcpy( header.magic, snapshotMagic, sizeof( snapshotMagic ) );
+      header.version = snapshotVersion;
+      header.byteOrder = snapshotByteOrder;
+      header.elementBytes = sizeof( value_type );
+      header.elementAlign = alignof( value_type );
+      header.keyBytes = sizeof( typename value_type::first_type );
+      header.mappedBytes = sizeof( typename value_type::second_type );
+      header.bucketCount = table.bucketCount();
+      header.slotCount = table.slotCount();
+      header.elementCount = table.size();
+      header.maxDistance = Table::maxDistance;
+      header.slotsOffset = snapshotSlotsOffset;
+      header.infoOffset = header.slotsOffset + (uint64_t) header.slotCount * sizeof( value_type );
+      header.fileBytes = header.infoOffset + header.slotCount + 1;
+
+      std::FILE* file = std::fopen( path.c_str(), "wb" );
+      if ( file == nullptr ) {
+        throw std::runtime_error( "rstd::hash_map::save: cannot open " + path );
+      }
+
+      unsigned char padding[snapshotSlotsOffset] = {};
+      size_t paddingBytes = snapshotSlotsOffset - sizeof( header );
+      bool written = std::fwrite( &header, sizeof( header ), 1, file ) == 1;
+      written = written && std::fwrite( padding, 1, paddingBytes, file ) == paddingBytes;
+
+      // Copied through a buffer a chunk at a time, so empty slots go out as zeroes instead of stale bytes.
+      constexpr uint32_t chunkSlots = 256;
+      std::vector<unsigned char> chunk( (size_t) chunkSlots * sizeof( value_type ) );
+      const unsigned char* slots = static_cast<const unsigned char*>( table.slotData() );
+      const uint8_t* info = table.infoData();
+
+      for ( uint32_t start = 0; written && start < header.slotCount; start += chunkSlots ) {
+
+        uint32_t count = header.slotCount - start < chunkSlots ? header.slotCount - start : chunkSlots;
+        memset( chunk.data(), 0, chunk.size() );
+
+        for ( uint32_t i = 0; i < count; i++ ) {
+          if ( info[start + i] != 0 ) {
+            memcpy( chunk.data() + (size_t) i * sizeof( value_type ), slots + (size_t) ( start + i ) * sizeof( value_type ), sizeof( value_type ) );
+          }
+        }
+
+        written = std::fwrite( chunk.data(), sizeof( value_type ), count, file ) == count;
+      }
+
+      written = written && std::fwrite( info, 1, header.slotCount + 1, file ) == header.slotCount + 1;
+      written = std::fclose( file ) == 0 && written;
+
+      if ( !written ) {
+        throw std::runtime_error( "rstd::hash_map::save: cannot write " + path );
+      }
+    }
+  }
+
+  using namespace rstd_support;
+
+  /*
+  The bytes held by a hash_map, as returned by hash_map::memory_usage().
+  Allocator bookkeeping is not known to the map and not counted, such as the
+  header malloc puts in front of every element under boxed_storage.
+  */
+  struct hash_map_memory_usage
+  {
+    //! The map object itself.
+    size_t object = 0;
+
+    //! The table block: every slot, occupied or not, and its info or control byte.
+    size_t table = 0;
+
+    //! Elements stored outside of the slots, by boxed_storage and compact_storage.
+    size_t elements = 0;
+
+    //! The part of table and elements holding no element: empty slots and unused cells.
+    size_t slack = 0;
+
+    size_t total() const {
+      return object + table + elements;
+    }
+  };
+
+  /*
+  A snapshot of the layout of a hash_map, as returned by hash_map::stats().
+  Probe lengths count what a successful lookup of each element inspects,
+  including the first probe: slots under robin_hood_engine, groups of slots
+  under group_engine.
+  */
+  struct hash_map_stats
+  {
+    uint32_t elements = 0;
+    uint32_t buckets = 0;
+
+    //! Slots holding neither an element nor a tombstone.
+    uint32_t emptySlots = 0;
+
+    //! Slots freed by erasing that probes still pass over. Always 0 under robin_hood_engine.
+    uint32_t tombstones = 0;
+
+    //! Elements erased by key or iterator since the map was constructed.
+    uint64_t erases = 0;
+
+    //! probeHistogram[i] is the number of elements with a probe length of i + 1.
+    std::vector<uint32_t> probeHistogram;
+
+    double meanProbeLength = 0.0;
+    uint32_t maxProbeLength = 0;
+  };
+
+  //! Hot path event counts of a hash_map with atomic_counters, as returned by hash_map::counters().
+  struct hash_map_counters
+  {
+    //! Lookups that found their key.
+    uint64_t hits = 0;
+
+    //! Lookups that did not, whether they went on to insert or not.
+    uint64_t misses = 0;
+
+    uint64_t inserts = 0;
+    uint64_t erases = 0;
+    uint64_t clears = 0;
+
+    //! Table blocks allocated by growing or rehashing, plus elements allocated under boxed_storage.
+    uint64_t allocations = 0;
+
+    //! Probes inspected by lookups that hit and by inserts, in the units of hash_map_stats.
+    uint64_t probes = 0;
+
+    //! Rebuilds of the table, growing or not.
+    uint64_t rehashes = 0;
+  };
+
+  namespace rstd_support
+  {
+    //! Counts the hot path events of a map, selected by the counters policy.
+    template< typename Counters >
+    struct event_counters;
+
+    template<>
+    struct event_counters<no_counters> final
+    {
+      //! Lets the map skip work done only to feed a counter.
+      static constexpr bool enabled = false;
+
+      void hit( uint32_t ) {}
+      void miss() {}
+      void insert( uint32_t ) {}
+      void erase() {}
+      void clear() {}
+      void allocate() {}
+      void rehash() {}
+
+      hash_map_counters snapshot() const {
+        return hash_map_counters();
+      }
+
+      void reset() {}
+    };
+
+    /*
+    Relaxed atomics, so another thread may read or reset them while the owner
+    of the map updates them; the hot path only pays an uncontended add. They
+    belong to the map object: copying, moving and swapping maps leave them be.
+    */
+    template<>
+    struct event_counters<atomic_counters> final
+    {
+      static constexpr bool enabled = true;
+
+      std::atomic<uint64_t> hits{ 0 };
+      std::atomic<uint64_t> misses{ 0 };
+      std::atomic<uint64_t> inserts{ 0 };
+      std::atomic<uint64_t> erases{ 0 };
+      std::atomic<uint64_t> clears{ 0 };
+      std::atomic<uint64_t> allocations{ 0 };
+      std::atomic<uint64_t> probes{ 0 };
+      std::atomic<uint64_t> rehashes{ 0 };
+
+      void hit( uint32_t probeLength ) {
+        hits.fetch_add( 1, std::memory_order_relaxed );
+        probes.fetch_add( probeLength, std::memory_order_relaxed );
+      }
+
+      void miss() {
+        misses.fetch_add( 1, std::memory_order_relaxed );
+      }
+
+      void insert( uint32_t probeLength ) {
+        inserts.fetch_add( 1, std::memory_order_relaxed );
+        probes.fetch_add( probeLength, std::memory_order_relaxed );
+      }
+
+      void erase() {
+        erases.fetch_add( 1, std::memory_order_relaxed );
+      }
+
+      void clear() {
+        clears.fetch_add( 1, std::memory_order_relaxed );
+      }
+
+      void allocate() {
+        allocations.fetch_add( 1, std::memory_order_relaxed );
+      }
+
+      void rehash() {
+        rehashes.fetch_add( 1, std::memory_order_relaxed );
+      }
+
+      hash_map_counters snapshot() const {
+        hash_map_counters counts;
+        counts.hits = hits.load( std::memory_order_relaxed );
+        counts.misses = misses.load( std::memory_order_relaxed );
+        counts.inserts = inserts.load( std::memory_order_relaxed );
+        counts.erases = erases.load( std::memory_order_relaxed );
+        counts.clears = clears.load( std::memory_order_relaxed );
+        counts.allocations = allocations.load( std::memory_order_relaxed );
+        counts.probes = probes.load( std::memory_order_relaxed );
+        counts.rehashes = rehashes.load( std::memory_order_relaxed );
+        return counts;
+      }
+
+      void reset() {
+        for ( std::atomic<uint64_t>* counter : { &hits, &misses, &inserts, &erases, &clears, &allocations, &probes, &rehashes } ) {
+          counter->store( 0, std::memory_order_relaxed );
+        }
+      }
+    };
+  }
+
+  template< typename K, typename T, typename Hash, typename KeyEqual, typename Allocator, typename Policy >
+  class hash_map;
+
+  template< typename K, typename T, typename Hash, typename KeyEqual, typename Allocator, typename Policy >
+  class lru_hash_map;
+
+  /*
+  An element extracted from a hash_map by extract(), owning it until it is
+  inserted into a map of the same type, or destroyed along with the node.
+  Under boxed_storage the node takes over the allocation of the element, so
+  moving an element between maps with equal allocators allocates nothing and
+  never touches the value. Otherwise the element is moved into the node and
+  back out of it, which never allocates either.
+  */
+  template< typename V, typename Allocator, typename Storage >
+  class hash_map_node final
+  {
+
+  public:
+
+    using key_type = typename std::remove_const<typename V::first_type>::type;
+    using mapped_type = typename V::second_type;
+    using allocator_type = Allocator;
+
+  private:
+
+    using storage = rstd_support::node_storage<Storage, V>;
+
+    template< typename keytype, typename valtype, typename hashtype, typename equaltype, typename alloctype, typename policytype >
+    friend class hash_map;
+
+    typename storage::slot _slot;
+
+    //! The allocator of the map the element came from. Engaged exactly while the node holds an element.
+    std::optional<Allocator> _allocator;
+
+  public:
+
+    friend void swap( hash_map_node& node1, hash_map_node& node2 ) {
+      hash_map_node temp( std::move( node1 ) );
+      node1 = std::move( node2 );
+      node2 = std::move( temp );
+    }
+
+    //! An empty node.
+    hash_map_node() = default;
+
+    hash_map_node( const hash_map_node& other ) = delete;
+    hash_map_node& operator=( const hash_map_node& other ) = delete;
+
+    //! Under boxed_storage, only the pointer to the element moves.
+    hash_map_node( hash_map_node&& other ) {
+      take( other );
+    }
+
+    hash_map_node& operator=( hash_map_node&& other ) {
+      if ( &other != this ) {
+        reset();
+        take( other );
+      }
+      return *this;
+    }
+
+    ~hash_map_node() {
+      reset();
+    }
+
+    //! Checks whether the node holds no element.
+    bool empty() const {
+      return !_allocator.has_value();
+    }
+
+    explicit operator bool() const {
+      return !empty();
+    }
+
+    //! The key of the element, which may be changed before inserting it. The node must not be empty.
+    key_type& key() const {
+      return const_cast<key_type&>( element().first );
+    }
+
+    //! The value of the element. The node must not be empty.
+    mapped_type& mapped() const {
+      return element().second;
+    }
+
+    //! The allocator of the map the element came from. The node must not be empty.
+    allocator_type get_allocator() const {
+      return *_allocator;
+    }
+
+  private:
+
+    V& element() const {
+      return *storage::get( const_cast<typename storage::slot&>( _slot ) );
+    }
+
+    //! Destroys the element, if there is one.
+    void reset() {
+      if ( _allocator ) {
+        storage::destroy( *_allocator, _slot );
+        _allocator.reset();
+      }
+    }
+
+    //! Moves the element of other, if there is one, into this empty node, leaving other empty.
+    void take( hash_map_node& other ) {
+      if ( other._allocator ) {
+        storage::relocate( _slot, other._slot );
+        _allocator = std::move( other._allocator );
+        other._allocator.reset();
+      }
+    }
+
+  };
+
+  //! What inserting a node returns: the value stored at its key, whether it was inserted, and the node if it was not.
+  template< typename T, typename Node >
+  struct hash_map_insert_return
+  {
+    T* position;
+    bool inserted;
+    Node node;
+  };
+
+  /*
+  Hash must return a size_t whose low bits carry the entropy of the key, since
+  the table reduces hashes with a power-of-two mask. Identity hashes such as
+  std::hash on integers do not qualify; rstd::hash does.
+
+  When both Hash and KeyEqual are transparent, find(), contains(), count(),
+  at(), erase() and find_hashed() also take any key type they accept, such as
+  a std::string_view into a map of std::string keys with std::equal_to<>,
+  without building a key_type first.
+  */
+  template< typename K, typename T, typename Hash = hash<K>, typename KeyEqual = std::equal_to<K>, typename Allocator = std::allocator<std::pair<const K, T>>, typename Policy = default_hash_map_policy >
+  class hash_map
+  {
+
+  private:
+
+    using table_type = typename engine_table<typename Policy::engine, K, T, typename Policy::storage, Allocator>::type;
+    using old_table_type = typename table_type::migration_table;
+    using counters_type = event_counters<typename Policy::counters>;
+
+  public:
+
+    using key_type = K;
+    using mapped_type = T;
+    using value_type = typename table_type::value_type;
+    using allocator_type = typename table_type::allocator_type;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+    using iterator = hash_map_iterator<hash_map, false>;
+    using const_iterator = hash_map_iterator<hash_map, true>;
+    using node_type = hash_map_node<value_type, allocator_type, typename Policy::storage>;
+    using insert_return_type = hash_map_insert_return<T, node_type>;
+
+  private:
+
+    //! Enables the lookups taking a Key other than K. Iterators are left to erase( const_iterator ).
+    template< typename Key >
+    using transparent_key = typename std::enable_if<rstd_support::is_transparent<Hash>::value && rstd_support::is_transparent<KeyEqual>::value
+      && !std::is_convertible<const Key&, const_iterator>::value>::type;
+
+    friend iterator;
+    friend const_iterator;
+
+    //! Sweeps its clock hand over the iterator positions.
+    template< typename keytype, typename valtype, typename hashtype, typename equaltype, typename alloctype, typename policytype >
+    friend class lru_hash_map;
+
+    //! The open-addressed table holding every element.
+    table_type _table;
+
+    //! Hashes keys into the full size_t range.
+    Hash _hasher;
+
+    //! Compares keys sharing a home bucket.
+    KeyEqual _keyEqual;
+
+    //! The largest allowed ratio of elements to buckets before the table grows.
+    float _maxLoadFactor = 0.8f;
+
+    //! The element count past which the table grows, derived from _maxLoadFactor.
+    uint32_t _growThreshold = 0;
+
+    //! The table being drained into _table by an incremental rehash. Unallocated otherwise.
+    old_table_type _oldTable;
+
+    //! Slots of _oldTable below this have all been moved over.
+    uint32_t _migrationCursor = 0;
+
+    //! Whether growing keeps the old table around and drains it bit by bit.
+    bool _incrementalRehash = false;
+
+    //! Hot path event counts. Empty unless the policy selects atomic_counters.
+    mutable counters_type _counters;
+
+    //! The number of elements erased one at a time since construction, reported by stats().
+    uint64_t _eraseCount = 0;
+
+  public:
+
+    template< typename keytype, typename valtype, typename hashtype, typename equaltype, typename alloctype, typename policytype >
+    friend void swap( hash_map<keytype, valtype, hashtype, equaltype, alloctype, policytype>& map1, hash_map<keytype, valtype, hashtype, equaltype, alloctype, policytype>& map2 );
+
+    hash_map( uint32_t storageSize = 256, const Hash& hasher = Hash(), const KeyEqual& keyEqual = KeyEqual(), const allocator_type& alloc = allocator_type() ) :
+      _table( alloc ),
+      _hasher( hasher ),
+      _keyEqual( keyEqual ),
+      _oldTable( alloc ) {
+
+      uint32_t bucketCount = roundUpToPowerOfTwo( storageSize );
+
+      if ( bucketCount == 0 ) {
+        bucketCount = 256;
+      }
+
+      _table = table_type( bucketCount, alloc );
+      updateGrowThreshold();
+    }
+
+    hash_map( const hash_map& other ) :
+      _table( other._table ),
+      _hasher( other._hasher ),
+      _keyEqual( other._keyEqual ),
+      _maxLoadFactor( other._maxLoadFactor ),
+      _growThreshold( other._growThreshold ),
+      _oldTable( _table.get_allocator() ),
+      _incrementalRehash( other._incrementalRehash ),
+      _eraseCount( other._eraseCount ) {
+
+      // Elements still waiting in the old table of other are copied straight into the new one, so every element shares one allocator.
+      for ( uint32_t i = other._oldTable.nextOccupied( 0 ); i < other._oldTable.slotCount(); i = other._oldTable.nextOccupied( i + 1 ) ) {
+        const value_type& entry = other._oldTable.slotValue( i );
+        insertNew( hashThis( entry.first ), entry );
+      }
+    }
+
+    hash_map( hash_map&& other ) noexcept :
+      _table( other._table.get_allocator() ),
+      _hasher( other._hasher ),
+      _keyEqual( other._keyEqual ),
+      _oldTable( other._table.get_allocator() ) {
+      swap( *this, other );
+    }
+
+    //! Reuses the table of this map through clone_into(), unless the allocator of other has to come along.
+    hash_map& operator=( const hash_map& other ) {
+
+      if ( this == &other ) {
+        return *this;
+      }
+
+      if ( std::allocator_traits<allocator_type>::propagate_on_container_copy_assignment::value ) {
+        hash_map temp( other );
+        swap( *this, temp );
+      }
+      else {
+        other.clone_into( *this );
+      }
+
+      return *this;
+    }
+
+    hash_map& operator=( hash_map&& other ) noexcept {
+      swap( *this, other );
+      return *this;
+    }
+
+    //! Clean up, aisle hash_map.
+    virtual ~hash_map() {}
+
+    //! Accessor operator.
+    T& operator[]( const K& rawKey ) {
+      return tryEmplace( rawKey ).first->second;
+    }
+
+    //! Accessor operator, moving the key into the map if it is missing.
+    T& operator[]( K&& rawKey ) {
+      return tryEmplace( std::move( rawKey ) ).first->second;
+    }
+
+    /*
+    Constructs the value from args in place, exactly once, if the key is missing.
+    Leaves args untouched if the key is present. Returns the stored value and
+    whether it was inserted.
+    */
+    template< typename... Args >
+    std::pair<T*, bool> try_emplace( const K& rawKey, Args&&... args ) {
+      std::pair<value_type*, bool> result = tryEmplace( rawKey, std::forward<Args>( args )... );
+      return { &( result.first->second ), result.second };
+    }
+
+    template< typename... Args >
+    std::pair<T*, bool> try_emplace( K&& rawKey, Args&&... args ) {
+      std::pair<value_type*, bool> result = tryEmplace( std::move( rawKey ), std::forward<Args>( args )... );
+      return { &( result.first->second ), result.second };
+    }
+
+    //! Same as try_emplace(). The value is only ever constructed when it is inserted.
+    template< typename... Args >
+    std::pair<T*, bool> emplace( const K& rawKey, Args&&... args ) {
+      return try_emplace( rawKey, std::forward<Args>( args )... );
+    }
+
+    template< typename... Args >
+    std::pair<T*, bool> emplace( K&& rawKey, Args&&... args ) {
+      return try_emplace( std::move( rawKey ), std::forward<Args>( args )... );
+    }
+
+    /*
+    Same as try_emplace(), with the hash computed beforehand by hash_of(), as
+    for find_hashed(). Stands in for an operator [] taking the hash, which
+    cannot have a second operand: try_emplace_hashed( key, hash ).first points
+    at the same value operator [] returns.
+    */
+    template< typename... Args >
+    std::pair<T*, bool> try_emplace_hashed( const K& rawKey, size_t hash, Args&&... args ) {
+      std::pair<value_type*, bool> result = tryEmplaceHashed( hash, rawKey, std::forward<Args>( args )... );
+      return { &( result.first->second ), result.second };
+    }
+
+    template< typename... Args >
+    std::pair<T*, bool> try_emplace_hashed( K&& rawKey, size_t hash, Args&&... args ) {
+      std::pair<value_type*, bool> result = tryEmplaceHashed( hash, std::move( rawKey ), std::forward<Args>( args )... );
+      return { &( result.first->second ), result.second };
+    }
+
+    //! Inserts the value, or assigns it over the one already stored. Returns the stored value and whether it was inserted.
+    template< typename M >
+    std::pair<T*, bool> insert_or_assign( const K& rawKey, M&& value ) {
+      return insertOrAssign( rawKey, std::forward<M>( value ) );
+    }
+
+    template< typename M >
+    std::pair<T*, bool> insert_or_assign( K&& rawKey, M&& value ) {
+      return insertOrAssign( std::move( rawKey ), std::forward<M>( value ) );
+    }
+
+    //! Returns the value stored at the key, or nullptr. Never inserts.
+    T* find( const K& rawKey ) {
+      return find_hashed( rawKey, hashThis( rawKey ) );
+    }
+
+    //! Returns the value stored at the key, or nullptr. Never inserts.
+    const T* find( const K& rawKey ) const {
+      return find_hashed( rawKey, hashThis( rawKey ) );
+    }
+
+    template< typename Key, typename = transparent_key<Key> >
+    T* find( const Key& rawKey ) {
+      return find_hashed( rawKey, hashThis( rawKey ) );
+    }
+
+    template< typename Key, typename = transparent_key<Key> >
+    const T* find( const Key& rawKey ) const {
+      return find_hashed( rawKey, hashThis( rawKey ) );
+    }
+
+    /*
+    Same as find(), with the hash of the key computed beforehand by hash_of(),
+    of this map or of any map with an equal Hash. Looking one key up in several
+    such maps then hashes it only once. Each table reduces the full hash to its
+    own bucket count; a hash from another Hash finds nothing.
+    */
+    T* find_hashed( const K& rawKey, size_t hash ) {
+      value_type* found = lookup( rawKey, hash );
+      return found == nullptr ? nullptr : &( found->second );
+    }
+
+    const T* find_hashed( const K& rawKey, size_t hash ) const {
+      value_type* found = lookup( rawKey, hash );
+      return found == nullptr ? nullptr : &( found->second );
+    }
+
+    template< typename Key, typename = transparent_key<Key> >
+    T* find_hashed( const Key& rawKey, size_t hash ) {
+      value_type* found = lookup( rawKey, hash );
+      return found == nullptr ? nullptr : &( found->second );
+    }
+
+    template< typename Key, typename = transparent_key<Key> >
+    const T* find_hashed( const Key& rawKey, size_t hash ) const {
+      value_type* found = lookup( rawKey, hash );
+      return found == nullptr ? nullptr : &( found->second );
+    }
+
+    //! Returns the full hash find_hashed() and try_emplace_hashed() take for the key.
+    size_t hash_of( const K& rawKey ) const {
+      return hashThis( rawKey );
+    }
+
+    template< typename Key, typename = transparent_key<Key> >
+    size_t hash_of( const Key& rawKey ) const {
+      return hashThis( rawKey );
+    }
+
+    //! Checks whether the key is in the map. Never inserts.
+    bool contains( const K& rawKey ) const {
+      return find( rawKey ) != nullptr;
+    }
+
+    template< typename Key, typename = transparent_key<Key> >
+    bool contains( const Key& rawKey ) const {
+      return find( rawKey ) != nullptr;
+    }
+
+    //! Returns the number of elements stored at the key, 0 or 1. Never inserts.
+    uint32_t count( const K& rawKey ) const {
+      return contains( rawKey ) ? 1 : 0;
+    }
+
+    template< typename Key, typename = transparent_key<Key> >
+    uint32_t count( const Key& rawKey ) const {
+      return contains( rawKey ) ? 1 : 0;
+    }
+
+    //! Returns the value stored at the key. Throws std::out_of_range if it is missing.
+    T& at( const K& rawKey ) {
+      return valueOrThrow( find( rawKey ) );
+    }
+
+    //! Returns the value stored at the key. Throws std::out_of_range if it is missing.
+    const T& at( const K& rawKey ) const {
+      return valueOrThrow( find( rawKey ) );
+    }
+
+    template< typename Key, typename = transparent_key<Key> >
+    T& at( const Key& rawKey ) {
+      return valueOrThrow( find( rawKey ) );
+    }
+
+    template< typename Key, typename = transparent_key<Key> >
+    const T& at( const Key& rawKey ) const {
+      return valueOrThrow( find( rawKey ) );
+    }
+
+    /*
+    Looks up n keys at once, storing each value or nullptr in out. Keys are
+    handled in chunks of batchSize: a chunk is hashed and its home buckets
+    prefetched before any of them is probed, so the cache misses of a chunk
+    overlap instead of stalling one after another. Returns how many were found.
+    */
+    size_t find_batch( const K* keys, size_t n, T** out ) {
+      return findBatch( keys, n, out );
+    }
+
+    size_t find_batch( const K* keys, size_t n, const T** out ) const {
+      return findBatch( keys, n, out );
+    }
+
+    /*
+    Does insert_or_assign() for n key and value pairs, prefetching each chunk of
+    home buckets like find_batch(). Later duplicates overwrite earlier ones.
+    Returns how many keys were newly inserted.
+    */
+    size_t insert_batch( const K* keys, const T* values, size_t n ) {
+
+      size_t hashes[batchSize];
+      size_t inserted = 0;
+
+      for ( size_t start = 0; start < n; start += batchSize ) {
+
+        // Migrating ahead of the chunk keeps its prefetched slots in place.
+        if ( rehash_in_progress() ) {
+          migrateStep();
+        }
+
+        size_t chunk = n - start < batchSize ? n - start : batchSize;
+        hashChunk( keys + start, chunk, hashes );
+
+        for ( size_t i = 0; i < chunk; i++ ) {
+
+          const K& rawKey = keys[start + i];
+          value_type* found = lookup( rawKey, hashes[i] );
+
+          if ( found != nullptr ) {
+            found->second = values[start + i];
+          }
+          else {
+            insertNew( hashes[i], rawKey, values[start + i] );
+            inserted++;
+          }
+        }
+      }
+
+      return inserted;
+    }
+
+    /*
+    Replaces the contents with n key and value pairs, sizing the table and the
+    element storage once up front. The pairs are hashed in one pass and
+    counting sorted by home bucket, so the table fills from front to back: a
+    Robin Hood run hardly ever needs shifting and each stretch of slots is
+    only touched while it is in cache. Big tables are sorted by ranges of
+    neighbouring buckets, keeping the sort itself cache friendly. Keys or
+    values that cannot be default constructed are inserted in input order
+    instead. Later duplicates overwrite earlier ones, as with insert_batch().
+    */
+    void build( const K* keys, const T* values, size_t n ) {
+
+      if ( n > maxBucketCount ) {
+        throw std::length_error( "rstd::hash_map::build: too many elements" );
+      }
+
+      clear();
+      reserve( (uint32_t) n );
+      _table.reserveElements( (uint32_t) n );
+
+      if constexpr ( std::is_default_constructible<K>::value && std::is_default_constructible<T>::value ) {
+        buildSorted( keys, values, n );
+      }
+      else {
+        insert_batch( keys, values, n );
+      }
+    }
+
+    //! Clears out the hash map from items, keeping the table so refilling it does not allocate.
+    void clear() {
+      _counters.clear();
+      _table.clear();
+      if ( rehash_in_progress() ) {
+        endMigration();
+      }
+    }
+
+    //! Erases a single entity from the map.
+    void erase( const K& rawKey ) {
+      eraseKey( rawKey, hashThis( rawKey ) );
+    }
+
+    template< typename Key, typename = transparent_key<Key> >
+    void erase( const Key& rawKey ) {
+      eraseKey( rawKey, hashThis( rawKey ) );
+    }
+
+    //! Same as erase(), with the hash computed beforehand by hash_of(), as for find_hashed(). Returns whether the key was erased.
+    bool erase_hashed( const K& rawKey, size_t hash ) {
+      return eraseKey( rawKey, hash );
+    }
+
+    //! Erases the element at pos. Returns an iterator to the element after it. Never migrates, so iteration can go on.
+    iterator erase( const_iterator pos ) {
+      eraseAtPosition( pos._position );
+      // The engine may have moved the next element into the erased slot, so the search starts at it.
+      return iterator( this, nextPosition( pos._position ) );
+    }
+
+    /*
+    Calls f( value_type& ) on every element, splitting the slots into one
+    contiguous range per thread. threads is the most threads to use, 0 for
+    one per hardware thread; tables too small to be worth it are walked on
+    the calling thread alone. f runs concurrently with itself, on distinct
+    elements, and must not insert or erase. An exception thrown by f is
+    rethrown here once every thread is done, the rest of its range skipped.
+    */
+    template< typename F >
+    void parallel_for_each( F&& f, unsigned threads = 0 ) {
+      rstd_support::parallelRanges( endPosition(), threads, [&]( uint32_t begin, uint32_t end, uint32_t ) {
+        for ( uint32_t i = nextPosition( begin ); i < end; i = nextPosition( i + 1 ) ) {
+          f( valueAt( i ) );
+        }
+      } );
+    }
+
+    //! Calls f( const value_type& ) on every element, as above.
+    template< typename F >
+    void parallel_for_each( F&& f, unsigned threads = 0 ) const {
+      rstd_support::parallelRanges( endPosition(), threads, [&]( uint32_t begin, uint32_t end, uint32_t ) {
+        for ( uint32_t i = nextPosition( begin ); i < end; i = nextPosition( i + 1 ) ) {
+          f( static_cast<const value_type&>( valueAt( i ) ) );
+        }
+      } );
+    }
+
+    /*
+    Erases every element for which pred( const value_type& ) holds. The
+    elements are tested in parallel like parallel_for_each(), so pred must be
+    safe to call concurrently, and the matches erased afterward on the calling
+    thread, from the last slot to the first: erasing only ever shifts elements
+    of later slots, so the slots still to go stay where they were marked.
+    Returns the number of elements erased.
+    */
+    template< typename Pred >
+    uint32_t erase_if( Pred&& pred, unsigned threads = 0 ) {
+
+      std::vector<std::vector<uint32_t>> marked( rstd_support::threadCount( threads ) );
+
+      rstd_support::parallelRanges( endPosition(), threads, [&]( uint32_t begin, uint32_t end, uint32_t part ) {
+        for ( uint32_t i = nextPosition( begin ); i < end; i = nextPosition( i + 1 ) ) {
+          if ( pred( static_cast<const value_type&>( valueAt( i ) ) ) ) {
+            marked[part].push_back( i );
+          }
+        }
+      } );
+
+      uint32_t erased = 0;
+      for ( size_t part = marked.size(); part-- > 0; ) {
+        for ( size_t i = marked[part].size(); i-- > 0; ) {
+          eraseAtPosition( marked[part][i] );
+          erased++;
+        }
+      }
+
+      return erased;
+    }
+
+    /*
+    Moves every element of source whose key is missing here over into this
+    map, leaving the others in source, like std::unordered_map::merge(). The
+    table is grown for both maps up front. With equal allocators, an element
+    goes over with its storage: boxed_storage moves the pointer, and no value
+    is copied or moved. Finishes any incremental rehash of either map first.
+    stats() and counters() count each element moved as erased from source and
+    inserted here.
+    */
+    void merge( hash_map& source ) {
+
+      if ( &source == this ) {
+        return;
+      }
+
+      if ( rehash_in_progress() ) {
+        finishMigration();
+      }
+      if ( source.rehash_in_progress() ) {
+        source.finishMigration();
+      }
+
+      uint64_t combined = (uint64_t) size() + source.size();
+      reserve( combined > maxBucketCount ? maxBucketCount : (uint32_t) combined );
+
+      bool sameAllocator = _table.get_allocator() == source._table.get_allocator();
+
+      // From the last slot down, so that the slots source shifts on erasing have been visited already.
+      for ( uint32_t i = source._table.slotCount(); i-- > 0; ) {
+
+        if ( !source._table.occupied( i ) ) {
+          continue;
+        }
+
+        value_type& entry = source._table.slotValue( i );
+        size_t hash = hashThis( entry.first );
+        if ( _table.findIndex( entry.first, hash, _keyEqual ) != table_type::npos ) {
+          continue;
+        }
+
+        if ( size() + _table.tombstones() >= _growThreshold ) {
+          growInPlace();
+        }
+
+        uint32_t index;
+        if ( sameAllocator ) {
+          while ( ( index = source._table.moveTo( _table, i, hash ) ) == table_type::npos ) {
+            growInPlace();
+          }
+        }
+        else {
+          while ( ( index = _table.makeRoom( hash ) ) == table_type::npos ) {
+            growInPlace();
+          }
+          _table.constructAt( index, std::move( const_cast<K&>( entry.first ) ), std::move( entry.second ) );
+          source._table.eraseAt( i );
+          if ( std::is_same<typename Policy::storage, boxed_storage>::value ) {
+            _counters.allocate();
+          }
+        }
+
+        // Counted as an erase from source and an insert here, like extract() and insert( node_type&& ).
+        source._eraseCount++;
+        source._counters.erase();
+        if ( counters_type::enabled ) {
+          _counters.insert( _table.probeLength( index, hash ) );
+        }
+      }
+    }
+
+    void merge( hash_map&& source ) {
+      merge( source );
+    }
+
+    //! Takes the element at the key out of the map into a node, or returns an empty node if the key is missing.
+    node_type extract( const K& rawKey ) {
+      return extractKey( rawKey );
+    }
+
+    template< typename Key, typename = transparent_key<Key> >
+    node_type extract( const Key& rawKey ) {
+      return extractKey( rawKey );
+    }
+
+    //! Takes the element at pos out of the map into a node. Never migrates, like erase( const_iterator ).
+    node_type extract( const_iterator pos ) {
+      node_type node;
+      extractAtPosition( pos._position, node );
+      return node;
+    }
+
+    /*
+    Inserts the element of node if its key is missing, leaving node empty.
+    Otherwise leaves the map alone and hands node back in the result. A node
+    from a map with an equal allocator goes in without allocating or moving
+    its value under boxed_storage; from any other, the element is moved into
+    storage of this map.
+    */
+    insert_return_type insert( node_type&& node ) {
+
+      if ( node.empty() ) {
+        return { nullptr, false, node_type() };
+      }
+
+      if ( rehash_in_progress() ) {
+        migrateStep();
+      }
+
+      size_t hash = hashThis( node.key() );
+      value_type* found = lookup( node.key(), hash );
+
+      if ( found != nullptr ) {
+        return { &( found->second ), false, std::move( node ) };
+      }
+
+      if ( *node._allocator != _table.get_allocator() ) {
+        value_type& inserted = insertNew( hash, std::move( node.key() ), std::move( node.mapped() ) );
+        node.reset();
+        return { &( inserted.second ), true, node_type() };
+      }
+
+      uint32_t index = claimSlot( hash );
+      value_type& inserted = _table.adoptAt( index, node._slot );
+      node._allocator.reset();
+
+      if ( counters_type::enabled ) {
+        _counters.insert( _table.probeLength( index, hash ) );
+      }
+      return { &( inserted.second ), true, node_type() };
+    }
+
+    iterator begin() {
+      return iterator( this, nextPosition( 0 ) );
+    }
+
+    const_iterator begin() const {
+      return const_iterator( this, nextPosition( 0 ) );
+    }
+
+    const_iterator cbegin() const {
+      return begin();
+    }
+
+    iterator end() {
+      return iterator( this, endPosition() );
+    }
+
+    const_iterator end() const {
+      return const_iterator( this, endPosition() );
+    }
+
+    const_iterator cend() const {
+      return end();
+    }
+
+    //! Checks if the map is empty or not.
+    bool empty() const {
+      return size() == 0;
+    }
+
+    //! Returns the number of elements in the map.
+    uint32_t size() const {
+      return _table.size() + _oldTable.size();
+    }
+
+    //! Returns the largest allowed ratio of elements to buckets.
+    float max_load_factor() const {
+      return _maxLoadFactor;
+    }
+
+    //! Sets the largest allowed ratio of elements to buckets. Grows right away if exceeded. Throws std::invalid_argument outside of [0.1, 1].
+    void max_load_factor( float maxLoadFactor ) {
+
+      if ( !( maxLoadFactor >= 0.1f && maxLoadFactor <= 1.0f ) ) {
+        throw std::invalid_argument( "rstd::hash_map::max_load_factor: must be between 0.1 and 1" );
+      }
+
+      _maxLoadFactor = maxLoadFactor;
+      updateGrowThreshold();
+
+      if ( size() > _growThreshold ) {
+        rehash( 0 );
+      }
+    }
+
+    //! Makes room for at least elementCount elements without growing again.
+    void reserve( uint32_t elementCount ) {
+      if ( elementCount > _growThreshold ) {
+        rehash( bucketsFor( elementCount ) );
+      }
+    }
+
+    //! Rebuilds the table with at least bucketCount buckets, and enough for the current elements. May shrink. Finishes any incremental rehash first.
+    void rehash( uint32_t bucketCount ) {
+
+      if ( rehash_in_progress() ) {
+        finishMigration();
+      }
+
+      uint32_t needed = bucketsFor( _table.size() );
+      if ( bucketCount < needed ) {
+        bucketCount = needed;
+      }
+
+      bucketCount = roundUpToPowerOfTwo( bucketCount );
+      if ( bucketCount == 0 ) {
+        bucketCount = maxBucketCount;
+      }
+
+      if ( bucketCount != _table.bucketCount() ) {
+        _table.rehash( bucketCount, _hasher );
+        countRebuild();
+        updateGrowThreshold();
+      }
+    }
+
+    /*
+    Turns incremental rehashing on or off. While on, growing allocates the new
+    table but leaves the elements in the old one, and each later insert or erase
+    moves up to migrationStep of them over. Turning it off finishes any rehash
+    still in progress.
+    */
+    void incremental_rehash( bool enabled ) {
+      _incrementalRehash = enabled;
+      if ( !enabled && rehash_in_progress() ) {
+        finishMigration();
+      }
+    }
+
+    bool incremental_rehash() const {
+      return _incrementalRehash;
+    }
+
+    //! Checks whether elements are still waiting in the old table of an incremental rehash.
+    bool rehash_in_progress() const {
+      return _oldTable.bucketCount() != 0;
+    }
+
+    //! Returns the number of elements sharing the home bucket of the given key.
+    uint32_t bucketDensity( const K& rawKey ) const {
+      size_t hash = hashThis( rawKey );
+      return _table.homeDensity( hash, _hasher ) + _oldTable.homeDensity( hash, _hasher );
+    }
+
+    //! Returns the number of buckets (hash size?).
+    uint32_t bucketCount() const {
+      return _table.bucketCount();
+    }
+
+    //! Returns the ratio of elements to buckets.
+    float load_factor() const {
+      return _table.bucketCount() == 0 ? 0.0f : (float) size() / _table.bucketCount();
+    }
+
+    /*
+    Returns the most elements sharing any single home bucket. Far above 1, it
+    points at a poor hash or a degenerate key set. Walks the whole table.
+    */
+    uint32_t max_bucket_density() const {
+      uint32_t densest = _table.maxHomeDensity( _hasher );
+      uint32_t oldDensest = _oldTable.maxHomeDensity( _hasher );
+      return densest > oldDensest ? densest : oldDensest;
+    }
+
+    //! Returns the bytes held by the map, broken down by what they hold.
+    hash_map_memory_usage memory_usage() const {
+
+      hash_map_memory_usage usage;
+      usage.object = sizeof( *this );
+      usage.table = _table.blockBytes() + _oldTable.blockBytes();
+      usage.elements = _table.elementBytes() + _oldTable.elementBytes();
+      usage.slack = _table.slackBytes() + _oldTable.slackBytes();
+
+      return usage;
+    }
+
+    //! Returns a snapshot of how well the keys spread over the table. Walks the whole table.
+    hash_map_stats stats() const {
+
+      hash_map_stats snapshot;
+      snapshot.elements = size();
+      snapshot.buckets = _table.bucketCount();
+      snapshot.emptySlots = _table.slotCount() + _oldTable.slotCount() - size() - _table.tombstones() - _oldTable.tombstones();
+      snapshot.tombstones = _table.tombstones() + _oldTable.tombstones();
+      snapshot.erases = _eraseCount;
+
+      _table.probeHistogram( _hasher, snapshot.probeHistogram );
+      _oldTable.probeHistogram( _hasher, snapshot.probeHistogram );
+
+      uint64_t totalLength = 0;
+      for ( uint32_t i = 0; i < snapshot.probeHistogram.size(); i++ ) {
+        totalLength += (uint64_t) ( i + 1 ) * snapshot.probeHistogram[i];
+        if ( snapshot.probeHistogram[i] != 0 ) {
+          snapshot.maxProbeLength = i + 1;
+        }
+      }
+
+      snapshot.meanProbeLength = snapshot.elements == 0 ? 0.0 : (double) totalLength / snapshot.elements;
+      return snapshot;
+    }
+
+    //! Returns the hot path event counts. All zero unless the policy selects atomic_counters. Safe to call from any thread.
+    hash_map_counters counters() const {
+      return _counters.snapshot();
+    }
+
+    //! Sets every hot path event count back to zero. Safe to call from any thread.
+    void reset_counters() {
+      _counters.reset();
+    }
+
+    //! Returns the bytes the map holds per element, as counted by memory_usage().
+    double bytes_per_entry() const {
+      return empty() ? 0.0 : (double) memory_usage().total() / size();
+    }
+
+    /*
+    Makes target a copy of this map, reusing its table where it can. At the
+    same bucket count, the table is cleared and refilled slot for slot, one
+    memcpy for trivially copyable keys and values; a bigger target keeps its
+    buckets and takes the elements one by one. Only a smaller target allocates.
+    The counters of target are left be. If copying an element throws, target
+    holds the elements copied so far.
+    */
+    void clone_into( hash_map& target ) const {
+
+      if ( &target == this ) {
+        return;
+      }
+
+      target.clear();
+      target._hasher = _hasher;
+      target._keyEqual = _keyEqual;
+      target._maxLoadFactor = _maxLoadFactor;
+      target._incrementalRehash = _incrementalRehash;
+      target._eraseCount = _eraseCount;
+
+      if ( target._table.bucketCount() > _table.bucketCount() ) {
+        target.updateGrowThreshold();
+        for ( uint32_t i = nextPosition( 0 ); i < endPosition(); i = nextPosition( i + 1 ) ) {
+          const value_type& entry = valueAt( i );
+          target.insertNew( hashThis( entry.first ), entry );
+        }
+        return;
+      }
+
+      if ( target._table.bucketCount() < _table.bucketCount() ) {
+        target._table = table_type( _table.bucketCount(), target._table.get_allocator() );
+        target._counters.allocate();
+      }
+
+      target._table.copyFrom( _table );
+      target.updateGrowThreshold();
+
+      // As in the copy constructor, elements still in the old table go straight into the new one.
+      for ( uint32_t i = _oldTable.nextOccupied( 0 ); i < _oldTable.slotCount(); i = _oldTable.nextOccupied( i + 1 ) ) {
+        const value_type& entry = _oldTable.slotValue( i );
+        target.insertNew( hashThis( entry.first ), entry );
+      }
+    }
+
+    /*
+    Writes the map to path as an image that mapped_hash_map serves lookups
+    from in place, without loading it; see snapshot_header. Keys and values
+    must be trivially copyable, and only builds with the same value_type layout
+    and the same Hash can read the image back. Maps of another policy, or in
+    the middle of an incremental rehash, are first copied into a Robin Hood
+    table of inline elements. Throws std::runtime_error if writing fails.
+    */
+    void save( const std::string& path ) const {
+
+      static_assert( std::is_trivially_copyable<K>::value && std::is_trivially_copyable<T>::value, "rstd::hash_map::save needs trivially copyable keys and values" );
+
+      const snapshot_table* direct = snapshotOf( _table );
+      if ( direct != nullptr && !rehash_in_progress() ) {
+        writeSnapshot( path, *direct );
+        return;
+      }
+
+      snapshot_table image( roundUpToPowerOfTwo( bucketsFor( size() ) ), get_allocator() );
+      for ( uint32_t i = nextPosition( 0 ); i < endPosition(); i = nextPosition( i + 1 ) ) {
+
+        const value_type& entry = valueAt( i );
+        size_t hash = hashThis( entry.first );
+
+        uint32_t index;
+        while ( ( index = image.makeRoom( hash ) ) == snapshot_table::npos ) {
+          image.rehash( image.grownBucketCount(), _hasher );
+        }
+        image.constructAt( index, entry );
+      }
+
+      writeSnapshot( path, image );
+    }
+
+    //! Returns a copy of the hash function.
+    hasher hash_function() const {
+      return _hasher;
+    }
+
+    //! Returns a copy of the key comparison function.
+    key_equal key_eq() const {
+      return _keyEqual;
+    }
+
+    //! Returns a copy of the allocator used for the table and any boxed elements.
+    allocator_type get_allocator() const {
+      return _table.get_allocator();
+    }
+
+#ifdef _DEBUG
+
+    //! Prints each entry in map to console. Mainly a debug thing.
+    void debugString() const {
+
+      std::cout << "Loc\tKey\tValue" << std::endl;
+      for ( uint32_t i = nextPosition( 0 ); i < endPosition(); i = nextPosition( i + 1 ) ) {
+        value_type& entry = valueAt( i );
+        std::cout << i << "\t" << entry.first << "\t" << entry.second << std::endl;
+      }
+    }
+
+#endif
+
+  private:
+
+    //! The number of keys find_batch() and insert_batch() hash and prefetch together.
+    static constexpr size_t batchSize = 16;
+
+    //! The most bucket ranges build() sorts pairs into. Few enough for the scatter to stay in cache.
+    static constexpr uint32_t maxBuildRanges = 4096;
+
+    //! A pair of build() along with its hash, copied into home bucket order.
+    struct build_entry
+    {
+      size_t hash;
+      K key;
+      T value;
+    };
+
+    void buildSorted( const K* keys, const T* values, size_t n ) {
+
+      std::vector<size_t> hashes( n );
+      for ( size_t i = 0; i < n; i++ ) {
+        hashes[i] = hashThis( keys[i] );
+      }
+
+      uint32_t shift = 0;
+      while ( ( _table.bucketCount() >> shift ) > maxBuildRanges ) {
+        shift++;
+      }
+
+      std::vector<uint32_t> rangeStarts( ( _table.bucketCount() >> shift ) + 1 );
+      for ( size_t i = 0; i < n; i++ ) {
+        rangeStarts[( _table.homeBucket( hashes[i] ) >> shift ) + 1]++;
+      }
+      for ( size_t range = 1; range < rangeStarts.size(); range++ ) {
+        rangeStarts[range] += rangeStarts[range - 1];
+      }
+
+      // The pairs themselves are copied, not their indices, so the fill below reads them in order. Scattering in input order keeps duplicates in order, so the last one wins.
+      std::vector<build_entry> sorted( n );
+      for ( size_t i = 0; i < n; i++ ) {
+        build_entry& entry = sorted[rangeStarts[_table.homeBucket( hashes[i] ) >> shift]++];
+        entry.hash = hashes[i];
+        entry.key = keys[i];
+        entry.value = values[i];
+      }
+
+      hashes = std::vector<size_t>();
+
+      for ( build_entry& entry : sorted ) {
+
+        value_type* found = _table.find( entry.key, entry.hash, _keyEqual );
+
+        if ( found != nullptr ) {
+          found->second = std::move( entry.value );
+        }
+        else {
+          insertNew( entry.hash, std::move( entry.key ), std::move( entry.value ) );
+        }
+      }
+    }
+
+    //! Hashes a chunk of keys and prefetches their home buckets.
+    void hashChunk( const K* keys, size_t chunk, size_t* hashes ) const {
+
+      for ( size_t i = 0; i < chunk; i++ ) {
+        hashes[i] = hashThis( keys[i] );
+      }
+
+      for ( size_t i = 0; i < chunk; i++ ) {
+        _table.prefetch( hashes[i] );
+      }
+    }
+
+    template< typename Out >
+    size_t findBatch( const K* keys, size_t n, Out** out ) const {
+
+      size_t hashes[batchSize];
+      size_t found = 0;
+
+      for ( size_t start = 0; start < n; start += batchSize ) {
+
+        size_t chunk = n - start < batchSize ? n - start : batchSize;
+        hashChunk( keys + start, chunk, hashes );
+
+        for ( size_t i = 0; i < chunk; i++ ) {
+          value_type* entry = lookup( keys[start + i], hashes[i] );
+          out[start + i] = entry == nullptr ? nullptr : &( entry->second );
+          found += entry != nullptr;
+        }
+      }
+
+      return found;
+    }
+
+    /*
+    Iterator positions are table slots, those of the old table of an
+    incremental rehash first. Returns the first element at or after position.
+    */
+    uint32_t nextPosition( uint32_t position ) const {
+
+      uint32_t oldSlots = _oldTable.slotCount();
+
+      if ( position < oldSlots ) {
+        position = _oldTable.nextOccupied( position );
+        if ( position < oldSlots ) {
+          return position;
+        }
+      }
+
+      return oldSlots + _table.nextOccupied( position - oldSlots );
+    }
+
+    uint32_t endPosition() const {
+      return _oldTable.slotCount() + _table.slotCount();
+    }
+
+    value_type& valueAt( uint32_t position ) const {
+      uint32_t oldSlots = _oldTable.slotCount();
+      return position < oldSlots ? _oldTable.slotValue( position ) : _table.slotValue( position - oldSlots );
+    }
+
+    //! The most elements a single insert or erase moves over during an incremental rehash.
+    static constexpr uint32_t migrationStep = 8;
+
+    //! Returns the element holding the key in either table, or nullptr.
+    template< typename Key >
+    value_type* lookup( const Key& rawKey, size_t hash ) const {
+
+      uint32_t index = _table.findIndex( rawKey, hash, _keyEqual );
+      if ( index != table_type::npos ) {
+        if ( counters_type::enabled ) {
+          _counters.hit( _table.probeLength( index, hash ) );
+        }
+        return &( _table.slotValue( index ) );
+      }
+
+      if ( rehash_in_progress() ) {
+        index = _oldTable.findIndex( rawKey, hash, _keyEqual );
+        if ( index != table_type::npos ) {
+          if ( counters_type::enabled ) {
+            _counters.hit( _oldTable.probeLength( index, hash ) );
+          }
+          return &( _oldTable.slotValue( index ) );
+        }
+      }
+
+      _counters.miss();
+      return nullptr;
+    }
+
+    //! Moves the old table element in the given slot over into _table.
+    void migrateAt( uint32_t index ) {
+
+      size_t hash = hashThis( _oldTable.slotValue( index ).first );
+
+      while ( _oldTable.moveTo( _table.migrationTable(), index, hash ) == old_table_type::npos ) {
+        growInPlace();
+      }
+    }
+
+    //! Doubles the buckets of _table right away, never starting an incremental rehash.
+    void growInPlace() {
+      _table.rehash( grownBucketCount(), _hasher );
+      countRebuild();
+      updateGrowThreshold();
+    }
+
+    //! Moves the element at an iterator position out into the empty node. Never migrates.
+    void extractAtPosition( uint32_t position, node_type& node ) {
+      uint32_t oldSlots = _oldTable.slotCount();
+      if ( position < oldSlots ) {
+        _oldTable.extractAt( position, node._slot );
+      }
+      else {
+        _table.extractAt( position - oldSlots, node._slot );
+      }
+      node._allocator = _table.get_allocator();
+      _eraseCount++;
+      _counters.erase();
+    }
+
+    //! Erases the element at an iterator position. Never migrates.
+    void eraseAtPosition( uint32_t position ) {
+      uint32_t oldSlots = _oldTable.slotCount();
+      if ( position < oldSlots ) {
+        _oldTable.eraseAt( position );
+      }
+      else {
+        _table.eraseAt( position - oldSlots );
+      }
+      _eraseCount++;
+      _counters.erase();
+    }
+
+    /*
+    Moves up to migrationStep elements over, looking at no more than eight
+    slots per element so a sparse stretch cannot make the step unbounded.
+    Moving an element out may shift the next one back into its slot, so the
+    cursor only advances past empty slots.
+    */
+    void migrateStep() {
+
+      uint32_t slotCount = _oldTable.slotCount();
+      uint32_t scanEnd = slotCount - _migrationCursor > migrationStep * 8 ? _migrationCursor + migrationStep * 8 : slotCount;
+      uint32_t moved = 0;
+
+      while ( moved < migrationStep && _migrationCursor < scanEnd ) {
+        if ( _oldTable.occupied( _migrationCursor ) ) {
+          migrateAt( _migrationCursor );
+          moved++;
+        }
+        else {
+          _migrationCursor++;
+        }
+      }
+
+      if ( _oldTable.size() == 0 ) {
+        endMigration();
+      }
+    }
+
+    //! Moves every remaining element over at once.
+    void finishMigration() {
+
+      uint32_t slotCount = _oldTable.slotCount();
+
+      while ( _oldTable.size() != 0 && _migrationCursor < slotCount ) {
+        if ( _oldTable.occupied( _migrationCursor ) ) {
+          migrateAt( _migrationCursor );
+        }
+        else {
+          _migrationCursor++;
+        }
+      }
+
+      endMigration();
+    }
+
+    //! Frees the drained old table.
+    void endMigration() {
+      _oldTable = old_table_type( _table.get_allocator() );
+      _migrationCursor = 0;
+    }
+
+    //! The largest power of two a bucket count can be.
+    static constexpr uint32_t maxBucketCount = 0x80000000u;
+
+    //! Rounds up to the next power of two. Returns 0 past maxBucketCount.
+    static uint32_t roundUpToPowerOfTwo( uint32_t value ) {
+      value--;
+      value |= value >> 1;
+      value |= value >> 2;
+      value |= value >> 4;
+      value |= value >> 8;
+      value |= value >> 16;
+      value++;
+      return value;
+    }
+
+    //! Returns the smallest bucket count holding elementCount elements under the max load factor.
+    uint32_t bucketsFor( uint32_t elementCount ) const {
+      double buckets = (double) elementCount / _maxLoadFactor;
+      return buckets >= maxBucketCount ? maxBucketCount : (uint32_t) buckets + 1;
+    }
+
+    //! The table layout save() writes, whatever the policy.
+    using snapshot_table = robin_hood_table<K, T, inline_storage, Allocator>;
+
+    //! Returns the table itself if save() can write it as it is, nullptr otherwise.
+    static const snapshot_table* snapshotOf( const snapshot_table& table ) {
+      return &table;
+    }
+
+    template< typename Table >
+    static const snapshot_table* snapshotOf( const Table& ) {
+      return nullptr;
+    }
+
+    //! Hashes the key
+    template< typename Key >
+    size_t hashThis( const Key& rawKey ) const {
+      return _hasher( rawKey );
+    }
+
+    //! Returns the value found by find() for at(), throwing if there is none.
+    static T& valueOrThrow( T* found ) {
+      if ( found == nullptr ) {
+        throw std::out_of_range( "rstd::hash_map::at: key not found" );
+      }
+      return *found;
+    }
+
+    static const T& valueOrThrow( const T* found ) {
+      if ( found == nullptr ) {
+        throw std::out_of_range( "rstd::hash_map::at: key not found" );
+      }
+      return *found;
+    }
+
+    //! Extracts the element holding the key from either table, if there is one.
+    template< typename Key >
+    node_type extractKey( const Key& rawKey ) {
+
+      if ( rehash_in_progress() ) {
+        migrateStep();
+      }
+
+      node_type node;
+      size_t hash = hashThis( rawKey );
+
+      uint32_t index = _table.findIndex( rawKey, hash, _keyEqual );
+      if ( index != table_type::npos ) {
+        extractAtPosition( _oldTable.slotCount() + index, node );
+      }
+      else if ( rehash_in_progress() ) {
+        index = _oldTable.findIndex( rawKey, hash, _keyEqual );
+        if ( index != table_type::npos ) {
+          extractAtPosition( index, node );
+        }
+      }
+
+      return node;
+    }
+
+    //! Erases the element holding the key from either table, if there is one.
+    template< typename Key >
+    bool eraseKey( const Key& rawKey, size_t hash ) {
+
+      if ( rehash_in_progress() ) {
+        migrateStep();
+      }
+
+      bool erased = _table.erase( rawKey, hash, _keyEqual );
+
+      if ( !erased && rehash_in_progress() ) {
+        erased = _oldTable.erase( rawKey, hash, _keyEqual );
+      }
+
+      _eraseCount += erased;
+      if ( erased ) {
+        _counters.erase();
+      }
+
+      return erased;
+    }
+
+    //! Finds the key, or inserts it with a value constructed from args.
+    template< typename KeyArg, typename... Args >
+    std::pair<value_type*, bool> tryEmplace( KeyArg&& rawKey, Args&&... args ) {
+      size_t hash = hashThis( rawKey );
+      return tryEmplaceHashed( hash, std::forward<KeyArg>( rawKey ), std::forward<Args>( args )... );
+    }
+
+    template< typename KeyArg, typename... Args >
+    std::pair<value_type*, bool> tryEmplaceHashed( size_t hash, KeyArg&& rawKey, Args&&... args ) {
+
+      if ( rehash_in_progress() ) {
+        migrateStep();
+      }
+
+      value_type* found = lookup( rawKey, hash );
+
+      if ( found != nullptr ) {
+        return { found, false };
+      }
+
+      value_type& inserted = insertNew( hash, std::piecewise_construct,
+        std::forward_as_tuple( std::forward<KeyArg>( rawKey ) ),
+        std::forward_as_tuple( std::forward<Args>( args )... ) );
+      return { &inserted, true };
+    }
+
+    template< typename KeyArg, typename M >
+    std::pair<T*, bool> insertOrAssign( KeyArg&& rawKey, M&& value ) {
+
+      if ( rehash_in_progress() ) {
+        migrateStep();
+      }
+
+      size_t hash = hashThis( rawKey );
+      value_type* found = lookup( rawKey, hash );
+
+      if ( found != nullptr ) {
+        found->second = std::forward<M>( value );
+        return { &( found->second ), false };
+      }
+
+      value_type& inserted = insertNew( hash, std::forward<KeyArg>( rawKey ), std::forward<M>( value ) );
+      return { &( inserted.second ), true };
+    }
+
+    //! Inserts a key known to be missing, growing the table first when needed.
+    template< typename... Args >
+    value_type& insertNew( size_t hash, Args&&... args ) {
+
+      uint32_t index = claimSlot( hash );
+      value_type& inserted = _table.constructAt( index, std::forward<Args>( args )... );
+
+      if ( counters_type::enabled ) {
+        _counters.insert( _table.probeLength( index, hash ) );
+        if ( std::is_same<typename Policy::storage, boxed_storage>::value ) {
+          _counters.allocate();
+        }
+      }
+
+      return inserted;
+    }
+
+    //! Makes room for a missing key, growing the table first when needed. Returns its slot, to be constructed right away.
+    uint32_t claimSlot( size_t hash ) {
+
+      if ( size() + _table.tombstones() >= _growThreshold ) {
+        // Inserts outran the migration, so the old table is drained before growing again.
+        if ( rehash_in_progress() ) {
+          finishMigration();
+        }
+        grow();
+      }
+
+      uint32_t index;
+      while ( ( index = _table.makeRoom( hash ) ) == table_type::npos ) {
+        grow();
+      }
+
+      return index;
+    }
+
+    /*
+    Doubles the number of buckets, or only drops the tombstones if they are what
+    filled the table. With incremental rehashing, doubling starts a migration
+    into the bigger table instead of moving everything right away.
+    */
+    void grow() {
+
+      uint32_t bucketCount = _table.bucketCount();
+
+      if ( _table.tombstones() > 0 && _table.size() < _growThreshold / 8 * 7 ) {
+        _table.rehash( bucketCount, _hasher );
+        countRebuild();
+        return;
+      }
+
+      uint32_t grown = grownBucketCount();
+
+      // A small_engine buffer spills at the bucket count it has, which the load factor may already have filled.
+      if ( grown == bucketCount && size() >= _growThreshold ) {
+        if ( grown >= maxBucketCount ) {
+          throw std::length_error( "rstd::hash_map: too many buckets" );
+        }
+        grown <<= 1;
+      }
+
+      // A table without a block of its own, like a small_engine buffer, is cheap to move over at once.
+      if ( _incrementalRehash && !rehash_in_progress() && _table.size() != 0 && _table.blockBytes() != 0 ) {
+        allocator_type alloc = _table.get_allocator();
+        _oldTable = std::move( _table.migrationTable() );
+        _table.migrationTable() = old_table_type( grown, alloc );
+        _migrationCursor = 0;
+      }
+      else {
+        _table.rehash( grown, _hasher );
+      }
+
+      countRebuild();
+      updateGrowThreshold();
+    }
+
+    //! Counts a rebuild of _table, and its new block unless it has none, like a small_engine that only moved its spill bucket count.
+    void countRebuild() {
+      _counters.rehash();
+      if ( _table.blockBytes() != 0 ) {
+        _counters.allocate();
+      }
+    }
+
+    //! Returns the bucket count _table grows to. Throws std::length_error past maxBucketCount.
+    uint32_t grownBucketCount() const {
+
+      uint32_t grown = _table.grownBucketCount();
+      if ( grown == 0 || grown > maxBucketCount ) {
+        throw std::length_error( "rstd::hash_map: too many buckets" );
+      }
+
+      return grown;
+    }
+
+    void updateGrowThreshold() {
+      _growThreshold = (uint32_t) ( (double) _table.bucketCount() * _maxLoadFactor );
+    }
+
+  };
+
+  template< typename keytype, typename valtype, typename hashtype, typename equaltype, typename alloctype, typename policytype >
+  void swap( hash_map<keytype, valtype, hashtype, equaltype, alloctype, policytype>& map1, hash_map<keytype, valtype, hashtype, equaltype, alloctype, policytype>& map2 ) {
+    using std::swap;
+    swap( map1._table, map2._table );
+    swap( map1._hasher, map2._hasher );
+    swap( map1._keyEqual, map2._keyEqual );
+    swap( map1._maxLoadFactor, map2._maxLoadFactor );
+    swap( map1._growThreshold, map2._growThreshold );
+    swap( map1._oldTable, map2._oldTable );
+    swap( map1._migrationCursor, map2._migrationCursor );
+    swap( map1._incrementalRehash, map2._incrementalRehash );
+    swap( map1._eraseCount, map2._eraseCount );
+  }
+
+}
+
+#endif // HASH_MAP_H
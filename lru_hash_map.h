@@ -0,0 +1,260 @@
+#ifndef LRU_HASH_MAP_H
+#define LRU_HASH_MAP_H
+
+#include "hash_map.h"
+
+#include <functional>
+#include <utility>
+
+/*
+
+A hash_map bounded to a fixed number of elements, for caches in front of a
+slower backing store. Once it is full, inserting a new key first evicts an
+element the clock algorithm picks, an approximation of least recently used.
+
+Every element carries a reference bit right next to its value, inside its
+table slot. A hit sets the bit and touches nothing else: no list to relink,
+no second allocation to chase. A clock hand sweeps the slots of the table in
+order, wrapping around at the end. An element whose bit is set gets it
+cleared and is passed over; the first one found with its bit clear is
+evicted. An element thus survives as long as it is hit again between two
+sweeps of the hand. Inserting counts as the first hit, so a new element
+lasts at least until the hand comes around once more.
+
+The table is reserved for the capacity up front, so it only grows further if
+the keys pile up in a few buckets; it never holds more than capacity
+elements either way. Each call hashes its key once. Evicting calls the
+eviction callback with the key and value, which it may move out of, just
+before the element is erased.
+
+Slot  Element
+----  -------
+[0]   { key, { value, referenced } }
+[1]   (empty)
+[2]   { key, { value, referenced } }  <- hand
+...
+
+*/
+
+namespace rstd
+{
+
+  template< typename K, typename T, typename Hash = hash<K>, typename KeyEqual = std::equal_to<K>, typename Allocator = std::allocator<std::pair<const K, T>>, typename Policy = default_hash_map_policy >
+  class lru_hash_map
+  {
+
+  public:
+
+    using key_type = K;
+    using mapped_type = T;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+
+    //! Called with each evicted element, right before it is erased.
+    using eviction_callback = std::function<void( const K&, T& )>;
+
+  private:
+
+    //! A value and its reference bit, sharing the table slot.
+    struct cached
+    {
+      T value;
+      bool referenced;
+
+      template< typename... Args >
+      explicit cached( std::in_place_t, Args&&... args ) :
+        value( std::forward<Args>( args )... ),
+        referenced( true ) {}
+    };
+
+  public:
+
+    using map_type = hash_map<K, cached, Hash, KeyEqual, typename std::allocator_traits<Allocator>::template rebind_alloc<std::pair<const K, cached>>, Policy>;
+
+  private:
+
+    map_type _map;
+
+    //! The most elements the map holds.
+    uint32_t _capacity;
+
+    //! The iterator position of _map the next sweep starts at.
+    uint32_t _hand = 0;
+
+    eviction_callback _onEvict;
+
+    //! The number of elements evicted since construction.
+    uint64_t _evictions = 0;
+
+  public:
+
+    //! Throws std::invalid_argument for a capacity of 0.
+    explicit lru_hash_map( uint32_t capacity, eviction_callback onEvict = eviction_callback(), const Hash& hasher = Hash(), const KeyEqual& keyEqual = KeyEqual(), const Allocator& alloc = Allocator() ) :
+      _map( 8, hasher, keyEqual, typename map_type::allocator_type( alloc ) ),
+      _capacity( capacity ),
+      _onEvict( std::move( onEvict ) ) {
+
+      if ( capacity == 0 ) {
+        throw std::invalid_argument( "rstd::lru_hash_map: capacity must not be 0" );
+      }
+
+      _map.reserve( capacity );
+    }
+
+    //! Returns the value stored at the key and marks it as recently used, or returns nullptr.
+    T* find( const K& rawKey ) {
+      cached* found = _map.find( rawKey );
+      if ( found == nullptr ) {
+        return nullptr;
+      }
+      found->referenced = true;
+      return &( found->value );
+    }
+
+    //! Returns the value stored at the key, or nullptr, without marking it as used.
+    const T* peek( const K& rawKey ) const {
+      const cached* found = _map.find( rawKey );
+      return found == nullptr ? nullptr : &( found->value );
+    }
+
+    //! Checks whether the key is cached, without marking it as used.
+    bool contains( const K& rawKey ) const {
+      return _map.contains( rawKey );
+    }
+
+    /*
+    Constructs the value from args if the key is missing, evicting an element
+    first if the map is full; otherwise marks the stored value as used and
+    leaves args untouched. Returns the stored value and whether it was inserted.
+    */
+    template< typename... Args >
+    std::pair<T*, bool> try_emplace( const K& rawKey, Args&&... args ) {
+
+      size_t hash = _map.hash_of( rawKey );
+      cached* found = _map.find_hashed( rawKey, hash );
+      if ( found != nullptr ) {
+        found->referenced = true;
+        return { &( found->value ), false };
+      }
+
+      return { insertMissing( rawKey, hash, std::forward<Args>( args )... ), true };
+    }
+
+    //! Inserts the value, or assigns it over the one stored and marks it as used. Returns the stored value and whether it was inserted.
+    template< typename M >
+    std::pair<T*, bool> insert_or_assign( const K& rawKey, M&& value ) {
+
+      size_t hash = _map.hash_of( rawKey );
+      cached* found = _map.find_hashed( rawKey, hash );
+      if ( found != nullptr ) {
+        found->value = std::forward<M>( value );
+        found->referenced = true;
+        return { &( found->value ), false };
+      }
+
+      return { insertMissing( rawKey, hash, std::forward<M>( value ) ), true };
+    }
+
+    //! Accessor operator. Inserts a default constructed value if the key is missing.
+    T& operator[]( const K& rawKey ) {
+      return *try_emplace( rawKey ).first;
+    }
+
+    //! Erases the key, without calling the eviction callback.
+    void erase( const K& rawKey ) {
+      _map.erase( rawKey );
+    }
+
+    //! Erases every element, without calling the eviction callback.
+    void clear() {
+      _map.clear();
+      _hand = 0;
+    }
+
+    //! Calls f( const K&, T& ) on every element, in slot order, without marking any as used.
+    template< typename F >
+    void for_each( F&& f ) {
+      for ( auto& entry : _map ) {
+        f( entry.first, entry.second.value );
+      }
+    }
+
+    uint32_t size() const {
+      return _map.size();
+    }
+
+    bool empty() const {
+      return _map.empty();
+    }
+
+    uint32_t capacity() const {
+      return _capacity;
+    }
+
+    //! Returns the number of elements evicted since construction.
+    uint64_t evictions() const {
+      return _evictions;
+    }
+
+    void set_eviction_callback( eviction_callback onEvict ) {
+      _onEvict = std::move( onEvict );
+    }
+
+    //! Returns the bytes held by the map, including the reference bits.
+    hash_map_memory_usage memory_usage() const {
+      return _map.memory_usage();
+    }
+
+  private:
+
+    //! Inserts a key known to be missing under its hash, evicting an element first if the map is full.
+    template< typename... Args >
+    T* insertMissing( const K& rawKey, size_t hash, Args&&... args ) {
+
+      if ( _map.size() >= _capacity ) {
+        evict();
+      }
+
+      return &( _map.try_emplace_hashed( rawKey, hash, std::in_place, std::forward<Args>( args )... ).first->value );
+    }
+
+    /*
+    Sweeps the hand on to the first element with its bit clear, clearing the
+    bits it passes, and evicts that element. A full map has one, at the latest
+    once the hand has gone all the way around. The hand stays on the slot,
+    which the element after the evicted one may have shifted into.
+    */
+    void evict() {
+
+      uint32_t end = _map.endPosition();
+
+      while ( true ) {
+
+        uint32_t position = _map.nextPosition( _hand < end ? _hand : 0 );
+        if ( position >= end ) {
+          position = _map.nextPosition( 0 );
+        }
+
+        auto& entry = _map.valueAt( position );
+        if ( entry.second.referenced ) {
+          entry.second.referenced = false;
+          _hand = position + 1;
+          continue;
+        }
+
+        if ( _onEvict ) {
+          _onEvict( entry.first, entry.second.value );
+        }
+
+        _map.eraseAtPosition( position );
+        _hand = position;
+        _evictions++;
+        return;
+      }
+    }
+
+  };
+
+}
+
+#endif // LRU_HASH_MAP_H
@@ -0,0 +1,336 @@
+#ifndef MAPPED_HASH_MAP_H
+#define MAPPED_HASH_MAP_H
+
+#include "hash_map.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+
+A read-only view of an image written by hash_map::save().
+
+load_mmap() maps the file into memory and find() probes the mapped slots and
+info bytes exactly like the robin_hood_table the image was taken from. Nothing
+is copied and nothing is allocated per entry, so opening even a huge image is
+immediate, and pages are only read in from disk as lookups touch them. Many
+processes mapping the same image share the same physical pages.
+
+The image must come from a build with the same value_type layout and the same
+Hash; load_mmap() checks what it can, the sizes, alignment, byte order and
+bounds, and throws std::runtime_error otherwise.
+
+File
+----
+[0]            snapshot_header
+[slotsOffset]  slot[slotCount]    { key, value } or zeroes
+[infoOffset]   uint8_t[slotCount + 1]
+
+*/
+
+namespace rstd
+{
+
+  template< typename K, typename T, typename Hash = hash<K>, typename KeyEqual = std::equal_to<K> >
+  class mapped_hash_map
+  {
+
+  public:
+
+    using key_type = K;
+    using mapped_type = T;
+    using value_type = std::pair<const K, T>;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+
+    static_assert( std::is_trivially_copyable<K>::value && std::is_trivially_copyable<T>::value, "rstd::mapped_hash_map needs trivially copyable keys and values" );
+
+  private:
+
+    //! The start of the mapping, or nullptr when nothing is mapped.
+    const unsigned char* _base = nullptr;
+
+    //! The length of the mapping in bytes.
+    size_t _length = 0;
+
+#ifdef _WIN32
+    HANDLE _mapping = nullptr;
+#endif
+
+    const value_type* _slots = nullptr;
+    const uint8_t* _info = nullptr;
+
+    uint32_t _mask = 0;
+    uint32_t _bucketCount = 0;
+    uint32_t _slotCount = 0;
+    uint32_t _elementCount = 0;
+
+    Hash _hasher;
+    KeyEqual _keyEqual;
+
+  public:
+
+    friend void swap( mapped_hash_map& map1, mapped_hash_map& map2 ) noexcept {
+      using std::swap;
+      swap( map1._base, map2._base );
+      swap( map1._length, map2._length );
+#ifdef _WIN32
+      swap( map1._mapping, map2._mapping );
+#endif
+      swap( map1._slots, map2._slots );
+      swap( map1._info, map2._info );
+      swap( map1._mask, map2._mask );
+      swap( map1._bucketCount, map2._bucketCount );
+      swap( map1._slotCount, map2._slotCount );
+      swap( map1._elementCount, map2._elementCount );
+      swap( map1._hasher, map2._hasher );
+      swap( map1._keyEqual, map2._keyEqual );
+    }
+
+    //! An empty view, mapping nothing.
+    explicit mapped_hash_map( const Hash& hasher = Hash(), const KeyEqual& keyEqual = KeyEqual() ) :
+      _hasher( hasher ),
+      _keyEqual( keyEqual ) {}
+
+    //! Maps the image at path. Throws std::runtime_error if it cannot be mapped or was not written for this map type.
+    explicit mapped_hash_map( const std::string& path, const Hash& hasher = Hash(), const KeyEqual& keyEqual = KeyEqual() ) :
+      _hasher( hasher ),
+      _keyEqual( keyEqual ) {
+
+      mapFile( path );
+
+      try {
+        validate( path );
+      }
+      catch ( ... ) {
+        unmap();
+        throw;
+      }
+    }
+
+    mapped_hash_map( const mapped_hash_map& other ) = delete;
+    mapped_hash_map& operator=( const mapped_hash_map& other ) = delete;
+
+    mapped_hash_map( mapped_hash_map&& other ) noexcept :
+      _hasher( other._hasher ),
+      _keyEqual( other._keyEqual ) {
+      swap( *this, other );
+    }
+
+    mapped_hash_map& operator=( mapped_hash_map&& other ) noexcept {
+      mapped_hash_map moved( std::move( other ) );
+      swap( *this, moved );
+      return *this;
+    }
+
+    virtual ~mapped_hash_map() {
+      unmap();
+    }
+
+    //! Returns the value stored at the key inside the mapping, or nullptr.
+    const T* find( const K& rawKey ) const {
+
+      if ( _info == nullptr ) {
+        return nullptr;
+      }
+
+      // The same probe as robin_hood_table::findIndex().
+      uint32_t index = (uint32_t) ( _hasher( rawKey ) & _mask );
+      uint32_t distance = 1;
+
+      while ( _info[index] >= distance ) {
+        if ( _info[index] == distance && _keyEqual( _slots[index].first, rawKey ) ) {
+          return &( _slots[index].second );
+        }
+        index++;
+        distance++;
+      }
+
+      return nullptr;
+    }
+
+    bool contains( const K& rawKey ) const {
+      return find( rawKey ) != nullptr;
+    }
+
+    uint32_t count( const K& rawKey ) const {
+      return contains( rawKey ) ? 1 : 0;
+    }
+
+    //! Returns the value stored at the key. Throws std::out_of_range if it is not there.
+    const T& at( const K& rawKey ) const {
+      const T* found = find( rawKey );
+      if ( found == nullptr ) {
+        throw std::out_of_range( "rstd::mapped_hash_map::at: key not found" );
+      }
+      return *found;
+    }
+
+    //! Calls f( const value_type& ) on every element, in slot order.
+    template< typename F >
+    void for_each( F&& f ) const {
+      for ( uint32_t i = 0; i < _slotCount; i++ ) {
+        if ( _info[i] != 0 ) {
+          f( _slots[i] );
+        }
+      }
+    }
+
+    uint32_t size() const {
+      return _elementCount;
+    }
+
+    bool empty() const {
+      return _elementCount == 0;
+    }
+
+    uint32_t bucketCount() const {
+      return _bucketCount;
+    }
+
+    //! Checks whether an image is mapped.
+    bool is_mapped() const {
+      return _base != nullptr;
+    }
+
+    //! Returns the bytes of the mapping.
+    size_t mapped_bytes() const {
+      return _length;
+    }
+
+  private:
+
+    void mapFile( const std::string& path ) {
+
+#ifdef _WIN32
+      HANDLE file = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+      if ( file == INVALID_HANDLE_VALUE ) {
+        throw std::runtime_error( "rstd::mapped_hash_map: cannot open " + path );
+      }
+
+      LARGE_INTEGER fileSize;
+      if ( !GetFileSizeEx( file, &fileSize ) || fileSize.QuadPart == 0 ) {
+        CloseHandle( file );
+        throw std::runtime_error( "rstd::mapped_hash_map: cannot map " + path );
+      }
+
+      _mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+      CloseHandle( file );
+      if ( _mapping == nullptr ) {
+        throw std::runtime_error( "rstd::mapped_hash_map: cannot map " + path );
+      }
+
+      void* view = MapViewOfFile( _mapping, FILE_MAP_READ, 0, 0, 0 );
+      if ( view == nullptr ) {
+        CloseHandle( _mapping );
+        _mapping = nullptr;
+        throw std::runtime_error( "rstd::mapped_hash_map: cannot map " + path );
+      }
+
+      _base = static_cast<const unsigned char*>( view );
+      _length = (size_t) fileSize.QuadPart;
+#else
+      int file = ::open( path.c_str(), O_RDONLY );
+      if ( file < 0 ) {
+        throw std::runtime_error( "rstd::mapped_hash_map: cannot open " + path );
+      }
+
+      struct stat status;
+      if ( ::fstat( file, &status ) != 0 || status.st_size == 0 ) {
+        ::close( file );
+        throw std::runtime_error( "rstd::mapped_hash_map: cannot map " + path );
+      }
+
+      // The mapping stays valid once the descriptor is closed.
+      void* view = ::mmap( nullptr, (size_t) status.st_size, PROT_READ, MAP_SHARED, file, 0 );
+      ::close( file );
+      if ( view == MAP_FAILED ) {
+        throw std::runtime_error( "rstd::mapped_hash_map: cannot map " + path );
+      }
+
+      _base = static_cast<const unsigned char*>( view );
+      _length = (size_t) status.st_size;
+#endif
+    }
+
+    //! Checks the header against this map type and the file, and points the view into the mapping.
+    void validate( const std::string& path ) {
+
+      snapshot_header header;
+      if ( _length < sizeof( header ) ) {
+        throw std::runtime_error( "rstd::mapped_hash_map: " + path + " is not a hash_map image" );
+      }
+      memcpy( &header, _base, sizeof( header ) );
+
+      if ( memcmp( header.magic, snapshotMagic, sizeof( snapshotMagic ) ) != 0 || header.version != snapshotVersion ) {
+        throw std::runtime_error( "rstd::mapped_hash_map: " + path + " is not a hash_map image" );
+      }
+
+      if ( header.byteOrder != snapshotByteOrder || header.elementBytes != sizeof( value_type ) || header.elementAlign != alignof( value_type )
+        || header.keyBytes != sizeof( K ) || header.mappedBytes != sizeof( T ) ) {
+        throw std::runtime_error( "rstd::mapped_hash_map: " + path + " was written for another element layout" );
+      }
+
+      // The probe relies on the bucket mask and on the sentinel ending every run inside the file.
+      bool powerOfTwo = header.bucketCount != 0 && ( header.bucketCount & ( header.bucketCount - 1 ) ) == 0;
+      bool bounded = header.slotsOffset % alignof( value_type ) == 0
+        && header.infoOffset == header.slotsOffset + (uint64_t) header.slotCount * sizeof( value_type )
+        && header.fileBytes == header.infoOffset + header.slotCount + 1
+        && header.fileBytes <= _length
+        && header.slotCount >= header.bucketCount
+        && header.elementCount <= header.slotCount;
+
+      if ( !powerOfTwo || !bounded || _base[header.infoOffset + header.slotCount] != 0 ) {
+        throw std::runtime_error( "rstd::mapped_hash_map: " + path + " is truncated or corrupt" );
+      }
+
+      _slots = reinterpret_cast<const value_type*>( _base + header.slotsOffset );
+      _info = _base + header.infoOffset;
+      _mask = header.bucketCount - 1;
+      _bucketCount = header.bucketCount;
+      _slotCount = header.slotCount;
+      _elementCount = header.elementCount;
+    }
+
+    void unmap() {
+
+      if ( _base == nullptr ) {
+        return;
+      }
+
+#ifdef _WIN32
+      UnmapViewOfFile( _base );
+      CloseHandle( _mapping );
+      _mapping = nullptr;
+#else
+      ::munmap( const_cast<unsigned char*>( _base ), _length );
+#endif
+
+      _base = nullptr;
+      _length = 0;
+      _slots = nullptr;
+      _info = nullptr;
+      _slotCount = 0;
+      _elementCount = 0;
+    }
+
+  };
+
+  //! Maps the image hash_map::save() wrote at path. Throws std::runtime_error if it cannot be used.
+  template< typename K, typename T, typename Hash = hash<K>, typename KeyEqual = std::equal_to<K> >
+  mapped_hash_map<K, T, Hash, KeyEqual> load_mmap( const std::string& path, const Hash& hasher = Hash(), const KeyEqual& keyEqual = KeyEqual() ) {
+    return mapped_hash_map<K, T, Hash, KeyEqual>( path, hasher, keyEqual );
+  }
+
+}
+
+#endif // MAPPED_HASH_MAP_H
@@ -0,0 +1,241 @@
+#ifndef POOL_ALLOCATOR_H
+#define POOL_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+/*
+
+A slab allocator for the many same-sized blocks a hash_map asks for, such as
+the elements of a map using boxed_storage.
+
+Small requests are rounded up to a size class and carved out of large slabs
+with a bump pointer. Freed blocks go onto a free list per size class and are
+handed out again before the slab is bumped any further, so a map that keeps
+erasing and inserting never goes back to the system allocator. Requests larger
+than maxPooledSize, like the table block itself, are passed on to operator new.
+The slabs are only returned all at once, when the pool_resource is destroyed
+or release() is called.
+
+A pool_resource is not thread-safe. The intended use is one pool per map, which
+is what a default constructed pool_allocator gives, so that maps used from
+different threads never share an allocator.
+
+Size class free lists      Slabs
+---------------------      -----
+[16]  -> block -> nullptr  slab -> slab -> nullptr
+[32]  -> nullptr
+[48]  -> block -> block -> nullptr
+...
+
+*/
+
+namespace rstd
+{
+
+  class pool_resource final
+  {
+
+  public:
+
+    //! Requests up to this many bytes are served from slabs.
+    static constexpr size_t maxPooledSize = 256;
+
+    //! Spacing of the size classes, and the alignment of every pooled block.
+    static constexpr size_t granularity = alignof( std::max_align_t );
+
+    //! The size of a single slab in bytes.
+    static constexpr size_t slabSize = 64 * 1024;
+
+  private:
+
+    //! A freed block, linked into the free list of its size class.
+    struct free_block
+    {
+      free_block* next;
+    };
+
+    //! Header at the start of every slab, linking all slabs for release().
+    struct slab_header
+    {
+      slab_header* next;
+    };
+
+    //! The free list of each size class.
+    free_block* _freeLists[maxPooledSize / granularity] = {};
+
+    //! Every slab allocated so far, newest first.
+    slab_header* _slabs = nullptr;
+
+    //! The unused part of the newest slab.
+    unsigned char* _cursor = nullptr;
+    unsigned char* _end = nullptr;
+
+    //! The number of slabs currently held.
+    size_t _slabCount = 0;
+
+  public:
+
+    pool_resource() = default;
+    pool_resource( const pool_resource& other ) = delete;
+    pool_resource& operator=( const pool_resource& other ) = delete;
+
+    ~pool_resource() {
+      release();
+    }
+
+    void* allocate( size_t bytes, size_t alignment ) {
+
+      if ( bytes > maxPooledSize || alignment > granularity ) {
+        return alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__
+          ? ::operator new( bytes, std::align_val_t( alignment ) )
+          : ::operator new( bytes );
+      }
+
+      size_t sizeClass = sizeClassOf( bytes );
+      free_block* block = _freeLists[sizeClass];
+
+      if ( block != nullptr ) {
+        _freeLists[sizeClass] = block->next;
+        return block;
+      }
+
+      size_t blockSize = ( sizeClass + 1 ) * granularity;
+      if ( (size_t) ( _end - _cursor ) < blockSize ) {
+        addSlab();
+      }
+
+      void* result = _cursor;
+      _cursor += blockSize;
+      return result;
+    }
+
+    void deallocate( void* pointer, size_t bytes, size_t alignment ) {
+
+      if ( bytes > maxPooledSize || alignment > granularity ) {
+        if ( alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__ ) {
+          ::operator delete( pointer, std::align_val_t( alignment ) );
+        }
+        else {
+          ::operator delete( pointer );
+        }
+        return;
+      }
+
+      size_t sizeClass = sizeClassOf( bytes );
+      free_block* block = static_cast<free_block*>( pointer );
+      block->next = _freeLists[sizeClass];
+      _freeLists[sizeClass] = block;
+    }
+
+    //! Frees every slab at once. Any block still handed out from them becomes invalid.
+    void release() {
+
+      while ( _slabs != nullptr ) {
+        slab_header* next = _slabs->next;
+        ::operator delete( _slabs );
+        _slabs = next;
+      }
+
+      for ( free_block*& list : _freeLists ) {
+        list = nullptr;
+      }
+
+      _cursor = nullptr;
+      _end = nullptr;
+      _slabCount = 0;
+    }
+
+    //! Returns the number of bytes held in slabs, whether handed out or not.
+    size_t slabBytes() const {
+      return _slabCount * slabSize;
+    }
+
+  private:
+
+    static size_t sizeClassOf( size_t bytes ) {
+      return bytes == 0 ? 0 : ( bytes - 1 ) / granularity;
+    }
+
+    void addSlab() {
+
+      slab_header* slab = static_cast<slab_header*>( ::operator new( slabSize ) );
+      slab->next = _slabs;
+      _slabs = slab;
+      _slabCount++;
+
+      _cursor = reinterpret_cast<unsigned char*>( slab ) + granularity;
+      _end = reinterpret_cast<unsigned char*>( slab ) + slabSize;
+    }
+
+  };
+
+  /*
+  A standard allocator drawing from a shared pool_resource.
+  Copies and rebound copies share the pool and compare equal. A default
+  constructed allocator, and the one a copied container selects, gets a
+  pool of its own.
+  */
+  template< typename T >
+  class pool_allocator
+  {
+
+  public:
+
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+  private:
+
+    template< typename U >
+    friend class pool_allocator;
+
+    //! The pool shared by every copy of this allocator.
+    std::shared_ptr<pool_resource> _resource;
+
+  public:
+
+    pool_allocator() :
+      _resource( std::make_shared<pool_resource>() ) {}
+
+    template< typename U >
+    pool_allocator( const pool_allocator<U>& other ) noexcept :
+      _resource( other._resource ) {}
+
+    T* allocate( size_t count ) {
+      return static_cast<T*>( _resource->allocate( count * sizeof( T ), alignof( T ) ) );
+    }
+
+    void deallocate( T* pointer, size_t count ) noexcept {
+      _resource->deallocate( pointer, count * sizeof( T ), alignof( T ) );
+    }
+
+    //! Copied containers get a fresh pool rather than sharing this one.
+    pool_allocator select_on_container_copy_construction() const {
+      return pool_allocator();
+    }
+
+    //! Returns the pool this allocator draws from.
+    pool_resource& resource() const {
+      return *_resource;
+    }
+
+    template< typename U >
+    bool operator==( const pool_allocator<U>& other ) const noexcept {
+      return _resource == other._resource;
+    }
+
+    template< typename U >
+    bool operator!=( const pool_allocator<U>& other ) const noexcept {
+      return _resource != other._resource;
+    }
+
+  };
+
+}
+
+#endif // POOL_ALLOCATOR_H
@@ -0,0 +1,524 @@
+#ifndef READ_MOSTLY_HASH_MAP_H
+#define READ_MOSTLY_HASH_MAP_H
+
+#include "hash_map.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*
+
+A hash map for read-mostly data shared between threads, such as configuration
+or routing tables, where lookups must never wait.
+
+The data is organized like the original rstd::hash_map: an array of heads of
+linked lists, one per hashed index. Here the heads and the links are atomic
+pointers and a node never changes once it is published. Readers only load
+pointers, so find() is wait-free: it finishes in a bounded number of steps no
+matter what other threads do, and never takes a lock.
+
+Writers are serialized by a mutex, since updates are rare, and publish every
+change with a single atomic store. Inserting links a new node in front of the
+head. Assigning links a copy of the node in place of the old one. Erasing
+links past the node. Growing builds a whole new array of copied nodes off to
+the side, then swaps it in with one store, so readers keep using the old array
+until they are done and never block behind a rehash. Since readers may still
+be reading the old nodes, their values are copied rather than moved, so T
+must be copy constructible.
+
+Nodes and arrays come from the Allocator, rebound to each. Unlinked ones may
+still be in use by readers, so they are retired rather than deallocated.
+Readers announce themselves in one of two epochs, on counters striped over
+cache lines. Before freeing retired memory, a writer flips the epoch and waits
+until no reader is left in the previous one, which proves nobody can still
+hold a pointer to it.
+
+Hashed Index -> First node of the linked list.
+-------------
+[0] -> nullptr
+[1] -> node -> nullptr
+[2] -> node -> node -> nullptr
+...
+
+*/
+
+namespace rstd
+{
+
+  template< typename K, typename T, typename Hash = hash<K>, typename KeyEqual = std::equal_to<K>, typename Allocator = std::allocator<std::pair<const K, T>> >
+  class read_mostly_hash_map
+  {
+
+  public:
+
+    using key_type = K;
+    using mapped_type = T;
+    using value_type = std::pair<const K, T>;
+
+    //! The number of retired nodes that makes a writer wait for readers and free them.
+    static constexpr size_t retireBatch = 128;
+
+    static_assert( std::is_copy_constructible<value_type>::value, "rstd::read_mostly_hash_map copies its elements on growing, so K and T must be copy constructible" );
+
+  private:
+
+    //! An immutable element, linked into the list of its hashed index.
+    struct node
+    {
+      std::atomic<node*> next;
+      size_t hash;
+      value_type value;
+
+      template< typename... Args >
+      node( node* nextNode, size_t keyHash, Args&&... args ) :
+        next( nextNode ),
+        hash( keyHash ),
+        value( std::forward<Args>( args )... ) {}
+    };
+
+    using node_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<node>;
+
+    //! The heads of all linked lists, allocated along with createArray().
+    struct bucket_array
+    {
+      uint32_t mask;
+      std::atomic<node*>* heads;
+    };
+
+    using array_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<bucket_array>;
+    using head_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<std::atomic<node*>>;
+
+    //! The number of striped reader counters.
+    static constexpr uint32_t readerStripes = 16;
+
+    //! Reader counts of both epochs, on a cache line of their own.
+    struct alignas( 64 ) reader_stripe
+    {
+      std::atomic<int64_t> active[2];
+    };
+
+    //! The current array of heads. Swapped as a whole by rehashing.
+    std::atomic<bucket_array*> _buckets;
+
+    std::atomic<uint32_t> _elementCount{ 0 };
+
+    //! Parity selects the reader counter new readers announce themselves on.
+    std::atomic<uint32_t> _epoch{ 0 };
+
+    mutable reader_stripe _readers[readerStripes];
+
+    //! Serializes writers.
+    std::mutex _writeLock;
+
+    //! Memory unlinked by writers that readers may still see.
+    std::vector<node*> _retiredNodes;
+    std::vector<bucket_array*> _retiredArrays;
+
+    Hash _hasher;
+    KeyEqual _keyEqual;
+    node_allocator _allocator;
+
+    //! Registers a reader on the current epoch for its lifetime.
+    class read_guard final
+    {
+
+    private:
+
+      std::atomic<int64_t>* _counter;
+
+    public:
+
+      explicit read_guard( const read_mostly_hash_map& map ) {
+        uint32_t epoch = map._epoch.load( std::memory_order_relaxed ) & 1;
+        _counter = &( map._readers[stripeOfThisThread()].active[epoch] );
+        _counter->fetch_add( 1, std::memory_order_relaxed );
+        // Pairs with the fence in waitForReaders(): either the writer sees this reader, or this reader sees the unlink.
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+      }
+
+      read_guard( const read_guard& other ) = delete;
+      read_guard& operator=( const read_guard& other ) = delete;
+
+      ~read_guard() {
+        _counter->fetch_sub( 1, std::memory_order_release );
+      }
+
+    };
+
+  public:
+
+    explicit read_mostly_hash_map( uint32_t storageSize = 256, const Hash& hasher = Hash(), const KeyEqual& keyEqual = KeyEqual(), const Allocator& alloc = Allocator() ) :
+      _hasher( hasher ),
+      _keyEqual( keyEqual ),
+      _allocator( alloc ) {
+
+      uint32_t bucketCount = 1;
+      while ( bucketCount < storageSize && bucketCount < 0x80000000u ) {
+        bucketCount <<= 1;
+      }
+
+      _buckets.store( createArray( bucketCount ), std::memory_order_relaxed );
+      for ( reader_stripe& stripe : _readers ) {
+        stripe.active[0].store( 0, std::memory_order_relaxed );
+        stripe.active[1].store( 0, std::memory_order_relaxed );
+      }
+    }
+
+    read_mostly_hash_map( const read_mostly_hash_map& other ) = delete;
+    read_mostly_hash_map& operator=( const read_mostly_hash_map& other ) = delete;
+
+    //! No other thread may use the map anymore.
+    virtual ~read_mostly_hash_map() {
+      bucket_array* buckets = _buckets.load( std::memory_order_relaxed );
+      freeChains( buckets );
+      destroyArray( buckets );
+      freeRetired();
+    }
+
+    //! Calls f( const T& ) on the value stored at the key. Wait-free. Returns whether it was found.
+    template< typename F >
+    bool visit( const K& rawKey, F&& f ) const {
+
+      read_guard guard( *this );
+      const node* found = findNode( rawKey, _hasher( rawKey ) );
+
+      if ( found != nullptr ) {
+        f( found->value.second );
+      }
+      return found != nullptr;
+    }
+
+    //! Returns a copy of the value stored at the key, if any. Wait-free.
+    std::optional<T> find( const K& rawKey ) const {
+      std::optional<T> result;
+      visit( rawKey, [&result]( const T& value ) { result.emplace( value ); } );
+      return result;
+    }
+
+    //! Wait-free.
+    bool contains( const K& rawKey ) const {
+      read_guard guard( *this );
+      return findNode( rawKey, _hasher( rawKey ) ) != nullptr;
+    }
+
+    //! Inserts the value, or replaces the one already stored. Returns whether it was inserted.
+    template< typename M >
+    bool insert_or_assign( const K& rawKey, M&& value ) {
+
+      std::lock_guard<std::mutex> guard( _writeLock );
+
+      size_t hash = _hasher( rawKey );
+      bucket_array* buckets = _buckets.load( std::memory_order_relaxed );
+      std::atomic<node*>* link = &( buckets->heads[hash & buckets->mask] );
+
+      for ( node* cur = link->load( std::memory_order_relaxed ); cur != nullptr; cur = cur->next.load( std::memory_order_relaxed ) ) {
+
+        if ( cur->hash == hash && _keyEqual( cur->value.first, rawKey ) ) {
+          node* replacement = createNode( cur->next.load( std::memory_order_relaxed ), hash, rawKey, std::forward<M>( value ) );
+          link->store( replacement, std::memory_order_release );
+          retire( cur );
+          return false;
+        }
+
+        link = &( cur->next );
+      }
+
+      pushFront( buckets, hash, rawKey, std::forward<M>( value ) );
+      return true;
+    }
+
+    //! Constructs the value from args if the key is missing. Returns whether it was inserted.
+    template< typename... Args >
+    bool try_emplace( const K& rawKey, Args&&... args ) {
+
+      std::lock_guard<std::mutex> guard( _writeLock );
+
+      size_t hash = _hasher( rawKey );
+      bucket_array* buckets = _buckets.load( std::memory_order_relaxed );
+
+      if ( findNode( buckets, rawKey, hash ) != nullptr ) {
+        return false;
+      }
+
+      pushFront( buckets, hash, std::piecewise_construct, std::forward_as_tuple( rawKey ), std::forward_as_tuple( std::forward<Args>( args )... ) );
+      return true;
+    }
+
+    //! Erases the key. Returns whether it was present.
+    bool erase( const K& rawKey ) {
+
+      std::lock_guard<std::mutex> guard( _writeLock );
+
+      size_t hash = _hasher( rawKey );
+      bucket_array* buckets = _buckets.load( std::memory_order_relaxed );
+      std::atomic<node*>* link = &( buckets->heads[hash & buckets->mask] );
+
+      for ( node* cur = link->load( std::memory_order_relaxed ); cur != nullptr; cur = cur->next.load( std::memory_order_relaxed ) ) {
+
+        if ( cur->hash == hash && _keyEqual( cur->value.first, rawKey ) ) {
+          // Readers standing on cur still find their way on through its unchanged next pointer.
+          link->store( cur->next.load( std::memory_order_relaxed ), std::memory_order_release );
+          _elementCount.fetch_sub( 1, std::memory_order_relaxed );
+          retire( cur );
+          return true;
+        }
+
+        link = &( cur->next );
+      }
+
+      return false;
+    }
+
+    //! Swaps in an empty array of the same size and retires every node.
+    void clear() {
+
+      std::lock_guard<std::mutex> guard( _writeLock );
+
+      bucket_array* buckets = _buckets.load( std::memory_order_relaxed );
+      _buckets.store( createArray( buckets->mask + 1 ), std::memory_order_release );
+      _elementCount.store( 0, std::memory_order_relaxed );
+      retireChains( buckets );
+    }
+
+    //! Grows the array of heads to hold elementCount elements at one per list.
+    void reserve( uint32_t elementCount ) {
+      std::lock_guard<std::mutex> guard( _writeLock );
+      if ( elementCount > _buckets.load( std::memory_order_relaxed )->mask + 1 ) {
+        rehash( elementCount );
+      }
+    }
+
+    //! Waits for the readers that may still see retired memory, then frees it.
+    void reclaim() {
+      std::lock_guard<std::mutex> guard( _writeLock );
+      reclaimRetired();
+    }
+
+    uint32_t size() const {
+      return _elementCount.load( std::memory_order_relaxed );
+    }
+
+    bool empty() const {
+      return size() == 0;
+    }
+
+    uint32_t bucketCount() const {
+      return _buckets.load( std::memory_order_acquire )->mask + 1;
+    }
+
+  private:
+
+    //! Spreads threads over the reader counters.
+    static uint32_t stripeOfThisThread() {
+      static std::atomic<uint32_t> nextStripe{ 0 };
+      thread_local uint32_t stripe = nextStripe.fetch_add( 1, std::memory_order_relaxed ) % readerStripes;
+      return stripe;
+    }
+
+    const node* findNode( const K& rawKey, size_t hash ) const {
+      return findNode( _buckets.load( std::memory_order_acquire ), rawKey, hash );
+    }
+
+    const node* findNode( const bucket_array* buckets, const K& rawKey, size_t hash ) const {
+
+      const node* cur = buckets->heads[hash & buckets->mask].load( std::memory_order_acquire );
+
+      while ( cur != nullptr ) {
+        if ( cur->hash == hash && _keyEqual( cur->value.first, rawKey ) ) {
+          return cur;
+        }
+        cur = cur->next.load( std::memory_order_acquire );
+      }
+
+      return nullptr;
+    }
+
+    template< typename... Args >
+    node* createNode( node* next, size_t hash, Args&&... args ) {
+
+      node* created = std::allocator_traits<node_allocator>::allocate( _allocator, 1 );
+
+      try {
+        ::new ( created ) node( next, hash, std::forward<Args>( args )... );
+      }
+      catch ( ... ) {
+        std::allocator_traits<node_allocator>::deallocate( _allocator, created, 1 );
+        throw;
+      }
+
+      return created;
+    }
+
+    void destroyNode( node* dead ) {
+      dead->~node();
+      std::allocator_traits<node_allocator>::deallocate( _allocator, dead, 1 );
+    }
+
+    //! Allocates an array of bucketCount empty lists.
+    bucket_array* createArray( uint32_t bucketCount ) {
+
+      array_allocator arrays( _allocator );
+      head_allocator heads( _allocator );
+
+      std::atomic<node*>* createdHeads = std::allocator_traits<head_allocator>::allocate( heads, bucketCount );
+      for ( uint32_t i = 0; i < bucketCount; i++ ) {
+        ::new ( &( createdHeads[i] ) ) std::atomic<node*>( nullptr );
+      }
+
+      bucket_array* created;
+      try {
+        created = std::allocator_traits<array_allocator>::allocate( arrays, 1 );
+      }
+      catch ( ... ) {
+        std::allocator_traits<head_allocator>::deallocate( heads, createdHeads, bucketCount );
+        throw;
+      }
+
+      return ::new ( created ) bucket_array{ bucketCount - 1, createdHeads };
+    }
+
+    //! Frees an array, but none of the nodes linked from it.
+    void destroyArray( bucket_array* dead ) {
+
+      array_allocator arrays( _allocator );
+      head_allocator heads( _allocator );
+
+      // std::atomic of a pointer is trivially destructible, so the heads need no destructor calls.
+      std::allocator_traits<head_allocator>::deallocate( heads, dead->heads, (size_t) dead->mask + 1 );
+      std::allocator_traits<array_allocator>::deallocate( arrays, dead, 1 );
+    }
+
+    //! Links a new node in front of its list, growing first if the lists got too long.
+    template< typename... Args >
+    void pushFront( bucket_array* buckets, size_t hash, Args&&... args ) {
+
+      if ( _elementCount.load( std::memory_order_relaxed ) + 1 > buckets->mask + 1 ) {
+        rehash( ( buckets->mask + 1 ) * 2 );
+        buckets = _buckets.load( std::memory_order_relaxed );
+      }
+
+      std::atomic<node*>& head = buckets->heads[hash & buckets->mask];
+      node* created = createNode( head.load( std::memory_order_relaxed ), hash, std::forward<Args>( args )... );
+      head.store( created, std::memory_order_release );
+      _elementCount.fetch_add( 1, std::memory_order_relaxed );
+    }
+
+    //! Builds a new array of copied nodes off to the side and swaps it in.
+    void rehash( uint32_t bucketCount ) {
+
+      uint32_t rounded = 1;
+      while ( rounded < bucketCount && rounded < 0x80000000u ) {
+        rounded <<= 1;
+      }
+
+      bucket_array* old = _buckets.load( std::memory_order_relaxed );
+      bucket_array* resized = createArray( rounded );
+
+      // Nodes are copied, neither relinked nor moved from, as readers may still be walking the old lists.
+      try {
+        for ( uint32_t i = 0; i <= old->mask; i++ ) {
+          for ( node* cur = old->heads[i].load( std::memory_order_relaxed ); cur != nullptr; cur = cur->next.load( std::memory_order_relaxed ) ) {
+            std::atomic<node*>& head = resized->heads[cur->hash & resized->mask];
+            head.store( createNode( head.load( std::memory_order_relaxed ), cur->hash, cur->value ), std::memory_order_relaxed );
+          }
+        }
+      }
+      catch ( ... ) {
+        freeChains( resized );
+        destroyArray( resized );
+        throw;
+      }
+
+      _buckets.store( resized, std::memory_order_release );
+      retireChains( old );
+    }
+
+    void retire( node* dead ) {
+      _retiredNodes.push_back( dead );
+      if ( _retiredNodes.size() >= retireBatch ) {
+        reclaimRetired();
+      }
+    }
+
+    //! Retires a whole array along with every node linked from it.
+    void retireChains( bucket_array* buckets ) {
+
+      for ( uint32_t i = 0; i <= buckets->mask; i++ ) {
+        for ( node* cur = buckets->heads[i].load( std::memory_order_relaxed ); cur != nullptr; cur = cur->next.load( std::memory_order_relaxed ) ) {
+          _retiredNodes.push_back( cur );
+        }
+      }
+
+      _retiredArrays.push_back( buckets );
+      reclaimRetired();
+    }
+
+    //! Blocks until no reader announced on the given epoch parity is left.
+    void waitForReaders( uint32_t parity ) const {
+
+      std::atomic_thread_fence( std::memory_order_seq_cst );
+
+      while ( true ) {
+
+        int64_t active = 0;
+        for ( const reader_stripe& stripe : _readers ) {
+          active += stripe.active[parity].load( std::memory_order_acquire );
+        }
+
+        if ( active == 0 ) {
+          return;
+        }
+        std::this_thread::yield();
+      }
+    }
+
+    /*
+    Waits out every reader that may have seen the retired memory, then frees it.
+    Readers still counted on the previous epoch are drained first, then the
+    epoch flips and the readers of the current one are drained.
+    */
+    void reclaimRetired() {
+
+      uint32_t epoch = _epoch.load( std::memory_order_relaxed );
+      waitForReaders( ( epoch + 1 ) & 1 );
+      _epoch.store( epoch + 1, std::memory_order_seq_cst );
+      waitForReaders( epoch & 1 );
+
+      freeRetired();
+    }
+
+    void freeRetired() {
+
+      for ( node* dead : _retiredNodes ) {
+        destroyNode( dead );
+      }
+      for ( bucket_array* dead : _retiredArrays ) {
+        destroyArray( dead );
+      }
+
+      _retiredNodes.clear();
+      _retiredArrays.clear();
+    }
+
+    void freeChains( bucket_array* buckets ) {
+      for ( uint32_t i = 0; i <= buckets->mask; i++ ) {
+        node* cur = buckets->heads[i].load( std::memory_order_relaxed );
+        while ( cur != nullptr ) {
+          node* next = cur->next.load( std::memory_order_relaxed );
+          destroyNode( cur );
+          cur = next;
+        }
+      }
+    }
+
+  };
+
+}
+
+#endif // READ_MOSTLY_HASH_MAP_H
@@ -0,0 +1,186 @@
+#ifndef STATIC_HASH_MAP_H
+#define STATIC_HASH_MAP_H
+
+#include "hash_map.h"
+
+#include <array>
+#include <initializer_list>
+
+/*
+
+A fixed capacity hash map that lives entirely inside the object and can be
+built and searched at compile time, for small static tables such as opcode
+dispatch or enum to handler mappings.
+
+Capacity is the most elements the map takes. The slots, twice as many rounded
+up to a power of two, are std::arrays of keys, values and occupancy flags, so
+the map never allocates, and a constexpr instance ends up in read-only data
+instead of being built at startup. Lookups probe linearly from the home slot
+and stop at the first empty one; the table is at most half full, so that
+takes one or two slots. Elements cannot be erased.
+
+Every operation is constexpr, as long as Hash and KeyEqual are. rstd::hash is
+for integral and enum keys; string keys need a constexpr hash of their own.
+Keys and values must be default constructible, and literal types to be used
+in constant expressions.
+
+*/
+
+namespace rstd
+{
+
+  template< typename K, typename T, size_t Capacity, typename Hash = hash<K>, typename KeyEqual = std::equal_to<K> >
+  class static_hash_map
+  {
+
+  public:
+
+    using key_type = K;
+    using mapped_type = T;
+    using hasher = Hash;
+    using key_equal = KeyEqual;
+
+    static_assert( Capacity > 0, "rstd::static_hash_map needs a capacity" );
+    static_assert( Capacity <= 0x40000000u, "rstd::static_hash_map capacity is too big to be static" );
+
+  private:
+
+    //! Twice the capacity, rounded up to a power of two.
+    static constexpr size_t slotCountFor( size_t capacity ) {
+      size_t slots = 1;
+      while ( slots < capacity * 2 ) {
+        slots <<= 1;
+      }
+      return slots;
+    }
+
+  public:
+
+    //! The number of slots, keeping the table at most half full.
+    static constexpr size_t slot_count = slotCountFor( Capacity );
+
+  private:
+
+    std::array<K, slot_count> _keys{};
+    std::array<T, slot_count> _values{};
+    std::array<bool, slot_count> _occupied{};
+
+    size_t _elementCount = 0;
+
+    Hash _hasher;
+    KeyEqual _keyEqual;
+
+  public:
+
+    constexpr static_hash_map() = default;
+
+    /*
+    Inserts every pair, later duplicates overwriting earlier ones. Throws
+    std::length_error past Capacity, which fails compilation in a constant
+    expression.
+    */
+    constexpr static_hash_map( std::initializer_list<std::pair<K, T>> entries, const Hash& hasher = Hash(), const KeyEqual& keyEqual = KeyEqual() ) :
+      _hasher( hasher ),
+      _keyEqual( keyEqual ) {
+
+      for ( const std::pair<K, T>& entry : entries ) {
+        insert_or_assign( entry.first, entry.second );
+      }
+    }
+
+    //! Inserts the value, or assigns it over the one already stored. Returns whether it was inserted.
+    constexpr bool insert_or_assign( const K& rawKey, const T& value ) {
+
+      size_t index = findSlot( rawKey );
+
+      if ( _occupied[index] ) {
+        _values[index] = value;
+        return false;
+      }
+
+      if ( _elementCount == Capacity ) {
+        throw std::length_error( "rstd::static_hash_map::insert_or_assign: capacity exceeded" );
+      }
+
+      _keys[index] = rawKey;
+      _values[index] = value;
+      _occupied[index] = true;
+      _elementCount++;
+      return true;
+    }
+
+    //! Returns the value stored at the key, or nullptr.
+    constexpr const T* find( const K& rawKey ) const {
+      size_t index = findSlot( rawKey );
+      return _occupied[index] ? &( _values[index] ) : nullptr;
+    }
+
+    constexpr T* find( const K& rawKey ) {
+      size_t index = findSlot( rawKey );
+      return _occupied[index] ? &( _values[index] ) : nullptr;
+    }
+
+    constexpr bool contains( const K& rawKey ) const {
+      return _occupied[findSlot( rawKey )];
+    }
+
+    constexpr size_t count( const K& rawKey ) const {
+      return contains( rawKey ) ? 1 : 0;
+    }
+
+    //! Returns the value stored at the key. Throws std::out_of_range if it is not there.
+    constexpr const T& at( const K& rawKey ) const {
+      size_t index = findSlot( rawKey );
+      if ( !_occupied[index] ) {
+        throw std::out_of_range( "rstd::static_hash_map::at: key not found" );
+      }
+      return _values[index];
+    }
+
+    //! Returns the value stored at the key, or fallback if it is not there.
+    constexpr T value_or( const K& rawKey, const T& fallback ) const {
+      size_t index = findSlot( rawKey );
+      return _occupied[index] ? _values[index] : fallback;
+    }
+
+    //! Calls f( const K&, const T& ) on every element, in slot order.
+    template< typename F >
+    constexpr void for_each( F&& f ) const {
+      for ( size_t i = 0; i < slot_count; i++ ) {
+        if ( _occupied[i] ) {
+          f( _keys[i], _values[i] );
+        }
+      }
+    }
+
+    constexpr size_t size() const {
+      return _elementCount;
+    }
+
+    constexpr bool empty() const {
+      return _elementCount == 0;
+    }
+
+    static constexpr size_t capacity() {
+      return Capacity;
+    }
+
+  private:
+
+    //! Returns the slot holding the key, or the empty slot it would go in. There always is one.
+    constexpr size_t findSlot( const K& rawKey ) const {
+
+      size_t index = _hasher( rawKey ) & ( slot_count - 1 );
+
+      while ( _occupied[index] && !_keyEqual( _keys[index], rawKey ) ) {
+        index = ( index + 1 ) & ( slot_count - 1 );
+      }
+
+      return index;
+    }
+
+  };
+
+}
+
+#endif // STATIC_HASH_MAP_H
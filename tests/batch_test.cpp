@@ -0,0 +1,168 @@
+#include "hash_map.h"
+
+#include "check.h"
+
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+
+  template< typename Storage, typename Engine >
+  struct policy : rstd::default_hash_map_policy
+  {
+    using storage = Storage;
+    using engine = Engine;
+  };
+
+  template< typename T, typename Storage, typename Engine >
+  using map_of = rstd::hash_map<int, T, rstd::hash<int>, std::equal_to<int>, std::allocator<std::pair<const int, T>>, policy<Storage, Engine>>;
+
+  template< typename T >
+  T valueOf( int index ) {
+    if constexpr ( std::is_same<T, std::string>::value ) {
+      return "value number " + std::to_string( index ) + ", long enough to allocate";
+    }
+    else {
+      return index * 3;
+    }
+  }
+
+  //! Looks every key up through both find_batch() overloads, checking each result against reference.
+  template< typename Map >
+  void checkFindBatch( Map& map, const std::vector<int>& keys, const std::unordered_map<int, typename Map::mapped_type>& reference ) {
+
+    using T = typename Map::mapped_type;
+
+    size_t expected = 0;
+    for ( int key : keys ) {
+      expected += reference.count( key );
+    }
+
+    std::vector<T*> out( keys.size() + 1, nullptr );
+    CHECK( map.find_batch( keys.data(), keys.size(), out.data() ) == expected );
+
+    std::vector<const T*> constOut( keys.size() + 1, nullptr );
+    const Map& constMap = map;
+    CHECK( constMap.find_batch( keys.data(), keys.size(), constOut.data() ) == expected );
+
+    for ( size_t i = 0; i < keys.size(); i++ ) {
+      auto found = reference.find( keys[i] );
+      if ( found == reference.end() ) {
+        CHECK( out[i] == nullptr );
+        CHECK( constOut[i] == nullptr );
+      }
+      else {
+        CHECK( out[i] != nullptr && *out[i] == found->second );
+        CHECK( out[i] == map.find( keys[i] ) );
+        CHECK( constOut[i] == out[i] );
+      }
+    }
+
+    // Nothing is written past the n results.
+    CHECK( out[keys.size()] == nullptr );
+    CHECK( constOut[keys.size()] == nullptr );
+  }
+
+  //! Inserts a batch into map and into reference, checking the count of new keys and the contents after.
+  template< typename Map >
+  void insertBatch( Map& map, const std::vector<int>& keys, const std::vector<typename Map::mapped_type>& values, std::unordered_map<int, typename Map::mapped_type>& reference ) {
+
+    size_t expected = 0;
+    for ( size_t i = 0; i < keys.size(); i++ ) {
+      expected += reference.insert_or_assign( keys[i], values[i] ).second;
+    }
+
+    CHECK( map.insert_batch( keys.data(), values.data(), keys.size() ) == expected );
+    CHECK( map.size() == reference.size() );
+    for ( const auto& entry : reference ) {
+      CHECK( map.at( entry.first ) == entry.second );
+    }
+  }
+
+  template< typename T, typename Storage, typename Engine >
+  void batches( bool incremental ) {
+
+    map_of<T, Storage, Engine> map( 16 );
+    map.incremental_rehash( incremental );
+    std::unordered_map<int, T> reference;
+
+    // Empty batches do nothing, whatever the pointers.
+    CHECK( map.insert_batch( nullptr, nullptr, 0 ) == 0 );
+    CHECK( map.find_batch( nullptr, 0, (T**) nullptr ) == 0 );
+    CHECK( map.empty() );
+
+    bool sawRehash = false;
+    for ( int round = 0; round < 40; round++ ) {
+
+      // Batches of odd lengths, mixing new keys with ones already present, and repeating keys within the batch.
+      std::vector<int> keys;
+      std::vector<T> values;
+      for ( int i = 0; i < 37 + round * 11; i++ ) {
+        keys.push_back( ( round * 97 + i * 7 ) % ( 200 + round * 50 ) );
+        values.push_back( valueOf<T>( round * 1000 + i ) );
+      }
+      keys.push_back( keys[0] );
+      values.push_back( valueOf<T>( -round ) );
+
+      insertBatch( map, keys, values, reference );
+      sawRehash = sawRehash || map.rehash_in_progress();
+
+      // Hits, misses and repeats in one batch, looked up while any incremental rehash is still going.
+      std::vector<int> lookups = keys;
+      for ( int i = 0; i < 50; i++ ) {
+        lookups.push_back( 100000 + i );
+        lookups.push_back( keys[(size_t) i % keys.size()] );
+      }
+      checkFindBatch( map, lookups, reference );
+    }
+    CHECK( sawRehash == incremental );
+
+    // A batch of misses only.
+    std::vector<int> misses;
+    for ( int key = -1; key > -200; key-- ) {
+      misses.push_back( key );
+    }
+    checkFindBatch( map, misses, reference );
+
+    // A batch of one key over and over inserts it once and keeps the last value.
+    std::vector<int> same( 100, -7 );
+    std::vector<T> sameValues;
+    for ( int i = 0; i < 100; i++ ) {
+      sameValues.push_back( valueOf<T>( i ) );
+    }
+    insertBatch( map, same, sameValues, reference );
+    CHECK( map.at( -7 ) == valueOf<T>( 99 ) );
+    checkFindBatch( map, same, reference );
+  }
+
+  template< typename T, typename Storage, typename Engine >
+  void checkType() {
+    batches<T, Storage, Engine>( false );
+    batches<T, Storage, Engine>( true );
+  }
+
+  template< typename Storage, typename Engine >
+  void checkStorage() {
+    checkType<int, Storage, Engine>();
+    checkType<std::string, Storage, Engine>();
+  }
+
+  template< typename Engine >
+  void checkEngine() {
+    checkStorage<rstd::inline_storage, Engine>();
+    checkStorage<rstd::boxed_storage, Engine>();
+    checkStorage<rstd::compact_storage, Engine>();
+  }
+
+}
+
+int main() {
+  checkEngine<rstd::robin_hood_engine>();
+  checkEngine<rstd::group_engine>();
+  checkEngine<rstd::small_engine<8>>();
+  checkEngine<rstd::small_engine<8, rstd::group_engine>>();
+  return 0;
+}
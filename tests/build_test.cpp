@@ -0,0 +1,159 @@
+#include "hash_map.h"
+
+#include "check.h"
+
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+
+  template< typename Engine >
+  struct policy : rstd::default_hash_map_policy
+  {
+    using engine = Engine;
+  };
+
+  template< typename T, typename Engine >
+  using map_of = rstd::hash_map<int, T, rstd::hash<int>, std::equal_to<int>, std::allocator<std::pair<const int, T>>, policy<Engine>>;
+
+  //! A value without a default constructor, which build() inserts in input order instead of sorting.
+  struct no_default
+  {
+    int value;
+
+    explicit no_default( int v ) :
+      value( v ) {}
+
+    bool operator==( const no_default& other ) const {
+      return value == other.value;
+    }
+  };
+
+  template< typename T >
+  T valueOf( int index ) {
+    if constexpr ( std::is_same<T, std::string>::value ) {
+      return "value number " + std::to_string( index );
+    }
+    else if constexpr ( std::is_same<T, no_default>::value ) {
+      return no_default( index );
+    }
+    else {
+      return index;
+    }
+  }
+
+  template< typename Map >
+  void checkEqual( const Map& map, const std::unordered_map<int, typename Map::mapped_type>& reference ) {
+
+    CHECK( map.size() == reference.size() );
+    for ( const auto& entry : reference ) {
+      const typename Map::mapped_type* found = map.find( entry.first );
+      CHECK( found != nullptr && *found == entry.second );
+    }
+
+    size_t visited = 0;
+    for ( const auto& entry : map ) {
+      CHECK( reference.count( entry.first ) == 1 );
+      visited++;
+    }
+    CHECK( visited == reference.size() );
+  }
+
+  //! Builds from keys with repeats, checking the result against inserting the same pairs one by one.
+  template< typename T, typename Engine >
+  void buildsLikeInserting( uint32_t n, int distinctKeys ) {
+
+    std::vector<int> keys;
+    std::vector<T> values;
+    std::unordered_map<int, T> reference;
+    for ( uint32_t i = 0; i < n; i++ ) {
+      int key = (int) ( ( i * 2654435761u ) % (uint32_t) distinctKeys );
+      keys.push_back( key );
+      values.push_back( valueOf<T>( (int) i ) );
+      // The last duplicate wins.
+      reference.insert_or_assign( key, valueOf<T>( (int) i ) );
+    }
+
+    map_of<T, Engine> map;
+    map.build( keys.data(), values.data(), n );
+    checkEqual( map, reference );
+
+    // The built map keeps working like any other.
+    map.insert_or_assign( -1, valueOf<T>( -1 ) );
+    reference.insert_or_assign( -1, valueOf<T>( -1 ) );
+    if ( n != 0 ) {
+      map.erase( keys[0] );
+      reference.erase( keys[0] );
+    }
+    checkEqual( map, reference );
+  }
+
+  //! build() replaces what was in the map, and building nothing leaves it empty.
+  template< typename T, typename Engine >
+  void replacesContents() {
+
+    map_of<T, Engine> map;
+    for ( int key = 0; key < 3000; key++ ) {
+      map.insert_or_assign( key, valueOf<T>( key ) );
+    }
+
+    std::vector<int> keys = { 5, 6000, 7, 5 };
+    std::vector<T> values = { valueOf<T>( 1 ), valueOf<T>( 2 ), valueOf<T>( 3 ), valueOf<T>( 4 ) };
+    map.build( keys.data(), values.data(), keys.size() );
+    checkEqual( map, { { 5, valueOf<T>( 4 ) }, { 6000, valueOf<T>( 2 ) }, { 7, valueOf<T>( 3 ) } } );
+
+    map.build( keys.data(), values.data(), 0 );
+    CHECK( map.empty() );
+    CHECK( !map.contains( 5 ) );
+
+    map_of<T, Engine> empty;
+    empty.build( nullptr, nullptr, 0 );
+    CHECK( empty.empty() );
+    CHECK( empty.begin() == empty.end() );
+  }
+
+  //! A single key repeated from start to end ends up once, with its last value.
+  template< typename T, typename Engine >
+  void allDuplicates() {
+
+    std::vector<int> keys( 1000, 42 );
+    std::vector<T> values;
+    for ( int i = 0; i < 1000; i++ ) {
+      values.push_back( valueOf<T>( i ) );
+    }
+
+    map_of<T, Engine> map;
+    map.build( keys.data(), values.data(), keys.size() );
+    checkEqual( map, { { 42, valueOf<T>( 999 ) } } );
+  }
+
+  template< typename T, typename Engine >
+  void checkType() {
+    buildsLikeInserting<T, Engine>( 0, 1 );
+    buildsLikeInserting<T, Engine>( 5, 1000 );
+    buildsLikeInserting<T, Engine>( 20000, 1 << 30 );
+    buildsLikeInserting<T, Engine>( 20000, 5000 );
+    replacesContents<T, Engine>();
+    allDuplicates<T, Engine>();
+  }
+
+  template< typename Engine >
+  void checkEngine() {
+    checkType<int, Engine>();
+    checkType<std::string, Engine>();
+    checkType<no_default, Engine>();
+    // Enough buckets to sort by ranges of them.
+    buildsLikeInserting<int, Engine>( 1 << 17, 1 << 30 );
+  }
+
+}
+
+int main() {
+  checkEngine<rstd::robin_hood_engine>();
+  checkEngine<rstd::group_engine>();
+  checkEngine<rstd::small_engine<8>>();
+  return 0;
+}
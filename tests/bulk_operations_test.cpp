@@ -0,0 +1,100 @@
+#include "hash_map.h"
+
+#include "check.h"
+
+#include <atomic>
+#include <string>
+
+namespace
+{
+
+  template< typename Storage >
+  struct counted_policy : rstd::default_hash_map_policy
+  {
+    using storage = Storage;
+    using counters = rstd::atomic_counters;
+  };
+
+  template< typename T, typename Storage >
+  using counted_map = rstd::hash_map<int, T, rstd::hash<int>, std::equal_to<int>, std::allocator<std::pair<const int, T>>, counted_policy<Storage>>;
+
+  void parallelForEach() {
+
+    rstd::hash_map<int, int> map;
+    for ( int key = 0; key < 100000; key++ ) {
+      map[key] = key;
+    }
+
+    map.parallel_for_each( []( std::pair<const int, int>& entry ) { entry.second *= 2; }, 4 );
+
+    std::atomic<uint64_t> total{ 0 };
+    const rstd::hash_map<int, int>& constMap = map;
+    constMap.parallel_for_each( [&total]( const std::pair<const int, int>& entry ) { total += entry.second; }, 4 );
+    CHECK( total == 99999ull * 100000 );
+
+    CHECK_THROWS( map.parallel_for_each( []( std::pair<const int, int>& entry ) { if ( entry.first == 500 ) throw std::runtime_error( "stop" ); }, 4 ), std::runtime_error );
+  }
+
+  void eraseIf() {
+
+    rstd::hash_map<int, std::string> map;
+    for ( int key = 0; key < 50000; key++ ) {
+      map[key] = std::to_string( key );
+    }
+
+    uint32_t erased = map.erase_if( []( const std::pair<const int, std::string>& entry ) { return entry.first % 3 == 0; }, 4 );
+    CHECK( erased == 16667 );
+    CHECK( map.size() == 50000 - 16667 );
+    for ( int key = 0; key < 50000; key++ ) {
+      CHECK( map.contains( key ) == ( key % 3 != 0 ) );
+    }
+  }
+
+  //! Moves the missing keys over, and both maps account for them in stats() and counters().
+  template< typename Storage >
+  void mergeCounts() {
+
+    counted_map<std::string, Storage> target;
+    counted_map<std::string, Storage> source;
+    for ( int key = 0; key < 1000; key++ ) {
+      target[key] = "target";
+    }
+    for ( int key = 500; key < 3000; key++ ) {
+      source[key] = "source";
+    }
+
+    rstd::hash_map_counters targetBefore = target.counters();
+    rstd::hash_map_counters sourceBefore = source.counters();
+
+    target.merge( source );
+
+    CHECK( target.size() == 3000 );
+    CHECK( source.size() == 500 );
+    for ( int key = 0; key < 3000; key++ ) {
+      CHECK( target.at( key ) == ( key < 1000 ? "target" : "source" ) );
+    }
+    for ( int key = 500; key < 1000; key++ ) {
+      CHECK( source.at( key ) == "source" );
+    }
+
+    CHECK( target.counters().inserts - targetBefore.inserts == 2000 );
+    CHECK( source.counters().erases - sourceBefore.erases == 2000 );
+    CHECK( source.stats().erases == 2000 );
+    CHECK( target.counters().probes > targetBefore.probes );
+
+    // Merging again moves nothing.
+    target.merge( std::move( source ) );
+    CHECK( source.size() == 500 );
+    CHECK( source.stats().erases == 2000 );
+  }
+
+}
+
+int main() {
+  parallelForEach();
+  eraseIf();
+  mergeCounts<rstd::inline_storage>();
+  mergeCounts<rstd::boxed_storage>();
+  mergeCounts<rstd::compact_storage>();
+  return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <cstdio>
+#include <cstdlib>
+
+/*
+
+The one assertion of the tests. Unlike assert() it stays on in release
+builds, and it reports the failed condition with its file and line.
+
+*/
+
+#define CHECK( condition ) \
+  do { \
+    if ( !( condition ) ) { \
+      std::fprintf( stderr, "%s:%d: CHECK( %s ) failed\n", __FILE__, __LINE__, #condition ); \
+      std::abort(); \
+    } \
+  } while ( false )
+
+//! Checks that statement throws an exception of the given type.
+#define CHECK_THROWS( statement, exception ) \
+  do { \
+    bool thrown = false; \
+    try { \
+      statement; \
+    } \
+    catch ( const exception& ) { \
+      thrown = true; \
+    } \
+    CHECK( thrown ); \
+  } while ( false )
+
+#endif // CHECK_H
@@ -0,0 +1,221 @@
+#include "hash_map.h"
+#include "pool_allocator.h"
+
+#include "check.h"
+#include "counting_allocator.h"
+
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <type_traits>
+
+//! Every call to the global operator new, which pool_resource draws its slabs and big blocks from.
+static size_t newCalls = 0;
+
+void* operator new( size_t bytes ) {
+  newCalls++;
+  if ( void* pointer = std::malloc( bytes == 0 ? 1 : bytes ) ) {
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete( void* pointer ) noexcept {
+  std::free( pointer );
+}
+
+void operator delete( void* pointer, size_t ) noexcept {
+  std::free( pointer );
+}
+
+namespace
+{
+
+  template< typename Storage, typename Engine >
+  struct policy : rstd::default_hash_map_policy
+  {
+    using storage = Storage;
+    using engine = Engine;
+  };
+
+  template< typename T, typename Storage, typename Engine, typename Allocator = counting_allocator<std::pair<const int, T>> >
+  using map_of = rstd::hash_map<int, T, rstd::hash<int>, std::equal_to<int>, Allocator, policy<Storage, Engine>>;
+
+  //! Counts live instances, so clear() can be seen destroying each element exactly once.
+  struct tracked
+  {
+    static inline int live = 0;
+
+    int value = 0;
+
+    tracked() {
+      live++;
+    }
+
+    tracked( int v ) :
+      value( v ) {
+      live++;
+    }
+
+    tracked( const tracked& other ) :
+      value( other.value ) {
+      live++;
+    }
+
+    tracked& operator=( const tracked& other ) = default;
+
+    ~tracked() {
+      live--;
+    }
+  };
+
+  template< typename T >
+  T valueOf( int key ) {
+    if constexpr ( std::is_same<T, std::string>::value ) {
+      return "value number " + std::to_string( key ) + ", long enough to allocate";
+    }
+    else {
+      return T( key );
+    }
+  }
+
+  template< typename Map >
+  void fill( Map& map, int first, int count ) {
+    for ( int key = first; key < first + count; key++ ) {
+      map[key] = valueOf<typename Map::mapped_type>( key );
+    }
+  }
+
+  //! After the first fill, clearing and refilling to the same size goes through the allocator no more.
+  template< typename Storage, typename Engine >
+  void refillAllocatesNothing() {
+
+    size_t firstAllocations = allocationCount;
+    map_of<int, Storage, Engine> map;
+    fill( map, 0, 5000 );
+    CHECK( allocationCount > firstAllocations );
+
+    for ( int round = 0; round < 3; round++ ) {
+
+      map.clear();
+      CHECK( map.empty() );
+
+      size_t allocations = allocationCount;
+      size_t bytes = allocatedBytes;
+      // Other keys than the first fill, so the refill cannot lean on any leftover layout.
+      fill( map, round * 7919, 5000 );
+      CHECK( allocationCount == allocations );
+      CHECK( allocatedBytes == bytes );
+      CHECK( map.size() == 5000 );
+    }
+  }
+
+  //! Boxed elements over a pool_allocator go back onto its free lists on clear(), and come back from them on refill.
+  template< typename Engine >
+  void pooledRefillAllocatesNothing() {
+
+    using pool_type = rstd::pool_allocator<std::pair<const int, int>>;
+    pool_type pool;
+    size_t firstCalls = newCalls;
+    map_of<int, rstd::boxed_storage, Engine, pool_type> map( 256, rstd::hash<int>(), std::equal_to<int>(), pool );
+    fill( map, 0, 5000 );
+    CHECK( newCalls > firstCalls );
+    CHECK( pool.resource().slabBytes() != 0 );
+
+    for ( int round = 0; round < 3; round++ ) {
+
+      map.clear();
+
+      size_t calls = newCalls;
+      size_t slabBytes = pool.resource().slabBytes();
+      fill( map, round * 7919, 5000 );
+      CHECK( newCalls == calls );
+      CHECK( pool.resource().slabBytes() == slabBytes );
+      CHECK( map.size() == 5000 );
+    }
+  }
+
+  //! However clear() gets rid of the elements, what is left is an empty map like a new one.
+  template< typename T, typename Storage, typename Engine >
+  void leavesMapReusable() {
+
+    map_of<T, Storage, Engine> map;
+    fill( map, 0, 3000 );
+    for ( int key = 0; key < 3000; key += 3 ) {
+      map.erase( key );
+    }
+
+    map.clear();
+    CHECK( map.empty() );
+    CHECK( map.size() == 0 );
+    CHECK( map.begin() == map.end() );
+    for ( int key = 0; key < 3000; key++ ) {
+      CHECK( !map.contains( key ) );
+    }
+
+    rstd::hash_map_stats stats = map.stats();
+    CHECK( stats.elements == 0 );
+    CHECK( stats.tombstones == 0 );
+    CHECK( stats.maxProbeLength == 0 );
+
+    fill( map, 1000, 2000 );
+    CHECK( map.size() == 2000 );
+    for ( int key = 0; key < 4000; key++ ) {
+      CHECK( map.contains( key ) == ( key >= 1000 && key < 3000 ) );
+    }
+
+    // Clearing twice, and clearing during an incremental rehash, is as good as clearing once.
+    map.clear();
+    map.clear();
+    map.incremental_rehash( true );
+    fill( map, 0, 20000 );
+    map.clear();
+    CHECK( !map.rehash_in_progress() );
+    CHECK( map.empty() );
+    fill( map, 0, 100 );
+    CHECK( map.size() == 100 );
+  }
+
+  //! Elements with a destructor are each destroyed exactly once, from the table and from an old one alike.
+  template< typename Storage, typename Engine >
+  void destroysEveryElement() {
+    {
+      map_of<tracked, Storage, Engine> map;
+      map.incremental_rehash( true );
+      fill( map, 0, 5000 );
+      CHECK( tracked::live == 5000 );
+
+      map.clear();
+      CHECK( tracked::live == 0 );
+
+      fill( map, 0, 100 );
+      CHECK( tracked::live == 100 );
+    }
+    CHECK( tracked::live == 0 );
+  }
+
+  template< typename Storage, typename Engine >
+  void checkStorage() {
+    leavesMapReusable<int, Storage, Engine>();
+    leavesMapReusable<std::string, Storage, Engine>();
+    destroysEveryElement<Storage, Engine>();
+  }
+
+  template< typename Engine >
+  void checkEngine() {
+    refillAllocatesNothing<rstd::inline_storage, Engine>();
+    refillAllocatesNothing<rstd::compact_storage, Engine>();
+    pooledRefillAllocatesNothing<Engine>();
+    checkStorage<rstd::inline_storage, Engine>();
+    checkStorage<rstd::boxed_storage, Engine>();
+    checkStorage<rstd::compact_storage, Engine>();
+  }
+
+}
+
+int main() {
+  checkEngine<rstd::robin_hood_engine>();
+  checkEngine<rstd::group_engine>();
+  checkEngine<rstd::small_engine<8>>();
+  return 0;
+}
@@ -0,0 +1,151 @@
+#include "concurrent_hash_map.h"
+
+#include "check.h"
+#include "counting_allocator.h"
+#include "pool_allocator.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+  //! Hashes keys modulo a runtime modulus, counting its calls. A default constructed one has no counter to count into.
+  struct modulo_hash
+  {
+    std::atomic<uint64_t>* calls = nullptr;
+    int modulus = 0;
+
+    size_t operator()( int key ) const {
+      calls->fetch_add( 1, std::memory_order_relaxed );
+      return rstd::rstd_support::mixBits( (uint64_t) ( key % modulus ) );
+    }
+  };
+
+  struct modulo_equal
+  {
+    int modulus = 0;
+
+    bool operator()( int key1, int key2 ) const {
+      return key1 % modulus == key2 % modulus;
+    }
+  };
+
+  using map_type = rstd::concurrent_hash_map<int, int, modulo_hash, modulo_equal>;
+
+  //! Every shard map hashes and compares through the functors given to the constructor.
+  void shardsShareFunctors() {
+
+    std::atomic<uint64_t> calls{ 0 };
+    map_type map( 16, modulo_hash{ &calls, 1000 }, modulo_equal{ 1000 } );
+
+    for ( int key = 0; key < 1000; key++ ) {
+      CHECK( map.try_emplace( key, key ) );
+    }
+    for ( int key = 1000; key < 2000; key++ ) {
+      CHECK( !map.try_emplace( key, key ) );
+      CHECK( map.find( key ) == key - 1000 );
+    }
+    CHECK( map.size() == 1000 );
+
+    CHECK( map.erase( 1001 ) );
+    CHECK( !map.contains( 1 ) );
+    CHECK( !map.insert_or_assign( 2002, 7 ) );
+    CHECK( map.find( 2 ) == 7 );
+  }
+
+  //! A call hashes its key once, for the shard and the lookup inside it.
+  void hashesOnce() {
+
+    std::atomic<uint64_t> calls{ 0 };
+    map_type map( 4, modulo_hash{ &calls, 1 << 30 }, modulo_equal{ 1 << 30 } );
+    map.reserve( 1000 );
+
+    for ( int key = 0; key < 100; key++ ) {
+      map.try_emplace( key, key );
+    }
+
+    calls = 0;
+    for ( int key = 0; key < 100; key++ ) {
+      map.find( key );
+      map.contains( key );
+      map.insert_or_assign( key, key + 1 );
+      map.visit( key, []( int& value ) { value++; } );
+      map.upsert( key, []( int& value ) { value++; } );
+      map.erase( key );
+    }
+    CHECK( calls == 600 );
+  }
+
+  //! Shards start at the smallest table rather than the hash_map default.
+  void shardsStartSmall() {
+    using counted_map = rstd::concurrent_hash_map<int, int, rstd::hash<int>, std::equal_to<int>, counting_allocator<std::pair<const int, int>>>;
+    {
+      counted_map map( 64 );
+      CHECK( allocatedBytes <= 64 * 32 * sizeof( std::pair<const int, int> ) );
+    }
+    CHECK( allocatedBytes == 0 );
+  }
+
+  struct boxed_policy : rstd::default_hash_map_policy
+  {
+    using storage = rstd::boxed_storage;
+  };
+
+  //! Every shard map draws from the allocator given to the constructor, not a default constructed one.
+  void shardsShareAllocator() {
+
+    using pool_type = rstd::pool_allocator<std::pair<const int, int>>;
+    using pooled_map = rstd::concurrent_hash_map<int, int, rstd::hash<int>, std::equal_to<int>, pool_type, boxed_policy>;
+
+    pool_type pool;
+    pooled_map map( 16, rstd::hash<int>(), std::equal_to<int>(), pool );
+
+    for ( int key = 0; key < 10000; key++ ) {
+      map.try_emplace( key, key );
+    }
+    // 10000 boxed elements fill several slabs, all of them in the shared pool.
+    CHECK( pool.resource().slabBytes() >= 10000 * sizeof( std::pair<const int, int> ) );
+    CHECK( map.find( 9999 ) == 9999 );
+  }
+
+  void concurrentWriters() {
+
+    rstd::concurrent_hash_map<int, int> map( 8 );
+    std::vector<std::thread> threads;
+
+    for ( int part = 0; part < 4; part++ ) {
+      threads.emplace_back( [&map, part]() {
+        for ( int key = part * 10000; key < ( part + 1 ) * 10000; key++ ) {
+          map.try_emplace( key, key );
+          // Counters on keys no thread inserts, so no upsert can run ahead of a try_emplace.
+          map.upsert( -1 - key % 100, []( int& value ) { value++; } );
+        }
+      } );
+    }
+    for ( std::thread& thread : threads ) {
+      thread.join();
+    }
+
+    CHECK( map.size() == 40100 );
+    for ( int key = 0; key < 40000; key++ ) {
+      CHECK( map.find( key ) == key );
+    }
+    int total = 0;
+    for ( int key = -100; key < 0; key++ ) {
+      total += *map.find( key );
+    }
+    CHECK( total == 40000 );
+  }
+
+}
+
+int main() {
+  shardsShareFunctors();
+  hashesOnce();
+  shardsStartSmall();
+  shardsShareAllocator();
+  concurrentWriters();
+  return 0;
+}
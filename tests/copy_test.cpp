@@ -0,0 +1,212 @@
+#include "hash_map.h"
+
+#include "check.h"
+
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+namespace
+{
+
+  template< typename Storage, typename Engine >
+  struct policy : rstd::default_hash_map_policy
+  {
+    using storage = Storage;
+    using engine = Engine;
+  };
+
+  template< typename T, typename Storage, typename Engine >
+  using map_of = rstd::hash_map<int, T, rstd::hash<int>, std::equal_to<int>, std::allocator<std::pair<const int, T>>, policy<Storage, Engine>>;
+
+  //! A trivially copyable value of several words, copied by the memcpy paths.
+  struct point
+  {
+    int x;
+    double y;
+
+    bool operator==( const point& other ) const {
+      return x == other.x && y == other.y;
+    }
+  };
+
+  static_assert( std::is_trivially_copyable<point>::value, "point takes the memcpy paths" );
+
+  template< typename T >
+  T valueOf( int key ) {
+    if constexpr ( std::is_same<T, std::string>::value ) {
+      return "value number " + std::to_string( key ) + ", long enough to allocate";
+    }
+    else if constexpr ( std::is_same<T, point>::value ) {
+      return point{ key, key * 0.5 };
+    }
+    else {
+      return (T) key * 3;
+    }
+  }
+
+  template< typename Map >
+  void checkEqual( const Map& map, const std::unordered_map<int, typename Map::mapped_type>& reference ) {
+
+    CHECK( map.size() == reference.size() );
+    for ( const auto& entry : reference ) {
+      CHECK( map.contains( entry.first ) );
+      CHECK( map.at( entry.first ) == entry.second );
+    }
+
+    size_t visited = 0;
+    for ( const auto& entry : map ) {
+      CHECK( reference.count( entry.first ) == 1 );
+      visited++;
+    }
+    CHECK( visited == reference.size() );
+  }
+
+  //! A source with erased keys, so copies see gaps and, for group_engine, tombstones.
+  template< typename Map >
+  void fillSource( Map& source, std::unordered_map<int, typename Map::mapped_type>& reference, int count ) {
+    using T = typename Map::mapped_type;
+    for ( int key = 0; key < count; key++ ) {
+      source[key] = valueOf<T>( key );
+      reference[key] = valueOf<T>( key );
+    }
+    for ( int key = 0; key < count; key += 4 ) {
+      source.erase( key );
+      reference.erase( key );
+    }
+  }
+
+  //! Copy construction and assignment give an equal, independent map, leaving the source as it was.
+  template< typename T, typename Storage, typename Engine >
+  void copies( int count ) {
+
+    using map_type = map_of<T, Storage, Engine>;
+
+    map_type source;
+    std::unordered_map<int, T> reference;
+    fillSource( source, reference, count );
+
+    map_type copy( source );
+    checkEqual( copy, reference );
+    checkEqual( source, reference );
+    CHECK( copy.bucketCount() == source.bucketCount() );
+
+    // The copy owns its elements: changing it leaves the source be.
+    copy[1] = valueOf<T>( 1000000 );
+    copy.erase( 2 );
+    copy[count + 1] = valueOf<T>( count + 1 );
+    checkEqual( source, reference );
+
+    for ( uint32_t targetBuckets : { 8u, source.bucketCount(), source.bucketCount() * 4 } ) {
+      map_type target( targetBuckets );
+      target[-1] = valueOf<T>( -1 );
+      target = source;
+      checkEqual( target, reference );
+      checkEqual( source, reference );
+    }
+  }
+
+  //! clone_into() makes an equal copy into an empty, a smaller and a bigger target, dropping what was in it.
+  template< typename T, typename Storage, typename Engine >
+  void clonesInto( int count ) {
+
+    using map_type = map_of<T, Storage, Engine>;
+
+    map_type source;
+    std::unordered_map<int, T> reference;
+    fillSource( source, reference, count );
+
+    {
+      map_type empty;
+      source.clone_into( empty );
+      checkEqual( empty, reference );
+    }
+
+    for ( uint32_t targetBuckets : { 8u, source.bucketCount() / 2, source.bucketCount(), source.bucketCount() * 4 } ) {
+
+      map_type target( targetBuckets );
+      for ( int key = -500; key < 0; key++ ) {
+        target[key] = valueOf<T>( key );
+      }
+      uint32_t targetBefore = target.bucketCount();
+
+      source.clone_into( target );
+      checkEqual( target, reference );
+      checkEqual( source, reference );
+      for ( int key = -500; key < 0; key++ ) {
+        CHECK( !target.contains( key ) );
+      }
+
+      // A bigger target keeps its buckets; a smaller one takes those of the source.
+      CHECK( target.bucketCount() == ( targetBefore > source.bucketCount() ? targetBefore : source.bucketCount() ) );
+
+      // The clone is a working map of its own.
+      target[count + 7] = valueOf<T>( count + 7 );
+      target.erase( 1 );
+      CHECK( target.size() == reference.size() );
+      checkEqual( source, reference );
+
+      // Cloning again over a filled target of the same size works alike.
+      source.clone_into( target );
+      checkEqual( target, reference );
+    }
+
+    source.clone_into( source );
+    checkEqual( source, reference );
+  }
+
+  //! A source in the middle of an incremental rehash copies both its tables.
+  template< typename T, typename Storage, typename Engine >
+  void copiesDuringRehash() {
+
+    using map_type = map_of<T, Storage, Engine>;
+
+    map_type source( 16 );
+    source.incremental_rehash( true );
+    std::unordered_map<int, T> reference;
+    for ( int key = 0; key < 3000 && !( key > 100 && source.rehash_in_progress() ); key++ ) {
+      source[key] = valueOf<T>( key );
+      reference[key] = valueOf<T>( key );
+    }
+    CHECK( source.rehash_in_progress() );
+
+    map_type copy( source );
+    checkEqual( copy, reference );
+
+    map_type target;
+    source.clone_into( target );
+    checkEqual( target, reference );
+    checkEqual( source, reference );
+  }
+
+  template< typename T, typename Storage, typename Engine >
+  void checkType() {
+    copies<T, Storage, Engine>( 3 );
+    copies<T, Storage, Engine>( 5000 );
+    clonesInto<T, Storage, Engine>( 3 );
+    clonesInto<T, Storage, Engine>( 5000 );
+    copiesDuringRehash<T, Storage, Engine>();
+  }
+
+  template< typename Storage, typename Engine >
+  void checkStorage() {
+    checkType<int, Storage, Engine>();
+    checkType<point, Storage, Engine>();
+    checkType<std::string, Storage, Engine>();
+  }
+
+  template< typename Engine >
+  void checkEngine() {
+    checkStorage<rstd::inline_storage, Engine>();
+    checkStorage<rstd::boxed_storage, Engine>();
+    checkStorage<rstd::compact_storage, Engine>();
+  }
+
+}
+
+int main() {
+  checkEngine<rstd::robin_hood_engine>();
+  checkEngine<rstd::group_engine>();
+  checkEngine<rstd::small_engine<8>>();
+  return 0;
+}
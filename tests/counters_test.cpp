@@ -0,0 +1,159 @@
+#include "hash_map.h"
+
+#include "check.h"
+
+#include <cstdint>
+#include <type_traits>
+
+namespace
+{
+
+  template< typename Engine, typename Storage = rstd::inline_storage >
+  struct counted_policy : rstd::default_hash_map_policy
+  {
+    using engine = Engine;
+    using storage = Storage;
+    using counters = rstd::atomic_counters;
+  };
+
+  template< typename Engine, typename Storage = rstd::inline_storage >
+  using counted_map = rstd::hash_map<int, int, rstd::hash<int>, std::equal_to<int>, std::allocator<std::pair<const int, int>>, counted_policy<Engine, Storage>>;
+
+  void checkZero( const rstd::hash_map_counters& counts ) {
+    CHECK( counts.hits == 0 );
+    CHECK( counts.misses == 0 );
+    CHECK( counts.inserts == 0 );
+    CHECK( counts.erases == 0 );
+    CHECK( counts.clears == 0 );
+    CHECK( counts.allocations == 0 );
+    CHECK( counts.probes == 0 );
+    CHECK( counts.rehashes == 0 );
+  }
+
+  //! Returns how many times bucketCount doubled from initialBuckets.
+  uint64_t doublings( uint32_t initialBuckets, uint32_t bucketCount ) {
+    uint64_t count = 0;
+    while ( initialBuckets < bucketCount ) {
+      initialBuckets <<= 1;
+      count++;
+    }
+    return count;
+  }
+
+  //! Every hot path event is counted exactly once, and reset_counters() starts over from zero.
+  template< typename Engine >
+  void exactCounts() {
+
+    counted_map<Engine> map( 16 );
+    uint32_t initialBuckets = map.bucketCount();
+    checkZero( map.counters() );
+
+    for ( int key = 0; key < 1000; key++ ) {
+      CHECK( map.try_emplace( key, key ).second );
+    }
+
+    rstd::hash_map_counters counts = map.counters();
+    CHECK( counts.hits == 0 );
+    CHECK( counts.misses == 1000 );
+    CHECK( counts.inserts == 1000 );
+    // A small_engine also rebuilds once to spill its buffer, at the bucket count it had.
+    uint64_t spills = std::is_same<Engine, rstd::small_engine<8>>::value ? 1 : 0;
+    CHECK( counts.rehashes == doublings( initialBuckets, map.bucketCount() ) + spills );
+    CHECK( counts.allocations == counts.rehashes );
+    CHECK( counts.probes >= 1000 );
+
+    // Assigning over a present key is a hit, not an insert.
+    CHECK( !map.insert_or_assign( 5, 6 ).second );
+    for ( int key = 0; key < 1000; key++ ) {
+      CHECK( map.contains( key ) );
+    }
+    for ( int key = 1000; key < 1500; key++ ) {
+      CHECK( map.find( key ) == nullptr );
+    }
+    for ( int key = 0; key < 300; key++ ) {
+      map.erase( key );
+    }
+    // Erasing a missing key erases nothing.
+    map.erase( -1 );
+
+    counts = map.counters();
+    CHECK( counts.hits == 1001 );
+    CHECK( counts.misses == 1500 );
+    CHECK( counts.inserts == 1000 );
+    CHECK( counts.erases == 300 );
+    CHECK( counts.clears == 0 );
+
+    map.reset_counters();
+    checkZero( map.counters() );
+
+    // Finding every key once probes exactly the lengths stats() reports.
+    for ( int key = 300; key < 1000; key++ ) {
+      map.find( key );
+    }
+    rstd::hash_map_stats stats = map.stats();
+    uint64_t totalLength = 0;
+    for ( uint32_t i = 0; i < stats.probeHistogram.size(); i++ ) {
+      totalLength += (uint64_t) ( i + 1 ) * stats.probeHistogram[i];
+    }
+    counts = map.counters();
+    CHECK( counts.hits == 700 );
+    CHECK( counts.probes == totalLength );
+
+    map.clear();
+    counts = map.counters();
+    CHECK( counts.clears == 1 );
+    CHECK( counts.rehashes == 0 );
+    CHECK( counts.allocations == 0 );
+
+    // rehash() to the same bucket count does nothing; to another one rebuilds once.
+    map.rehash( map.bucketCount() );
+    CHECK( map.counters().rehashes == 0 );
+    map.rehash( map.bucketCount() * 2 );
+    CHECK( map.counters().rehashes == 1 );
+    CHECK( map.counters().allocations == 1 );
+  }
+
+  //! Boxed elements are allocated one by one, on top of the table blocks.
+  void boxedAllocations() {
+
+    counted_map<rstd::robin_hood_engine, rstd::boxed_storage> map( 1024 );
+    for ( int key = 0; key < 500; key++ ) {
+      map[key] = key;
+    }
+
+    rstd::hash_map_counters counts = map.counters();
+    CHECK( counts.rehashes == 0 );
+    CHECK( counts.allocations == 500 );
+  }
+
+  //! A small_engine growing while its elements still fit inline only moves its spill bucket count, which allocates nothing.
+  void inlineGrowthAllocatesNothing() {
+
+    // A low load factor makes the map grow long before the buffer fills up.
+    counted_map<rstd::small_engine<8>> map( 2 );
+    map.max_load_factor( 0.1f );
+    for ( int key = 0; key < 8; key++ ) {
+      map[key] = key;
+    }
+
+    rstd::hash_map_counters counts = map.counters();
+    CHECK( counts.rehashes > 0 );
+    CHECK( counts.allocations == 0 );
+    CHECK( map.memory_usage().table == 0 );
+
+    // The ninth element spills the buffer into a table of its own.
+    map[8] = 8;
+    CHECK( map.memory_usage().table != 0 );
+    CHECK( map.counters().allocations == 1 );
+  }
+
+}
+
+int main() {
+  exactCounts<rstd::robin_hood_engine>();
+  exactCounts<rstd::group_engine>();
+  exactCounts<rstd::small_engine<8>>();
+  boxedAllocations();
+  inlineGrowthAllocatesNothing();
+  return 0;
+}
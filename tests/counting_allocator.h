@@ -0,0 +1,46 @@
+#ifndef COUNTING_ALLOCATOR_H
+#define COUNTING_ALLOCATOR_H
+
+#include <cstddef>
+#include <memory>
+
+//! The bytes currently held through every counting_allocator.
+inline size_t allocatedBytes = 0;
+
+//! The calls to allocate() through every counting_allocator so far.
+inline size_t allocationCount = 0;
+
+//! std::allocator, keeping count in allocatedBytes. Not thread safe.
+template< typename V >
+struct counting_allocator
+{
+  using value_type = V;
+
+  counting_allocator() = default;
+
+  template< typename U >
+  counting_allocator( const counting_allocator<U>& ) {}
+
+  V* allocate( size_t count ) {
+    allocatedBytes += count * sizeof( V );
+    allocationCount++;
+    return std::allocator<V>().allocate( count );
+  }
+
+  void deallocate( V* pointer, size_t count ) {
+    allocatedBytes -= count * sizeof( V );
+    std::allocator<V>().deallocate( pointer, count );
+  }
+
+  template< typename U >
+  bool operator==( const counting_allocator<U>& ) const {
+    return true;
+  }
+
+  template< typename U >
+  bool operator!=( const counting_allocator<U>& ) const {
+    return false;
+  }
+};
+
+#endif // COUNTING_ALLOCATOR_H
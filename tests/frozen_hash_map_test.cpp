@@ -0,0 +1,127 @@
+#include "frozen_hash_map.h"
+
+#include "check.h"
+
+#include <random>
+#include <string>
+
+namespace
+{
+
+  //! Freezing finds every key at its value and nothing else; thawing gives back an equal mutable map.
+  void freezeAndThaw() {
+
+    for ( uint32_t elementCount : { 0u, 1u, 2u, 7u, 1000u, 100000u } ) {
+
+      std::mt19937_64 random( elementCount );
+      rstd::hash_map<uint64_t, uint32_t> map;
+      for ( uint32_t i = 0; i < elementCount; i++ ) {
+        map[random()] = i;
+      }
+
+      rstd::frozen_hash_map<uint64_t, uint32_t> frozen = rstd::freeze( map );
+      CHECK( frozen.size() == map.size() );
+      for ( const auto& entry : map ) {
+        const uint32_t* found = frozen.find( entry.first );
+        CHECK( found != nullptr && *found == entry.second );
+      }
+      for ( int i = 0; i < 10000; i++ ) {
+        CHECK( !frozen.contains( random() ) );
+      }
+
+      size_t visited = 0;
+      for ( const auto& entry : frozen ) {
+        CHECK( map.at( entry.first ) == entry.second );
+        visited++;
+      }
+      CHECK( visited == map.size() );
+
+      rstd::hash_map<uint64_t, uint32_t> thawed = frozen.thaw();
+      CHECK( thawed.size() == map.size() );
+      for ( const auto& entry : map ) {
+        CHECK( thawed.at( entry.first ) == entry.second );
+      }
+
+      // The thawed map is mutable again.
+      thawed[1] = 1;
+      CHECK( thawed.contains( 1 ) );
+    }
+  }
+
+  void stringKeys() {
+
+    rstd::hash_map<std::string, int> map;
+    for ( int i = 0; i < 5000; i++ ) {
+      map[std::to_string( i )] = i;
+    }
+
+    rstd::frozen_hash_map<std::string, int> frozen( map );
+    CHECK( frozen.at( "4999" ) == 4999 );
+    CHECK( !frozen.contains( "5000" ) );
+    CHECK_THROWS( frozen.at( "missing" ), std::out_of_range );
+
+    rstd::frozen_hash_map<std::string, int> copy( frozen );
+    CHECK( copy.at( "0" ) == 0 );
+  }
+
+  //! Keys sharing a full hash cannot be told apart by a perfect hash.
+  void rejectsEqualHashes() {
+
+    struct constant_hash
+    {
+      size_t operator()( int ) const {
+        return 1;
+      }
+    };
+
+    rstd::hash_map<int, int, constant_hash> map;
+    map[1] = 1;
+    map[2] = 2;
+    CHECK_THROWS( rstd::freeze( map ), std::invalid_argument );
+  }
+
+  //! Hashes and compares keys modulo a runtime modulus. A default constructed one takes every key as the same.
+  struct modulo_hash
+  {
+    int modulus = 1;
+
+    size_t operator()( int key ) const {
+      return rstd::rstd_support::mixBits( (uint64_t) ( key % modulus ) );
+    }
+  };
+
+  struct modulo_equal
+  {
+    int modulus = 1;
+
+    bool operator()( int key1, int key2 ) const {
+      return key1 % modulus == key2 % modulus;
+    }
+  };
+
+  //! freeze() keeps the KeyEqual of the map, not a default constructed one.
+  void keepsKeyEqual() {
+
+    rstd::hash_map<int, int, modulo_hash, modulo_equal> map( 256, modulo_hash{ 1000 }, modulo_equal{ 1000 } );
+    for ( int key = 0; key < 500; key++ ) {
+      map[key] = key;
+    }
+
+    rstd::frozen_hash_map<int, int, modulo_hash, modulo_equal> frozen = rstd::freeze( map );
+    for ( int key = 0; key < 500; key++ ) {
+      CHECK( frozen.at( key + 1000 ) == key );
+    }
+    for ( int key = 500; key < 1000; key++ ) {
+      CHECK( !frozen.contains( key ) );
+    }
+  }
+
+}
+
+int main() {
+  freezeAndThaw();
+  stringKeys();
+  rejectsEqualHashes();
+  keepsKeyEqual();
+  return 0;
+}
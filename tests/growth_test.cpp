@@ -0,0 +1,149 @@
+#include "hash_map.h"
+
+#include "check.h"
+
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace
+{
+
+  template< typename Engine >
+  struct counted_policy : rstd::default_hash_map_policy
+  {
+    using engine = Engine;
+    using counters = rstd::atomic_counters;
+  };
+
+  template< typename Engine >
+  using counted_map = rstd::hash_map<int, int, rstd::hash<int>, std::equal_to<int>, std::allocator<std::pair<const int, int>>, counted_policy<Engine>>;
+
+  //! Inserting never lets the elements outgrow bucketCount() * max_load_factor().
+  template< typename Engine >
+  void growsWithLoadFactor( float maxLoadFactor ) {
+
+    counted_map<Engine> map( 8 );
+    map.max_load_factor( maxLoadFactor );
+    CHECK( map.max_load_factor() == maxLoadFactor );
+
+    for ( int key = 0; key < 20000; key++ ) {
+      map[key] = key;
+      CHECK( map.bucketCount() >= map.size() / map.max_load_factor() );
+      CHECK( map.load_factor() <= map.max_load_factor() );
+    }
+    for ( int key = 0; key < 20000; key++ ) {
+      CHECK( map.at( key ) == key );
+    }
+  }
+
+  //! Nothing inserted after reserve( n ) makes the table grow, up to n elements.
+  template< typename Engine >
+  void reserveAvoidsRehashing( uint32_t elementCount ) {
+
+    counted_map<Engine> map( 8 );
+    map.reserve( elementCount );
+    uint32_t bucketCount = map.bucketCount();
+    CHECK( bucketCount >= elementCount / map.max_load_factor() );
+
+    map.reset_counters();
+    for ( int key = 0; key < (int) elementCount; key++ ) {
+      map[key] = key;
+    }
+
+    CHECK( map.bucketCount() == bucketCount );
+    // A small_engine still rebuilds once, when its buffer spills into a table with the reserved bucket count.
+    bool spills = !std::is_same<Engine, rstd::robin_hood_engine>::value && !std::is_same<Engine, rstd::group_engine>::value && elementCount > 8;
+    CHECK( map.counters().rehashes == ( spills ? 1u : 0u ) );
+
+    // Reserving no more than the map already holds changes nothing.
+    map.reserve( elementCount / 2 );
+    CHECK( map.bucketCount() == bucketCount );
+  }
+
+  //! rehash() never goes below the bucket count the elements need, whatever it is asked for.
+  template< typename Engine >
+  void rehashIsClamped() {
+
+    counted_map<Engine> map;
+    for ( int key = 0; key < 1000; key++ ) {
+      map[key] = key;
+    }
+
+    map.rehash( 1 << 16 );
+    CHECK( map.bucketCount() == 1 << 16 );
+
+    // 1000 elements at a load factor of 0.8 need 1251 buckets, rounded up to 2048.
+    map.rehash( 1 );
+    CHECK( map.bucketCount() == 2048 );
+    map.rehash( 0 );
+    CHECK( map.bucketCount() == 2048 );
+
+    // Counts in between round up to a power of two.
+    map.rehash( 3000 );
+    CHECK( map.bucketCount() == 4096 );
+
+    CHECK( map.size() == 1000 );
+    for ( int key = 0; key < 1000; key++ ) {
+      CHECK( map.at( key ) == key );
+    }
+  }
+
+  //! Lowering the load factor under the current load grows right away.
+  template< typename Engine >
+  void loweringGrows() {
+
+    counted_map<Engine> map;
+    for ( int key = 0; key < 1000; key++ ) {
+      map[key] = key;
+    }
+
+    map.max_load_factor( 0.25f );
+    CHECK( map.bucketCount() >= 4000 );
+    CHECK( map.load_factor() <= 0.25f );
+    for ( int key = 0; key < 1000; key++ ) {
+      CHECK( map.at( key ) == key );
+    }
+  }
+
+  //! Load factors outside of [0.1, 1] throw and leave the map as it was.
+  void rejectsBadLoadFactors() {
+
+    rstd::hash_map<int, int> map;
+    map.max_load_factor( 0.5f );
+
+    CHECK_THROWS( map.max_load_factor( 0.0f ), std::invalid_argument );
+    CHECK_THROWS( map.max_load_factor( 0.05f ), std::invalid_argument );
+    CHECK_THROWS( map.max_load_factor( -1.0f ), std::invalid_argument );
+    CHECK_THROWS( map.max_load_factor( 1.01f ), std::invalid_argument );
+    CHECK_THROWS( map.max_load_factor( std::numeric_limits<float>::quiet_NaN() ), std::invalid_argument );
+    CHECK_THROWS( map.max_load_factor( std::numeric_limits<float>::infinity() ), std::invalid_argument );
+    CHECK( map.max_load_factor() == 0.5f );
+
+    map.max_load_factor( 0.1f );
+    map.max_load_factor( 1.0f );
+    CHECK( map.max_load_factor() == 1.0f );
+  }
+
+  template< typename Engine >
+  void checkEngine() {
+    growsWithLoadFactor<Engine>( 0.8f );
+    growsWithLoadFactor<Engine>( 0.5f );
+    growsWithLoadFactor<Engine>( 1.0f );
+    reserveAvoidsRehashing<Engine>( 5 );
+    reserveAvoidsRehashing<Engine>( 1000 );
+    reserveAvoidsRehashing<Engine>( 100000 );
+    rehashIsClamped<Engine>();
+    loweringGrows<Engine>();
+  }
+
+}
+
+int main() {
+  checkEngine<rstd::robin_hood_engine>();
+  checkEngine<rstd::group_engine>();
+  checkEngine<rstd::small_engine<8>>();
+  checkEngine<rstd::small_engine<8, rstd::group_engine>>();
+  rejectsBadLoadFactors();
+  return 0;
+}
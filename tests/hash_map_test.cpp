@@ -0,0 +1,466 @@
+#include "hash_map.h"
+
+#include "check.h"
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+
+  //! Sends every key to one of four hashes, so thousands of keys share each home bucket.
+  struct degenerate_hash
+  {
+    size_t operator()( int key ) const {
+      return (size_t) ( key % 4 );
+    }
+  };
+
+  //! Sends key k to bucket k modulo the bucket count, so the home of every key is known.
+  struct identity_hash
+  {
+    size_t operator()( int key ) const {
+      return (size_t) key;
+    }
+  };
+
+  //! Sends every key to the first bucket.
+  struct zero_hash
+  {
+    size_t operator()( int ) const {
+      return 0;
+    }
+  };
+
+  template< typename Storage, typename Engine >
+  struct policy : rstd::default_hash_map_policy
+  {
+    using storage = Storage;
+    using engine = Engine;
+  };
+
+  template< typename V >
+  V valueOf( int key ) {
+    if constexpr ( std::is_same<V, std::string>::value ) {
+      return "value number " + std::to_string( key ) + ", long enough to allocate";
+    }
+    else {
+      return (V) key * 3;
+    }
+  }
+
+  template< typename Map >
+  void checkEqual( const Map& map, const std::unordered_map<int, typename Map::mapped_type>& reference ) {
+
+    CHECK( map.size() == reference.size() );
+
+    size_t visited = 0;
+    for ( const auto& entry : map ) {
+      auto found = reference.find( entry.first );
+      CHECK( found != reference.end() );
+      CHECK( entry.second == found->second );
+      visited++;
+    }
+    CHECK( visited == reference.size() );
+
+    for ( const auto& entry : reference ) {
+      CHECK( map.contains( entry.first ) );
+      CHECK( map.at( entry.first ) == entry.second );
+    }
+  }
+
+  //! Inserts, overwrites, erases and copies the same keys in map and in std::unordered_map, checking they agree.
+  template< typename Map >
+  void roundTrip( uint32_t keyCount ) {
+
+    using V = typename Map::mapped_type;
+
+    Map map;
+    std::unordered_map<int, V> reference;
+
+    for ( int key = 0; key < (int) keyCount; key++ ) {
+      map[key] = valueOf<V>( key );
+      reference[key] = valueOf<V>( key );
+    }
+    checkEqual( map, reference );
+
+    for ( int key = 0; key < (int) keyCount; key += 3 ) {
+      map.erase( key );
+      reference.erase( key );
+    }
+    for ( int key = 1; key < (int) keyCount; key += 5 ) {
+      map.insert_or_assign( key, valueOf<V>( key + 1 ) );
+      reference[key] = valueOf<V>( key + 1 );
+    }
+    for ( int key = (int) keyCount; key < (int) keyCount + 100; key++ ) {
+      CHECK( map.find( key ) == nullptr );
+    }
+    checkEqual( map, reference );
+
+    Map copy( map );
+    checkEqual( copy, reference );
+
+    Map moved( std::move( copy ) );
+    checkEqual( moved, reference );
+
+    map.clear();
+    CHECK( map.empty() );
+    for ( int key = 0; key < 100; key++ ) {
+      map[key] = valueOf<V>( key );
+    }
+    CHECK( map.size() == 100 );
+
+    CHECK_THROWS( map.at( -1 ), std::out_of_range );
+  }
+
+  template< typename Hash, typename Storage, typename Engine >
+  void roundTripAll( uint32_t keyCount ) {
+    roundTrip<rstd::hash_map<int, int, Hash, std::equal_to<int>, std::allocator<std::pair<const int, int>>, policy<Storage, Engine>>>( keyCount );
+    roundTrip<rstd::hash_map<int, std::string, Hash, std::equal_to<int>, std::allocator<std::pair<const int, std::string>>, policy<Storage, Engine>>>( keyCount );
+  }
+
+  template< typename Hash, typename Engine >
+  void roundTripStorages( uint32_t keyCount ) {
+    roundTripAll<Hash, rstd::inline_storage, Engine>( keyCount );
+    roundTripAll<Hash, rstd::boxed_storage, Engine>( keyCount );
+    roundTripAll<Hash, rstd::compact_storage, Engine>( keyCount );
+  }
+
+  template< typename Hash >
+  void roundTripEngines( uint32_t keyCount ) {
+    roundTripStorages<Hash, rstd::robin_hood_engine>( keyCount );
+    roundTripStorages<Hash, rstd::group_engine>( keyCount );
+    roundTripStorages<Hash, rstd::small_engine<8>>( keyCount );
+    roundTripStorages<Hash, rstd::small_engine<8, rstd::group_engine>>( keyCount );
+  }
+
+  //! More keys share a hash than a Robin Hood run may be long; they must go to the stash instead of growing without end.
+  void degenerateHash() {
+
+    rstd::hash_map<int, int, degenerate_hash> map;
+    for ( int key = 0; key < 2000; key++ ) {
+      map[key] = key;
+    }
+
+    CHECK( map.size() == 2000 );
+    CHECK( map.bucketCount() <= 8192 );
+    for ( int key = 0; key < 2000; key++ ) {
+      CHECK( map.at( key ) == key );
+    }
+
+    map.incremental_rehash( true );
+    for ( int key = 2000; key < 4000; key++ ) {
+      map[key] = key;
+    }
+    for ( int key = 0; key < 4000; key += 2 ) {
+      map.erase( key );
+    }
+    CHECK( map.size() == 2000 );
+    for ( int key = 0; key < 4000; key++ ) {
+      CHECK( map.contains( key ) == ( key % 2 == 1 ) );
+    }
+  }
+
+  /*
+  Erasing from the start of a run shifts the rest of it back by one slot, so
+  every probe gets shorter and no tombstone is left behind.
+  */
+  void backwardShiftDeletion() {
+
+    rstd::hash_map<int, int, identity_hash> map;
+    CHECK( map.bucketCount() == 256 );
+
+    // Four keys homed at bucket 0, then one homed at 1, displaced behind them to slot 4.
+    for ( int key : { 0, 256, 512, 768, 1 } ) {
+      map[key] = key;
+    }
+    rstd::hash_map_stats stats = map.stats();
+    CHECK( stats.maxProbeLength == 4 );
+    CHECK( stats.probeHistogram == std::vector<uint32_t>( { 1, 1, 1, 2 } ) );
+    uint32_t freeSlots = stats.emptySlots + stats.elements;
+
+    map.erase( 0 );
+    stats = map.stats();
+    CHECK( stats.maxProbeLength == 3 );
+    CHECK( stats.probeHistogram == std::vector<uint32_t>( { 1, 1, 2 } ) );
+    CHECK( stats.tombstones == 0 );
+    CHECK( stats.emptySlots + stats.elements == freeSlots );
+
+    // Erasing from the middle shifts back only what follows.
+    map.erase( 512 );
+    stats = map.stats();
+    CHECK( stats.maxProbeLength == 2 );
+    CHECK( stats.probeHistogram == std::vector<uint32_t>( { 1, 2 } ) );
+    CHECK( stats.tombstones == 0 );
+    CHECK( stats.emptySlots + stats.elements == freeSlots );
+
+    CHECK( map.size() == 3 );
+    for ( int key : { 256, 768, 1 } ) {
+      CHECK( map.at( key ) == key );
+    }
+    for ( int key : { 0, 512, 2, 1024 } ) {
+      CHECK( !map.contains( key ) );
+    }
+
+    // Erasing the last element of the run leaves the others where they are.
+    map.erase( 1 );
+    stats = map.stats();
+    CHECK( stats.probeHistogram == std::vector<uint32_t>( { 1, 1 } ) );
+    CHECK( stats.emptySlots + stats.elements == freeSlots );
+  }
+
+  //! A run longer than maxDistance in a table at most half full overflows into the stash instead of growing the table.
+  void stashesLongRuns() {
+
+    using map_type = rstd::hash_map<int, int, zero_hash>;
+
+    map_type map;
+    map.reserve( 1000 );
+    CHECK( map.bucketCount() == 2048 );
+    size_t tableBytes = map.memory_usage().table;
+
+    // 255 slots hold the run; the rest goes to the stash.
+    for ( int key = 0; key < 255; key++ ) {
+      map[key] = key;
+    }
+    CHECK( map.memory_usage().table == tableBytes );
+    for ( int key = 255; key < 300; key++ ) {
+      map[key] = key;
+    }
+    CHECK( map.bucketCount() == 2048 );
+    CHECK( map.memory_usage().table > tableBytes );
+    CHECK( map.stats().maxProbeLength > 255 );
+
+    std::unordered_map<int, int> reference;
+    for ( int key = 0; key < 300; key++ ) {
+      reference[key] = key;
+    }
+    checkEqual( map, reference );
+    CHECK( !map.contains( 300 ) );
+
+    // Stashed keys are found, overwritten and erased like the others, and so are those of the run in front of them.
+    map[299] = -299;
+    reference[299] = -299;
+    for ( int key = 0; key < 300; key += 7 ) {
+      map.erase( key );
+      reference.erase( key );
+    }
+    map.erase( 298 );
+    reference.erase( 298 );
+    checkEqual( map, reference );
+
+    // The slots freed in the run take new keys again.
+    for ( int key = 1000; key < 1010; key++ ) {
+      map[key] = key;
+      reference[key] = key;
+    }
+    checkEqual( map, reference );
+
+    // A rehash keeps the stashed elements, and copies take the stash along.
+    map.rehash( 4096 );
+    CHECK( map.bucketCount() == 4096 );
+    checkEqual( map, reference );
+    map_type copy( map );
+    checkEqual( copy, reference );
+
+    map.clear();
+    CHECK( map.empty() );
+    CHECK( !map.contains( 299 ) );
+  }
+
+  template< typename Hash >
+  using group_map = rstd::hash_map<int, int, Hash, std::equal_to<int>, std::allocator<std::pair<const int, int>>, policy<rstd::inline_storage, rstd::group_engine>>;
+
+  //! Erasing from full groups leaves tombstones that further probes pass over, and new keys take their slots first.
+  void groupTombstones() {
+
+    // Every key starts probing at the same group, so the keys fill it and the next ones.
+    group_map<zero_hash> map( 1024 );
+    for ( int key = 0; key < 40; key++ ) {
+      map[key] = key;
+    }
+    CHECK( map.stats().tombstones == 0 );
+
+    for ( int key = 0; key < 20; key++ ) {
+      map.erase( key );
+    }
+    rstd::hash_map_stats stats = map.stats();
+    CHECK( stats.tombstones > 0 );
+    CHECK( stats.emptySlots + stats.tombstones + stats.elements == map.bucketCount() );
+
+    // The keys behind the tombstones are still found, and the erased ones still miss.
+    for ( int key = 0; key < 40; key++ ) {
+      CHECK( map.contains( key ) == ( key >= 20 ) );
+    }
+
+    // New keys land on the tombstones, one each.
+    uint32_t tombstones = stats.tombstones;
+    for ( int key = 100; key < 100 + (int) tombstones; key++ ) {
+      map[key] = key;
+      CHECK( map.stats().tombstones == tombstones - (uint32_t) ( key - 99 ) );
+    }
+    CHECK( map.stats().emptySlots == stats.emptySlots );
+    for ( int key = 20; key < 40; key++ ) {
+      CHECK( map.at( key ) == key );
+    }
+
+    // Rebuilding drops whatever tombstones are left.
+    for ( int key = 20; key < 40; key++ ) {
+      map.erase( key );
+    }
+    CHECK( map.stats().tombstones > 0 );
+    map.rehash( 2048 );
+    CHECK( map.stats().tombstones == 0 );
+    CHECK( map.size() == tombstones );
+    for ( int key = 100; key < 100 + (int) tombstones; key++ ) {
+      CHECK( map.at( key ) == key );
+    }
+  }
+
+  //! A map whose size stays put while its keys churn gets filled up by tombstones, which a rehash at the same bucket count drops.
+  void tombstonesRehashInPlace() {
+
+    group_map<rstd::hash<int>> map( 1024 );
+    CHECK( map.bucketCount() == 1024 );
+
+    std::unordered_map<int, int> reference;
+    uint32_t mostTombstones = 0;
+    bool dropped = false;
+    for ( int key = 0; key < 20000; key++ ) {
+
+      map[key] = key;
+      reference[key] = key;
+      if ( key >= 700 ) {
+        map.erase( key - 700 );
+        reference.erase( key - 700 );
+      }
+
+      uint32_t tombstones = map.stats().tombstones;
+      dropped = dropped || ( tombstones == 0 && mostTombstones != 0 );
+      mostTombstones = tombstones > mostTombstones ? tombstones : mostTombstones;
+
+      // Tombstones count against the load factor, and never make the table grow.
+      CHECK( map.size() + tombstones < 820 );
+      CHECK( map.bucketCount() == 1024 );
+    }
+    // The tombstones filled the table up to the 819 elements of its load factor before they went.
+    CHECK( 700 + mostTombstones >= 819 );
+    CHECK( dropped );
+    checkEqual( map, reference );
+  }
+
+  template< typename T >
+  using compact_map = rstd::hash_map<int, T, rstd::hash<int>, std::equal_to<int>, std::allocator<std::pair<const int, T>>, policy<rstd::compact_storage, rstd::robin_hood_engine>>;
+
+  //! Erased cells go onto a free list, newest first, and new elements take them before the cell array grows.
+  void compactCellReuse() {
+
+    compact_map<std::string> map;
+    for ( int key = 0; key < 1000; key++ ) {
+      map[key] = valueOf<std::string>( key );
+    }
+    rstd::hash_map_memory_usage usage = map.memory_usage();
+
+    // The element of the key erased last is where the next new key goes.
+    const std::string* erased = &map.at( 500 );
+    map.erase( 7 );
+    map.erase( 500 );
+    map[2000] = valueOf<std::string>( 2000 );
+    CHECK( &map.at( 2000 ) == erased );
+    map[2001] = valueOf<std::string>( 2001 );
+
+    // Churning the keys at the same size keeps the cells, free ones counting as slack.
+    for ( int key = 0; key < 1000; key += 2 ) {
+      map.erase( key );
+    }
+    CHECK( map.memory_usage().elements == usage.elements );
+    CHECK( map.memory_usage().slack > usage.slack );
+    for ( int round = 0; round < 10; round++ ) {
+      for ( int key = 0; key < 500; key++ ) {
+        map[10000 + round * 500 + key] = valueOf<std::string>( key );
+      }
+      for ( int key = 0; key < 500; key++ ) {
+        map.erase( 10000 + round * 500 + key );
+      }
+    }
+    CHECK( map.memory_usage().elements == usage.elements );
+    CHECK( map.memory_usage().table == usage.table );
+
+    for ( int key = 1; key < 1000; key += 2 ) {
+      CHECK( key == 7 || map.at( key ) == valueOf<std::string>( key ) );
+    }
+    CHECK( map.at( 2000 ) == valueOf<std::string>( 2000 ) );
+    CHECK( map.size() == 501 );
+  }
+
+  //! Slots hold a 32-bit index whatever the element, and no map gets more elements than an index reaches.
+  void compactIndexLimit() {
+
+    compact_map<int> small;
+    compact_map<std::string> large;
+    small.reserve( 5000 );
+    large.reserve( 5000 );
+    CHECK( small.bucketCount() == large.bucketCount() );
+    CHECK( small.memory_usage().table == large.memory_usage().table );
+
+    // The cells are as big as the elements, and only the cells.
+    for ( int key = 0; key < 5000; key++ ) {
+      small[key] = key;
+      large[key] = valueOf<std::string>( key );
+    }
+    CHECK( small.memory_usage().table == large.memory_usage().table );
+    CHECK( small.memory_usage().elements >= 5000 * sizeof( std::pair<const int, int> ) );
+    CHECK( large.memory_usage().elements >= 5000 * sizeof( std::pair<const int, std::string> ) );
+
+    // Bucket counts stop at 2^31, so element indices stay clear of the UINT32_MAX ending the free list.
+    CHECK_THROWS( small.build( nullptr, nullptr, (size_t) 0x80000001u ), std::length_error );
+    CHECK( small.size() == 5000 );
+  }
+
+  //! Boxed elements never move, so references to them stay valid while the table grows, rehashes and shifts its runs.
+  template< typename Engine >
+  void boxedReferencesStay() {
+
+    using map_type = rstd::hash_map<int, std::string, rstd::hash<int>, std::equal_to<int>, std::allocator<std::pair<const int, std::string>>, policy<rstd::boxed_storage, Engine>>;
+
+    map_type map;
+    std::unordered_map<int, const std::string*> addresses;
+    for ( int key = 0; key < 100; key++ ) {
+      addresses[key] = &( map[key] = valueOf<std::string>( key ) );
+    }
+
+    uint32_t bucketCount = map.bucketCount();
+    for ( int key = 100; key < 20000; key++ ) {
+      map[key] = valueOf<std::string>( key );
+    }
+    CHECK( map.bucketCount() > bucketCount );
+    for ( int key = 100; key < 20000; key += 2 ) {
+      map.erase( key );
+    }
+    map.rehash( map.bucketCount() * 2 );
+
+    for ( const auto& entry : addresses ) {
+      CHECK( &map.at( entry.first ) == entry.second );
+      CHECK( *entry.second == valueOf<std::string>( entry.first ) );
+    }
+  }
+
+}
+
+int main() {
+  roundTripEngines<rstd::hash<int>>( 5000 );
+  roundTripEngines<degenerate_hash>( 1000 );
+  degenerateHash();
+  backwardShiftDeletion();
+  stashesLongRuns();
+  groupTombstones();
+  tombstonesRehashInPlace();
+  compactCellReuse();
+  compactIndexLimit();
+  boxedReferencesStay<rstd::robin_hood_engine>();
+  boxedReferencesStay<rstd::group_engine>();
+  return 0;
+}
@@ -0,0 +1,98 @@
+#include "hash_map.h"
+
+#include "check.h"
+
+#include <string>
+#include <string_view>
+
+namespace
+{
+
+  template< typename Engine >
+  struct policy : rstd::default_hash_map_policy
+  {
+    using engine = Engine;
+  };
+
+  template< typename Engine >
+  using string_map = rstd::hash_map<std::string, int, rstd::hash<std::string>, std::equal_to<>, std::allocator<std::pair<const std::string, int>>, policy<Engine>>;
+
+  //! A transparent Hash and KeyEqual look keys up by std::string_view and string literals, without building a std::string.
+  template< typename Engine >
+  void transparentLookups() {
+
+    string_map<Engine> map;
+    map.incremental_rehash( true );
+    for ( int i = 0; i < 5000; i++ ) {
+      map["key " + std::to_string( i )] = i;
+    }
+
+    std::string_view key = "key 77";
+    CHECK( map.contains( key ) );
+    CHECK( *map.find( key ) == 77 );
+    CHECK( map.at( key ) == 77 );
+    CHECK( map.count( key ) == 1 );
+    CHECK( map.contains( "key 78" ) );
+    CHECK( !map.contains( "missing" ) );
+
+    const string_map<Engine>& constMap = map;
+    CHECK( constMap.at( "key 2" ) == 2 );
+    CHECK_THROWS( constMap.at( "missing" ), std::out_of_range );
+
+    map.erase( key );
+    map.erase( "key 1" );
+    CHECK( !map.contains( key ) && !map.contains( "key 1" ) );
+    CHECK( map.size() == 4998 );
+  }
+
+  //! One hash of a key serves lookups and inserts in every map with an equal Hash.
+  template< typename Engine >
+  void hashedLookups() {
+
+    string_map<Engine> odd;
+    string_map<Engine> all;
+    for ( int i = 0; i < 1000; i++ ) {
+      all["key " + std::to_string( i )] = i;
+      if ( i % 2 == 1 ) {
+        odd["key " + std::to_string( i )] = -i;
+      }
+    }
+
+    size_t hash = all.hash_of( std::string_view( "key 77" ) );
+    CHECK( hash == odd.hash_of( std::string( "key 77" ) ) );
+    CHECK( *all.find_hashed( "key 77", hash ) == 77 );
+    CHECK( *odd.find_hashed( std::string( "key 77" ), hash ) == -77 );
+
+    hash = odd.hash_of( "key 78" );
+    CHECK( odd.find_hashed( "key 78", hash ) == nullptr );
+
+    std::pair<int*, bool> inserted = odd.try_emplace_hashed( std::string( "key 78" ), hash, 5 );
+    CHECK( inserted.second && *inserted.first == 5 );
+    inserted = odd.try_emplace_hashed( std::string( "key 78" ), hash, 6 );
+    CHECK( !inserted.second && *inserted.first == 5 );
+
+    CHECK( odd.erase_hashed( "key 78", hash ) );
+    CHECK( !odd.erase_hashed( "key 78", hash ) );
+  }
+
+  //! Without is_transparent, only K itself is taken.
+  void plainKeys() {
+    rstd::hash_map<int, int> map;
+    map[3] = 4;
+    CHECK( *map.find_hashed( 3, map.hash_of( 3 ) ) == 4 );
+    map.erase( 3 );
+    CHECK( !map.contains( 3 ) );
+  }
+
+}
+
+int main() {
+  transparentLookups<rstd::robin_hood_engine>();
+  transparentLookups<rstd::group_engine>();
+  transparentLookups<rstd::small_engine<4>>();
+  hashedLookups<rstd::robin_hood_engine>();
+  hashedLookups<rstd::group_engine>();
+  hashedLookups<rstd::small_engine<4>>();
+  plainKeys();
+  return 0;
+}
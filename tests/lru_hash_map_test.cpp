@@ -0,0 +1,111 @@
+#include "lru_hash_map.h"
+
+#include "check.h"
+
+#include <string>
+#include <vector>
+
+namespace
+{
+
+  //! Keeps small keys in key order in the table, so the clock hand meets them in that order. Counts its calls.
+  struct ordered_hash
+  {
+    uint64_t* calls = nullptr;
+
+    size_t operator()( int key ) const {
+      ( *calls )++;
+      return (size_t) key;
+    }
+  };
+
+  using cache_type = rstd::lru_hash_map<int, std::string, ordered_hash>;
+
+  //! The clock hand passes over elements hit since its last sweep and evicts the first one that was not.
+  void evictionOrder() {
+
+    uint64_t calls = 0;
+    std::vector<int> evicted;
+    cache_type cache( 4, [&evicted]( const int& key, std::string& value ) {
+      CHECK( value == std::to_string( key ) );
+      evicted.push_back( key );
+    }, ordered_hash{ &calls } );
+
+    for ( int key = 0; key < 4; key++ ) {
+      cache[key] = std::to_string( key );
+    }
+    CHECK( evicted.empty() );
+
+    // Every element is fresh, so the hand clears them all and comes back around to 0.
+    cache[4] = "4";
+    CHECK( evicted == std::vector<int>( { 0 } ) );
+
+    // 1 is hit, so the hand spares it once.
+    CHECK( cache.find( 1 ) != nullptr );
+    cache[5] = "5";
+    CHECK( evicted == std::vector<int>( { 0, 2 } ) );
+
+    cache[6] = "6";
+    CHECK( evicted == std::vector<int>( { 0, 2, 3 } ) );
+
+    // 4, 5 and 6 are fresh, and 1 has not been hit since the hand passed it.
+    cache[7] = "7";
+    CHECK( evicted == std::vector<int>( { 0, 2, 3, 1 } ) );
+
+    CHECK( cache.size() == 4 );
+    CHECK( cache.evictions() == 4 );
+    for ( int key = 4; key < 8; key++ ) {
+      CHECK( cache.contains( key ) );
+    }
+
+    // Neither peek() nor contains() counts as a hit.
+    CHECK( *cache.peek( 4 ) == "4" );
+    cache[8] = "8";
+    cache[9] = "9";
+    CHECK( !cache.contains( 4 ) && !cache.contains( 5 ) );
+  }
+
+  //! Every call hashes its key once, and the table reserved for the capacity does not grow.
+  void hashesOnce() {
+
+    uint64_t calls = 0;
+    cache_type cache( 64, cache_type::eviction_callback(), ordered_hash{ &calls } );
+    size_t tableBytes = cache.memory_usage().table;
+
+    for ( int key = 0; key < 1000; key++ ) {
+      calls = 0;
+      CHECK( cache.try_emplace( key, std::to_string( key ) ).second );
+      CHECK( !cache.try_emplace( key, "hit" ).second );
+      CHECK( !cache.insert_or_assign( key, std::to_string( key ) ).second );
+      CHECK( cache.insert_or_assign( key + 100000, "new" ).second );
+      cache[key + 200000] = "new";
+      CHECK( calls == 5 );
+    }
+
+    CHECK( cache.size() == 64 );
+    CHECK( cache.memory_usage().table == tableBytes );
+  }
+
+  void capacityChecks() {
+    using int_cache = rstd::lru_hash_map<int, int>;
+    CHECK_THROWS( int_cache( 0 ), std::invalid_argument );
+
+    int_cache single( 1 );
+    single[1] = 1;
+    single[2] = 2;
+    CHECK( single.size() == 1 );
+    CHECK( single.contains( 2 ) );
+
+    single.erase( 2 );
+    CHECK( single.empty() );
+    CHECK( single.evictions() == 1 );
+  }
+
+}
+
+int main() {
+  evictionOrder();
+  hashesOnce();
+  capacityChecks();
+  return 0;
+}
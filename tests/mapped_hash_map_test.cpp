@@ -0,0 +1,154 @@
+#include "mapped_hash_map.h"
+
+#include "check.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+  template< typename Engine, typename Storage >
+  struct policy : rstd::default_hash_map_policy
+  {
+    using engine = Engine;
+    using storage = Storage;
+  };
+
+  template< typename Engine, typename Storage >
+  using map_of = rstd::hash_map<uint64_t, double, rstd::hash<uint64_t>, std::equal_to<uint64_t>, std::allocator<std::pair<const uint64_t, double>>, policy<Engine, Storage>>;
+
+  struct degenerate_hash
+  {
+    size_t operator()( uint64_t key ) const {
+      return (size_t) ( key % 2 );
+    }
+  };
+
+  std::vector<char> readFile( const std::string& path ) {
+    std::ifstream in( path, std::ios::binary );
+    return std::vector<char>( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+  }
+
+  void writeFile( const std::string& path, const std::vector<char>& bytes ) {
+    std::ofstream out( path, std::ios::binary | std::ios::trunc );
+    out.write( bytes.data(), (std::streamsize) bytes.size() );
+  }
+
+  //! Saves the map and checks the mapped image holds exactly its elements.
+  template< typename Map >
+  void roundTrip( const Map& map, const std::string& path ) {
+
+    map.save( path );
+    rstd::mapped_hash_map<uint64_t, double> mapped = rstd::load_mmap<uint64_t, double>( path );
+
+    CHECK( mapped.size() == map.size() );
+    for ( const auto& entry : map ) {
+      const double* found = mapped.find( entry.first );
+      CHECK( found != nullptr && *found == entry.second );
+    }
+    CHECK( !mapped.contains( 1ull << 40 ) );
+
+    size_t visited = 0;
+    mapped.for_each( [&visited]( const std::pair<const uint64_t, double>& ) { visited++; } );
+    CHECK( visited == map.size() );
+
+    std::remove( path.c_str() );
+  }
+
+  void roundTrips() {
+
+    map_of<rstd::robin_hood_engine, rstd::inline_storage> robinHood;
+    for ( uint64_t key = 0; key < 100000; key++ ) {
+      robinHood[key * 7] = (double) key / 2;
+    }
+    roundTrip( robinHood, "mapped_robin_hood.img" );
+
+    // Images are always Robin Hood tables of inline elements; other engines and storages are converted on saving.
+    map_of<rstd::group_engine, rstd::inline_storage> group;
+    map_of<rstd::robin_hood_engine, rstd::compact_storage> compact;
+    map_of<rstd::robin_hood_engine, rstd::inline_storage> migrating;
+    migrating.incremental_rehash( true );
+    for ( uint64_t key = 0; key < 5000; key++ ) {
+      group[key] = (double) key;
+      compact[key] = (double) key;
+      migrating[key] = (double) key;
+      if ( key % 3 == 0 ) {
+        group.erase( key / 2 );
+      }
+    }
+    roundTrip( group, "mapped_group.img" );
+    roundTrip( compact, "mapped_compact.img" );
+    roundTrip( migrating, "mapped_migrating.img" );
+
+    roundTrip( map_of<rstd::robin_hood_engine, rstd::inline_storage>(), "mapped_empty.img" );
+  }
+
+  //! A damaged, foreign or missing image throws instead of being probed.
+  void rejectsBadImages() {
+
+    map_of<rstd::robin_hood_engine, rstd::inline_storage> map;
+    for ( uint64_t key = 0; key < 1000; key++ ) {
+      map[key] = (double) key;
+    }
+    map.save( "mapped_good.img" );
+    std::vector<char> good = readFile( "mapped_good.img" );
+
+    using view_type = rstd::mapped_hash_map<uint64_t, double>;
+
+    // Truncated: the slots or the sentinel ending the info bytes are cut off.
+    writeFile( "mapped_bad.img", std::vector<char>( good.begin(), good.end() - 1 ) );
+    CHECK_THROWS( view_type( "mapped_bad.img" ), std::runtime_error );
+    writeFile( "mapped_bad.img", std::vector<char>( good.begin(), good.begin() + 200 ) );
+    CHECK_THROWS( view_type( "mapped_bad.img" ), std::runtime_error );
+
+    // Not an image at all.
+    std::vector<char> garbage( good.size(), 'x' );
+    writeFile( "mapped_bad.img", garbage );
+    CHECK_THROWS( view_type( "mapped_bad.img" ), std::runtime_error );
+
+    // A corrupt header: a bucket count that is not a power of two.
+    std::vector<char> corrupt = good;
+    corrupt[offsetof( rstd::rstd_support::snapshot_header, bucketCount )] ^= 0x03;
+    writeFile( "mapped_bad.img", corrupt );
+    CHECK_THROWS( view_type( "mapped_bad.img" ), std::runtime_error );
+
+    // A corrupt sentinel.
+    corrupt = good;
+    corrupt.back() = 1;
+    writeFile( "mapped_bad.img", corrupt );
+    CHECK_THROWS( view_type( "mapped_bad.img" ), std::runtime_error );
+
+    // Another element layout.
+    using narrow_view_type = rstd::mapped_hash_map<uint32_t, double>;
+    CHECK_THROWS( narrow_view_type( "mapped_good.img" ), std::runtime_error );
+
+    CHECK_THROWS( view_type( "mapped_missing.img" ), std::runtime_error );
+    CHECK_THROWS( map.save( "missing_directory/mapped.img" ), std::runtime_error );
+
+    std::remove( "mapped_good.img" );
+    std::remove( "mapped_bad.img" );
+  }
+
+  //! Keys stashed for sharing a hash have no place in the image format, so saving them throws.
+  void rejectsStash() {
+    rstd::hash_map<uint64_t, double, degenerate_hash> map;
+    for ( uint64_t key = 0; key < 1000; key++ ) {
+      map[key] = (double) key;
+    }
+    CHECK_THROWS( map.save( "mapped_stash.img" ), std::runtime_error );
+    std::remove( "mapped_stash.img" );
+  }
+
+}
+
+int main() {
+  roundTrips();
+  rejectsBadImages();
+  rejectsStash();
+  return 0;
+}
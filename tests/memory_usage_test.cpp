@@ -0,0 +1,151 @@
+#include "hash_map.h"
+
+#include "check.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace
+{
+
+  //! Sends key k to bucket k, so keys below the bucket count never share one.
+  struct identity_hash
+  {
+    size_t operator()( int key ) const {
+      return (size_t) key;
+    }
+  };
+
+  //! Sends every key to one of four buckets.
+  struct degenerate_hash
+  {
+    size_t operator()( int key ) const {
+      return (size_t) ( key % 4 );
+    }
+  };
+
+  struct boxed_policy : rstd::default_hash_map_policy
+  {
+    using storage = rstd::boxed_storage;
+  };
+
+  using value_type = std::pair<const int, int>;
+
+  //! The slots of a Robin Hood table: its buckets plus an overflow tail of up to 255.
+  size_t robinHoodSlotCount( uint32_t bucketCount ) {
+    return bucketCount + ( bucketCount < 255 ? bucketCount : 255 );
+  }
+
+  //! The bytes of a Robin Hood table block: its slots, then one info byte per slot and one past the end, rounded up to whole slots.
+  size_t robinHoodBlockBytes( uint32_t bucketCount, size_t slotSize ) {
+    size_t slotCount = robinHoodSlotCount( bucketCount );
+    return ( slotCount + ( slotCount + slotSize ) / slotSize ) * slotSize;
+  }
+
+  //! Inline elements: every byte is in the table block, and slack is the empty slots.
+  void inlineElements() {
+
+    rstd::hash_map<int, int> map;
+    rstd::hash_map_memory_usage usage = map.memory_usage();
+    CHECK( map.bucketCount() == 256 );
+    CHECK( usage.object == sizeof( map ) );
+    CHECK( usage.table == robinHoodBlockBytes( 256, sizeof( value_type ) ) );
+    CHECK( usage.elements == 0 );
+    CHECK( usage.slack == robinHoodSlotCount( 256 ) * sizeof( value_type ) );
+    CHECK( usage.total() == usage.object + usage.table );
+    CHECK( map.load_factor() == 0.0f );
+    CHECK( map.max_bucket_density() == 0 );
+    CHECK( map.bytes_per_entry() == 0.0 );
+
+    // 1000 elements at a load factor of 0.8 need 1251 buckets, rounded up to 2048.
+    map.reserve( 1000 );
+    CHECK( map.bucketCount() == 2048 );
+    size_t tableBytes = robinHoodBlockBytes( 2048, sizeof( value_type ) );
+    CHECK( map.memory_usage().table == tableBytes );
+    CHECK( map.memory_usage().slack == robinHoodSlotCount( 2048 ) * sizeof( value_type ) );
+
+    for ( int key = 0; key < 1000; key++ ) {
+      map[key] = key;
+    }
+
+    usage = map.memory_usage();
+    CHECK( usage.table == tableBytes );
+    CHECK( usage.elements == 0 );
+    CHECK( usage.slack == ( robinHoodSlotCount( 2048 ) - 1000 ) * sizeof( value_type ) );
+    CHECK( map.load_factor() == 1000.0f / 2048 );
+    CHECK( map.bytes_per_entry() == (double) ( sizeof( map ) + tableBytes ) / 1000 );
+
+    // Erasing keeps the table and frees its slots.
+    for ( int key = 0; key < 500; key++ ) {
+      map.erase( key );
+    }
+
+    usage = map.memory_usage();
+    CHECK( usage.table == tableBytes );
+    CHECK( usage.slack == ( robinHoodSlotCount( 2048 ) - 500 ) * sizeof( value_type ) );
+    CHECK( map.load_factor() == 500.0f / 2048 );
+    CHECK( map.bytes_per_entry() == (double) ( sizeof( map ) + tableBytes ) / 500 );
+  }
+
+  //! Boxed elements: the slots hold pointers, and every element is counted separately.
+  void boxedElements() {
+
+    rstd::hash_map<int, int, rstd::hash<int>, std::equal_to<int>, std::allocator<value_type>, boxed_policy> map( 1024 );
+    for ( int key = 0; key < 600; key++ ) {
+      map[key] = key;
+    }
+
+    rstd::hash_map_memory_usage usage = map.memory_usage();
+    CHECK( map.bucketCount() == 1024 );
+    CHECK( usage.table == robinHoodBlockBytes( 1024, sizeof( value_type* ) ) );
+    CHECK( usage.elements == 600 * sizeof( value_type ) );
+    CHECK( usage.slack == ( robinHoodSlotCount( 1024 ) - 600 ) * sizeof( value_type* ) );
+    CHECK( usage.total() == sizeof( map ) + usage.table + usage.elements );
+
+    for ( int key = 0; key < 600; key += 2 ) {
+      map.erase( key );
+    }
+    usage = map.memory_usage();
+    CHECK( usage.elements == 300 * sizeof( value_type ) );
+    CHECK( usage.slack == ( robinHoodSlotCount( 1024 ) - 300 ) * sizeof( value_type* ) );
+  }
+
+  //! Known densities: one element per bucket, then four buckets sharing every key, stashed ones included.
+  void bucketDensities() {
+
+    rstd::hash_map<int, int, identity_hash> spread;
+    for ( int key = 0; key < 100; key++ ) {
+      spread[key] = key;
+    }
+    CHECK( spread.max_bucket_density() == 1 );
+    CHECK( spread.bucketDensity( 42 ) == 1 );
+
+    rstd::hash_map<int, int, degenerate_hash> clustered;
+    for ( int key = 0; key < 100; key++ ) {
+      clustered[key] = key;
+    }
+    CHECK( clustered.max_bucket_density() == 25 );
+    CHECK( clustered.bucketDensity( 3 ) == 25 );
+
+    for ( int key = 0; key < 100; key += 4 ) {
+      clustered.erase( key );
+    }
+    CHECK( clustered.max_bucket_density() == 25 );
+    CHECK( clustered.bucketDensity( 0 ) == 0 );
+
+    // Runs this long spill into the stash, which still counts towards its home buckets.
+    for ( int key = 0; key < 2000; key++ ) {
+      clustered[key] = key;
+    }
+    CHECK( clustered.max_bucket_density() == 500 );
+    CHECK( clustered.bucketDensity( 1 ) == 500 );
+  }
+
+}
+
+int main() {
+  inlineElements();
+  boxedElements();
+  bucketDensities();
+  return 0;
+}
@@ -0,0 +1,141 @@
+#include "hash_map.h"
+
+#include "check.h"
+
+#include <memory>
+#include <string>
+
+namespace
+{
+
+  template< typename Engine, typename Storage >
+  struct policy : rstd::default_hash_map_policy
+  {
+    using engine = Engine;
+    using storage = Storage;
+  };
+
+  //! std::allocator with a tag, unequal to allocators of another tag.
+  template< typename V >
+  struct tagged_allocator : std::allocator<V>
+  {
+    int tag = 0;
+
+    template< typename U >
+    struct rebind
+    {
+      using other = tagged_allocator<U>;
+    };
+
+    tagged_allocator() = default;
+
+    explicit tagged_allocator( int allocatorTag ) :
+      tag( allocatorTag ) {}
+
+    template< typename U >
+    tagged_allocator( const tagged_allocator<U>& other ) :
+      tag( other.tag ) {}
+  };
+
+  template< typename V1, typename V2 >
+  bool operator==( const tagged_allocator<V1>& allocator1, const tagged_allocator<V2>& allocator2 ) {
+    return allocator1.tag == allocator2.tag;
+  }
+
+  template< typename V1, typename V2 >
+  bool operator!=( const tagged_allocator<V1>& allocator1, const tagged_allocator<V2>& allocator2 ) {
+    return allocator1.tag != allocator2.tag;
+  }
+
+  using value = std::unique_ptr<int>;
+
+  template< typename Engine, typename Storage, typename Allocator = std::allocator<std::pair<const std::string, value>> >
+  using map_of = rstd::hash_map<std::string, value, rstd::hash<std::string>, std::equal_to<std::string>, Allocator, policy<Engine, Storage>>;
+
+  std::string keyOf( int i ) {
+    return "key " + std::to_string( i );
+  }
+
+  //! Moves move-only values between maps through nodes, without touching the values themselves.
+  template< typename Map >
+  void extractAndInsert( bool incremental ) {
+
+    Map hot;
+    Map cold;
+    hot.incremental_rehash( incremental );
+    for ( int i = 0; i < 3000; i++ ) {
+      hot[keyOf( i )] = std::make_unique<int>( i );
+    }
+
+    for ( int i = 0; i < 3000; i += 2 ) {
+      typename Map::node_type node = hot.extract( keyOf( i ) );
+      CHECK( node && *node.mapped() == i );
+      const int* pointee = node.mapped().get();
+
+      typename Map::insert_return_type result = cold.insert( std::move( node ) );
+      CHECK( result.inserted && !result.node );
+      CHECK( result.position->get() == pointee );
+    }
+    CHECK( hot.size() == 1500 && cold.size() == 1500 );
+    CHECK( hot.extract( "missing" ).empty() );
+
+    typename Map::node_type first = hot.extract( hot.begin() );
+    CHECK( hot.size() == 1499 );
+    CHECK( hot.insert( std::move( first ) ).inserted );
+
+    // A key already present hands the node back untouched.
+    typename Map::node_type renamed = cold.extract( keyOf( 0 ) );
+    renamed.key() = keyOf( 1 );
+    typename Map::insert_return_type result = hot.insert( std::move( renamed ) );
+    CHECK( !result.inserted && result.node && result.node.key() == keyOf( 1 ) && **result.position == 1 );
+
+    typename Map::insert_return_type empty = hot.insert( typename Map::node_type() );
+    CHECK( !empty.inserted && empty.position == nullptr );
+
+    for ( int i = 1; i < 3000; i += 2 ) {
+      CHECK( *hot.at( keyOf( i ) ) == i );
+    }
+    for ( int i = 2; i < 3000; i += 2 ) {
+      CHECK( *cold.at( keyOf( i ) ) == i );
+    }
+  }
+
+  //! A node from a map with an unequal allocator is rebuilt in the allocator of the target.
+  template< typename Map >
+  void acrossAllocators() {
+
+    Map source( 8, {}, {}, typename Map::allocator_type( 1 ) );
+    Map target( 8, {}, {}, typename Map::allocator_type( 2 ) );
+    for ( int i = 0; i < 100; i++ ) {
+      source[keyOf( i )] = std::make_unique<int>( i );
+    }
+
+    for ( int i = 0; i < 100; i++ ) {
+      CHECK( target.insert( source.extract( keyOf( i ) ) ).inserted );
+    }
+    CHECK( source.empty() );
+    for ( int i = 0; i < 100; i++ ) {
+      CHECK( *target.at( keyOf( i ) ) == i );
+    }
+
+    source.merge( target );
+    CHECK( source.size() == 100 && target.empty() );
+  }
+
+}
+
+int main() {
+
+  for ( bool incremental : { false, true } ) {
+    extractAndInsert<map_of<rstd::robin_hood_engine, rstd::inline_storage>>( incremental );
+    extractAndInsert<map_of<rstd::robin_hood_engine, rstd::boxed_storage>>( incremental );
+    extractAndInsert<map_of<rstd::group_engine, rstd::compact_storage>>( incremental );
+    extractAndInsert<map_of<rstd::small_engine<8>, rstd::boxed_storage>>( incremental );
+    extractAndInsert<map_of<rstd::small_engine<8, rstd::group_engine>, rstd::compact_storage>>( incremental );
+  }
+
+  using tagged = tagged_allocator<std::pair<const std::string, value>>;
+  acrossAllocators<map_of<rstd::robin_hood_engine, rstd::boxed_storage, tagged>>();
+  acrossAllocators<map_of<rstd::group_engine, rstd::inline_storage, tagged>>();
+  return 0;
+}
@@ -0,0 +1,188 @@
+#include "pool_allocator.h"
+#include "hash_map.h"
+
+#include "check.h"
+
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+//! Blocks currently held from the global operator new, which pool_resource draws its slabs and big blocks from.
+static size_t liveBlocks = 0;
+
+void* operator new( size_t bytes ) {
+  if ( void* pointer = std::malloc( bytes == 0 ? 1 : bytes ) ) {
+    liveBlocks++;
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete( void* pointer ) noexcept {
+  if ( pointer != nullptr ) {
+    liveBlocks--;
+    std::free( pointer );
+  }
+}
+
+void operator delete( void* pointer, size_t ) noexcept {
+  operator delete( pointer );
+}
+
+namespace
+{
+
+  struct boxed_policy : rstd::default_hash_map_policy
+  {
+    using storage = rstd::boxed_storage;
+  };
+
+  using pool_type = rstd::pool_allocator<std::pair<const int, std::string>>;
+  using pooled_map = rstd::hash_map<int, std::string, rstd::hash<int>, std::equal_to<int>, pool_type, boxed_policy>;
+
+  //! Freed blocks are handed out again, newest first, before the slab is bumped any further.
+  void reusesFreedBlocks() {
+
+    rstd::pool_allocator<uint64_t> pool;
+    CHECK( pool.resource().slabBytes() == 0 );
+
+    uint64_t* first = pool.allocate( 2 );
+    uint64_t* second = pool.allocate( 2 );
+    CHECK( pool.resource().slabBytes() == rstd::pool_resource::slabSize );
+    CHECK( first != second );
+
+    pool.deallocate( first, 2 );
+    pool.deallocate( second, 2 );
+    CHECK( pool.allocate( 2 ) == second );
+    CHECK( pool.allocate( 2 ) == first );
+
+    // Another size class has a free list of its own.
+    uint64_t* wide = pool.allocate( 6 );
+    pool.deallocate( wide, 6 );
+    CHECK( pool.allocate( 2 ) != wide );
+    CHECK( pool.allocate( 6 ) == wide );
+
+    // Filling more than a slab adds one, and refilling after freeing it all adds none.
+    std::vector<uint64_t*> blocks;
+    for ( size_t i = 0; i < 2 * rstd::pool_resource::slabSize / 16; i++ ) {
+      blocks.push_back( pool.allocate( 2 ) );
+    }
+    size_t slabBytes = pool.resource().slabBytes();
+    CHECK( slabBytes > rstd::pool_resource::slabSize );
+    for ( uint64_t* block : blocks ) {
+      pool.deallocate( block, 2 );
+    }
+    for ( uint64_t*& block : blocks ) {
+      block = pool.allocate( 2 );
+    }
+    CHECK( pool.resource().slabBytes() == slabBytes );
+  }
+
+  //! Requests past maxPooledSize go straight to operator new and never touch a slab.
+  void passesOnLargeRequests() {
+
+    rstd::pool_allocator<char> pool;
+    size_t blocks = liveBlocks;
+
+    char* large = pool.allocate( rstd::pool_resource::maxPooledSize + 1 );
+    CHECK( liveBlocks == blocks + 1 );
+    CHECK( pool.resource().slabBytes() == 0 );
+
+    pool.deallocate( large, rstd::pool_resource::maxPooledSize + 1 );
+    CHECK( liveBlocks == blocks );
+  }
+
+  //! Slabs go back to the system all at once, on release() or with the last allocator sharing the pool.
+  void releasesSlabs() {
+
+    size_t blocks = liveBlocks;
+    {
+      rstd::pool_allocator<uint64_t> pool;
+      for ( int i = 0; i < 10000; i++ ) {
+        pool.allocate( 1 );
+      }
+      CHECK( liveBlocks > blocks );
+
+      pool.resource().release();
+      CHECK( pool.resource().slabBytes() == 0 );
+      // The pool itself remains, held by the allocator.
+      CHECK( liveBlocks == blocks + 1 );
+
+      for ( int i = 0; i < 10000; i++ ) {
+        pool.allocate( 1 );
+      }
+    }
+    CHECK( liveBlocks == blocks );
+  }
+
+  //! Copies and rebound copies share one pool and compare equal; default constructed ones and copy constructed containers get their own.
+  void sharesPoolBetweenCopies() {
+
+    rstd::pool_allocator<uint64_t> pool;
+    rstd::pool_allocator<uint64_t> copy( pool );
+    rstd::pool_allocator<char> rebound( pool );
+
+    CHECK( copy == pool );
+    CHECK( rebound == pool );
+    CHECK( !( rebound != pool ) );
+    CHECK( &copy.resource() == &pool.resource() );
+
+    copy.allocate( 1 );
+    CHECK( pool.resource().slabBytes() == rstd::pool_resource::slabSize );
+
+    rstd::pool_allocator<uint64_t> other;
+    CHECK( other != pool );
+
+    rstd::pool_allocator<uint64_t> selected = pool.select_on_container_copy_construction();
+    CHECK( selected != pool );
+    CHECK( selected.resource().slabBytes() == 0 );
+  }
+
+  //! A boxed map keeps drawing its elements from the one pool, reusing erased ones.
+  void boxedMap() {
+
+    size_t blocks = liveBlocks;
+    {
+      pool_type pool;
+      pooled_map map( 256, rstd::hash<int>(), std::equal_to<int>(), pool );
+      CHECK( map.get_allocator() == pool );
+
+      for ( int key = 0; key < 20000; key++ ) {
+        map.try_emplace( key, "value " + std::to_string( key ) );
+      }
+      size_t slabBytes = pool.resource().slabBytes();
+      CHECK( slabBytes >= 20000 * sizeof( std::pair<const int, std::string> ) );
+
+      for ( int key = 0; key < 20000; key++ ) {
+        map.erase( key );
+      }
+      CHECK( map.empty() );
+
+      // Refilling takes the erased elements off the free list.
+      for ( int key = 20000; key < 40000; key++ ) {
+        map.try_emplace( key, "value " + std::to_string( key ) );
+      }
+      CHECK( pool.resource().slabBytes() == slabBytes );
+      CHECK( map.at( 39999 ) == "value 39999" );
+
+      // A copied map draws from a fresh pool of its own.
+      pooled_map copy( map );
+      CHECK( copy.get_allocator() != map.get_allocator() );
+      CHECK( copy.get_allocator().resource().slabBytes() >= 20000 * sizeof( std::pair<const int, std::string> ) );
+      CHECK( pool.resource().slabBytes() == slabBytes );
+      CHECK( copy.at( 20000 ) == "value 20000" );
+    }
+    CHECK( liveBlocks == blocks );
+  }
+
+}
+
+int main() {
+  reusesFreedBlocks();
+  passesOnLargeRequests();
+  releasesSlabs();
+  sharesPoolBetweenCopies();
+  boxedMap();
+  return 0;
+}
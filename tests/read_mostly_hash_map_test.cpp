@@ -0,0 +1,107 @@
+#include "read_mostly_hash_map.h"
+
+#include "check.h"
+#include "counting_allocator.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+  void singleThreaded() {
+
+    rstd::read_mostly_hash_map<int, std::string> map( 4 );
+
+    for ( int key = 0; key < 1000; key++ ) {
+      CHECK( map.try_emplace( key, std::to_string( key ) ) );
+    }
+    CHECK( map.size() == 1000 );
+    CHECK( map.bucketCount() >= 1000 );
+    CHECK( !map.try_emplace( 1, "again" ) );
+    CHECK( *map.find( 1 ) == "1" );
+
+    CHECK( !map.insert_or_assign( 1, std::string( "one" ) ) );
+    CHECK( map.insert_or_assign( 1000, std::string( "1000" ) ) );
+    CHECK( *map.find( 1 ) == "one" );
+
+    CHECK( map.erase( 2 ) );
+    CHECK( !map.erase( 2 ) );
+    CHECK( !map.contains( 2 ) );
+    CHECK( map.size() == 1000 );
+
+    map.clear();
+    CHECK( map.empty() );
+    CHECK( !map.find( 1 ).has_value() );
+  }
+
+  //! Nodes and bucket arrays both come from the allocator, and all of it goes back.
+  void allocatorOnly() {
+    {
+      rstd::read_mostly_hash_map<int, int, rstd::hash<int>, std::equal_to<int>, counting_allocator<std::pair<const int, int>>> map( 2 );
+      size_t empty = allocatedBytes;
+      CHECK( empty >= 2 * sizeof( void* ) );
+
+      for ( int key = 0; key < 5000; key++ ) {
+        map.try_emplace( key, key );
+      }
+      map.reclaim();
+      CHECK( allocatedBytes > empty );
+
+      map.clear();
+      map.reclaim();
+    }
+    CHECK( allocatedBytes == 0 );
+  }
+
+  //! Readers keep finding every key that is never erased while a writer inserts, grows and erases.
+  void readersDuringGrowth() {
+
+    rstd::read_mostly_hash_map<int, int> map( 8 );
+    for ( int key = 0; key < 100; key++ ) {
+      map.try_emplace( key, key );
+    }
+
+    std::atomic<bool> done{ false };
+    std::atomic<uint64_t> misses{ 0 };
+    std::vector<std::thread> readers;
+
+    for ( int reader = 0; reader < 4; reader++ ) {
+      readers.emplace_back( [&]() {
+        while ( !done.load( std::memory_order_relaxed ) ) {
+          for ( int key = 0; key < 100; key++ ) {
+            std::optional<int> found = map.find( key );
+            misses += !found.has_value() || *found != key;
+          }
+        }
+      } );
+    }
+
+    for ( int key = 100; key < 50000; key++ ) {
+      map.try_emplace( key, key );
+      if ( key % 3 == 0 && key >= 200 ) {
+        map.erase( key - 100 );
+      }
+    }
+
+    done = true;
+    for ( std::thread& reader : readers ) {
+      reader.join();
+    }
+
+    CHECK( misses == 0 );
+    for ( int key = 0; key < 100; key++ ) {
+      CHECK( map.contains( key ) );
+    }
+  }
+
+}
+
+int main() {
+  singleThreaded();
+  allocatorOnly();
+  readersDuringGrowth();
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include "hash_map.h"
+
+#include "check.h"
+
+#include <string>
+#include <vector>
+
+namespace
+{
+
+  template< typename Engine >
+  struct policy : rstd::default_hash_map_policy
+  {
+    using engine = Engine;
+  };
+
+  template< typename T, typename Engine >
+  using map_of = rstd::hash_map<int, T, rstd::hash<int>, std::equal_to<int>, std::allocator<std::pair<const int, T>>, policy<Engine>>;
+
+  //! The buffer lives in the map once: the old table of an incremental rehash is the wrapped table alone.
+  void bufferHeldOnce() {
+    static_assert( sizeof( map_of<int, rstd::small_engine<8>> ) <= sizeof( map_of<int, rstd::robin_hood_engine> ) + 8 * sizeof( std::pair<const int, int> ) + 8,
+      "small_engine holds its buffer once" );
+    static_assert( sizeof( map_of<int, rstd::small_engine<8, rstd::group_engine>> ) <= sizeof( map_of<int, rstd::group_engine> ) + 8 * sizeof( std::pair<const int, int> ) + 8,
+      "small_engine holds its buffer once" );
+  }
+
+  //! Fills the buffer, spills and grows incrementally, erasing along the way.
+  template< typename Engine >
+  void spillAndMigrate() {
+
+    map_of<std::string, Engine> map;
+    map.incremental_rehash( true );
+
+    for ( int key = 0; key < 8; key++ ) {
+      map[key] = std::to_string( key );
+    }
+    CHECK( map.memory_usage().table == 0 );
+
+    std::vector<bool> erased( 10000, false );
+    bool migrated = false;
+    for ( int key = 8; key < 10000; key++ ) {
+      map[key] = std::to_string( key );
+      migrated = migrated || map.rehash_in_progress();
+      if ( key % 7 == 0 ) {
+        map.erase( key / 2 );
+        erased[key / 2] = true;
+      }
+    }
+    CHECK( migrated );
+
+    for ( int key = 0; key < 10000; key++ ) {
+      CHECK( map.contains( key ) == !erased[key] );
+      if ( !erased[key] ) {
+        CHECK( map.at( key ) == std::to_string( key ) );
+      }
+    }
+
+    map_of<std::string, Engine> copy( map );
+    CHECK( copy.size() == map.size() );
+
+    map.clear();
+    CHECK( map.empty() );
+  }
+
+  //! A buffer filled up to the load factor spills into a bigger table, not one at the bucket count it had.
+  template< typename Engine >
+  void spillKeepsLoadFactor() {
+
+    map_of<int, Engine> map( 16 );
+    map.max_load_factor( 0.5f );
+    for ( int key = 0; key < 9; key++ ) {
+      map[key] = key;
+      CHECK( map.load_factor() <= 0.5f );
+    }
+    CHECK( map.bucketCount() == 32 );
+
+    // A buffer full well below the load factor spills at the bucket count reserved for it.
+    map_of<int, Engine> reserved;
+    reserved.reserve( 1000 );
+    uint32_t bucketCount = reserved.bucketCount();
+    for ( int key = 0; key < 9; key++ ) {
+      reserved[key] = key;
+    }
+    CHECK( reserved.bucketCount() == bucketCount );
+  }
+
+}
+
+int main() {
+  bufferHeldOnce();
+  spillAndMigrate<rstd::small_engine<8>>();
+  spillAndMigrate<rstd::small_engine<8, rstd::group_engine>>();
+  spillKeepsLoadFactor<rstd::small_engine<8>>();
+  spillKeepsLoadFactor<rstd::small_engine<8, rstd::group_engine>>();
+  return 0;
+}
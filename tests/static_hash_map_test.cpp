@@ -0,0 +1,68 @@
+#include "static_hash_map.h"
+
+#include "check.h"
+
+namespace
+{
+
+  enum class opcode : uint8_t { add, sub, mul, nop };
+
+  constexpr int add( int a, int b ) {
+    return a + b;
+  }
+
+  constexpr int sub( int a, int b ) {
+    return a - b;
+  }
+
+  constexpr int mul( int a, int b ) {
+    return a * b;
+  }
+
+  using operation = int ( * )( int, int );
+
+  //! Built and probed entirely at compile time.
+  constexpr rstd::static_hash_map<opcode, operation, 4> operations{ { opcode::add, &add }, { opcode::sub, &sub }, { opcode::mul, &mul } };
+
+  static_assert( operations.size() == 3, "every entry is in" );
+  static_assert( operations.at( opcode::mul )( 6, 7 ) == 42, "lookups run in constant expressions" );
+  static_assert( operations.find( opcode::sub ) != nullptr && !operations.contains( opcode::nop ), "missing keys are missing" );
+
+  constexpr rstd::static_hash_map<int, int, 30> squares = [] {
+    rstd::static_hash_map<int, int, 30> map;
+    for ( int i = 0; i < 30; i++ ) {
+      map.insert_or_assign( i * 1000, i * i );
+    }
+    return map;
+  }();
+
+  static_assert( squares.size() == 30, "filled by a constexpr lambda" );
+  static_assert( squares.value_or( 29000, -1 ) == 841 && squares.value_or( 5, -1 ) == -1, "value_or() falls back on missing keys" );
+
+  // A repeated key assigns over the first value.
+  static_assert( rstd::static_hash_map<int, int, 2>{ { 1, 1 }, { 1, 2 } }.at( 1 ) == 2, "later entries win" );
+  static_assert( rstd::static_hash_map<int, int, 2>{ { 1, 1 }, { 1, 2 } }.size() == 1, "a repeated key is one entry" );
+
+  void runtimeUse() {
+
+    rstd::static_hash_map<int, int, 8> map;
+    for ( int key = 0; key < 8; key++ ) {
+      CHECK( map.insert_or_assign( key, key ) );
+    }
+    CHECK_THROWS( map.insert_or_assign( 8, 8 ), std::length_error );
+
+    CHECK( !map.insert_or_assign( 3, 33 ) );
+    CHECK( *map.find( 3 ) == 33 );
+    CHECK_THROWS( map.at( 100 ), std::out_of_range );
+
+    int total = 0;
+    map.for_each( [&total]( int key, int value ) { total += key + value; } );
+    CHECK( total == 28 + 28 + 30 );
+  }
+
+}
+
+int main() {
+  runtimeUse();
+  return 0;
+}